@@ -64,11 +64,22 @@ typedef struct Glyph {
   i32 advance;
   i32 bearing_x;
   i32 bearing_y;
-  u16 codepoint;
+  u32 codepoint;
 } Glyph;
 
+/* NOTE: Glyphs outside of ascii are rasterized the first time they are drawn into
+   a cache of sets of FONT_GLYPH_CACHE_WAYS glyphs picked by codepoint. A full set
+   drops the glyph that was drawn the longest time ago */
+#define FONT_GLYPH_CACHE_SIZE 2048
+#define FONT_GLYPH_CACHE_WAYS 8
+
 typedef struct Font {
   Glyph glyph_table[128];
+  /* NOTE: A zero codepoint is a free slot, used is the clock of the last draw */
+  Glyph glyph_cache[FONT_GLYPH_CACHE_SIZE];
+  u32 glyph_cache_used[FONT_GLYPH_CACHE_SIZE];
+  u32 glyph_cache_clock;
+  void *face;
   u32 advance;
   u32 line_gap;
   i32 ascender;
@@ -77,15 +88,80 @@ typedef struct Font {
 
 QUILL_PLATFORM_API Font *font_load_from_file(u8 *filename, u32 font_size);
 QUILL_PLATFORM_API void font_destroy(Font *font);
-Glyph *font_get_glyph(u16 codepoint);
+QUILL_PLATFORM_API Glyph *font_get_glyph(Font *font, u32 codepoint);
 
 typedef struct ByteArray {
   u8 *data;
-  u32 size;
+  u64 size;
 } ByteArray;
 
 QUILL_PLATFORM_API ByteArray load_entire_file(u8 *filename);
-QUILL_PLATFORM_API struct Folder *platform_load_folder(u8 *foldername);
+
+/* NOTE: Read only, copy on write mapping of a whole file */
+typedef struct MappedFile {
+  u8 *data;
+  u64 size;
+} MappedFile;
+
+/* NOTE: Two infos are the same file with the same contents when every field matches,
+   the modified time is in nanoseconds */
+typedef struct PlatformFileInfo {
+  u64 size;
+  u64 modified_time;
+  u64 device;
+  u64 inode;
+} PlatformFileInfo;
+
+QUILL_PLATFORM_API bool platform_get_file_info(u8 *filename, PlatformFileInfo *info);
+/* NOTE: Read up to size bytes from the start of the file, returns how many were read */
+QUILL_PLATFORM_API u64 platform_read_file_head(u8 *filename, u8 *buffer, u64 size);
+
+/* NOTE: Read the whole file into a heap buffer, false when it cannot be read. The
+   size of info is the number of bytes read */
+QUILL_PLATFORM_API bool platform_try_read_file(u8 *filename, ByteArray *bytes, PlatformFileInfo *info);
+
+QUILL_PLATFORM_API MappedFile platform_map_file(u8 *filename);
+/* NOTE: Same as platform_map_file but it returns false instead of exiting, info is
+   the file that was mapped. A page of the mapping past the end of a file truncated on
+   disk reads as zeros instead of faulting */
+QUILL_PLATFORM_API bool platform_try_map_file(u8 *filename, MappedFile *mapping, PlatformFileInfo *info);
+QUILL_PLATFORM_API void platform_unmap_file(MappedFile mapping);
+/* NOTE: Hints for a range of a mapping, released pages are read again from the
+   file the next time they are touched and prefetched pages are read ahead */
+QUILL_PLATFORM_API void platform_release_mapped_range(MappedFile mapping, u64 offset, u64 size);
+QUILL_PLATFORM_API void platform_prefetch_mapped_range(MappedFile mapping, u64 offset, u64 size);
+/* NOTE: Write the spans one after the other with as few system calls as possible
+   into a temporary file that replaces filename once it is on disk, when the save
+   fails filename is not touched. info is the file that was written. With
+   allow_in_place, when the spans do not point into filename, a file that cannot be
+   replaced keeping its owner and links, or whose folder is not writable, is
+   written in place instead */
+QUILL_PLATFORM_API bool platform_write_file_spans(u8 *filename, ByteArray *spans, u32 span_count, PlatformFileInfo *info, bool allow_in_place);
+/* NOTE: Files that are written a piece at a time, the functions return 0 or false
+   when the file system fails and the callers keep going without the file */
+QUILL_PLATFORM_API void *platform_open_append_file(u8 *filename, bool truncate);
+QUILL_PLATFORM_API bool platform_append_file(void *file, u8 *data, u64 size);
+QUILL_PLATFORM_API void platform_close_append_file(void *file);
+/* NOTE: An append file with no name that is gone once it is closed, what was
+   appended can be read back from any offset */
+QUILL_PLATFORM_API void *platform_open_temp_file(void);
+QUILL_PLATFORM_API bool platform_read_file_at(void *file, u64 offset, u8 *buffer, u64 size);
+QUILL_PLATFORM_API bool platform_file_exists(u8 *filename);
+QUILL_PLATFORM_API bool platform_rename_file(u8 *filename, u8 *new_filename);
+QUILL_PLATFORM_API void platform_delete_file(u8 *filename);
+/* NOTE: Returns true when the folder was created or was already there */
+QUILL_PLATFORM_API bool platform_create_folder(u8 *foldername);
+/* NOTE: The modified time is in nanoseconds like in PlatformFileInfo */
+typedef struct PlatformFolderEntry {
+  u8 name[256];
+  bool is_folder;
+  u64 size;
+  u64 modified_time;
+} PlatformFolderEntry;
+
+/* NOTE: Push the entries of the folder into the entries vector, only the metadata
+   is read. Links to folders are left out so a walk never loops */
+QUILL_PLATFORM_API bool platform_list_folder(u8 *foldername, PlatformFolderEntry **entries);
 
 typedef struct Platform {
   BackBuffer *backbuffer;
@@ -96,6 +172,39 @@ typedef struct Platform {
   void *data;
 } Platform;
 
+typedef i32 PlatformThreadProc(void *data);
+
+QUILL_PLATFORM_API void *platform_create_thread(PlatformThreadProc *proc, void *data);
+QUILL_PLATFORM_API i32 platform_wait_thread(void *thread);
+QUILL_PLATFORM_API u32 platform_get_processor_count(void);
+QUILL_PLATFORM_API void platform_sleep(u32 milliseconds);
+/* NOTE: Background threads call this so the main thread sends MESSAGE_BACKGROUND_UPDATE */
+QUILL_PLATFORM_API void platform_wake_up(void);
+
+/* NOTE: Reads run on a pool of threads so many of them are in flight at once, the
+   element gets MESSAGE_FILE_READ with the PlatformFileRead on the main thread. The
+   handler owns bytes.data when it sets it to zero, otherwise it is freed after */
+#define PLATFORM_READ_THREAD_COUNT 16
+typedef struct PlatformFileRead {
+  u8 *filename;
+  void *element;
+  void *data;
+  ByteArray bytes;
+  PlatformFileInfo info;
+  bool success;
+} PlatformFileRead;
+
+QUILL_PLATFORM_API void platform_read_file_async(u8 *filename, void *element, void *data);
+/* NOTE: Wait for the reads in flight and drop their completions */
+QUILL_PLATFORM_API void platform_stop_file_reads(void);
+
+/* NOTE: The files of the watched folders that are written or replaced are sent to
+   the element as MESSAGE_FILE_CHANGED with their path, hidden files are left out.
+   A watch is zero when the platform cannot watch files, the functions accept it */
+QUILL_PLATFORM_API void *platform_watch_create(void *element);
+QUILL_PLATFORM_API void platform_watch_folder(void *watch, u8 *foldername);
+QUILL_PLATFORM_API void platform_watch_destroy(void *watch);
+
 QUILL_PLATFORM_API u8 *platform_get_clipboard();
 QUILL_PLATFORM_API void platform_free_clipboard(u8 *buffer);
 QUILL_PLATFORM_API void platform_set_clipboard(u8 *buffer);
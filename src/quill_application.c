@@ -3,11 +3,75 @@
 #include "quill_editor.h"
 #include "quill_painter.h"
 #include "quill_file.h"
+#include "quill_journal.h"
+#include "quill_folder.h"
+#include "quill_finder.h"
 #include "quill_tokenizer.h"
 #include "quill_line.h"
+#include "quill_utf8.h"
 
 extern Platform platform;
 
+static Rect application_goto_prompt_rect(Application *application) {
+  Rect rect = element_get_rect(application->current_editor);
+  rect.b = rect.t + platform.font->line_gap;
+  return rect;
+}
+
+/* NOTE: Rows of files in the selector, the first row is the query */
+static u32 application_file_selector_view_count(Application *application) {
+  u32 selector_height = application->file_selector_rect.b - application->file_selector_rect.t;
+  u32 row_count = selector_height / platform.font->line_gap;
+  return row_count > 1 ? row_count - 1 : 1;
+}
+
+static void application_open_file(Application *application, File *file) {
+  Editor *editor = application->current_editor;
+  if(editor->file) {
+    editor->file->cursor_saved = editor->cursor;
+  }
+  element_message(editor, MESSAGE_EDITOR_OPEN_FILE, file);
+}
+
+/* NOTE: Returns false when the reload has to wait for the scan of the file */
+static bool application_reload_file(Application *application, FolderFile *folder_file) {
+  FileReload reload = file_reload(folder_file->file);
+  if(reload.reloaded) {
+    for(Element *child = application->element.first_child; child; child = child->next) {
+      _element_message(child, MESSAGE_EDITOR_FILE_RELOADED, &reload);
+    }
+  }
+  return !reload.deferred;
+}
+
+/* NOTE: The finder filters what a keystroke left over on the next updates */
+static void application_finder_wake_up(Application *application) {
+  if(!finder_is_done(application->finder)) {
+    platform_wake_up();
+  }
+}
+
+static void application_goto_prompt_submit(Application *application) {
+  Editor *editor = application->current_editor;
+  u8 *query = application->goto_query;
+  u32 query_size = application->goto_query_size;
+  bool is_offset = (query_size > 0) && (query[0] == '#');
+  u64 value = 0;
+  u32 digits = 0;
+  for(u32 i = is_offset ? 1 : 0; i < query_size; ++i) {
+    value = value * 10 + (query[i] - '0');
+    ++digits;
+  }
+  if(editor->file && digits > 0) {
+    if(is_offset) {
+      editor_goto_offset(editor, value);
+    } else {
+      /* NOTE: Line numbers in the prompt start at one */
+      editor_goto_line(editor, (u32)MIN(MAX(value, 1) - 1, (u64)0xffffffff));
+    }
+  }
+}
+
 static int application_default_message_handler(struct Element *element, Message message, void *data) {
   /* TODO: Implements default line message handler */
   (void)element; (void)message; (void)data;
@@ -30,28 +94,66 @@ static int application_default_message_handler(struct Element *element, Message
     rect.b += (gap/2);
     painter_draw_rect_outline(painter, rect, 0x0000ff);
 
+    File *current_file = application->current_editor->file;
+    if(current_file && current_file->save_error) {
+      /* NOTE: The failed save stays on the last row of the editor until a save succeeds */
+      Rect error_rect = element_get_rect(application->current_editor);
+      error_rect.t = error_rect.b - platform.font->line_gap;
+      painter_draw_rect(painter, error_rect, 0x602020);
+      painter_draw_text(painter, (u8 *)current_file->save_error, strlen(current_file->save_error),
+                        error_rect.l, error_rect.t + platform.font->line_gap, 0xffffff);
+    }
+
     if(application->file_selector) {
       /* TODO: Try to manage the selector clipping always from the application */
       Rect old_clipping = painter->clipping;
       painter->clipping = application->file_selector_rect;
       painter_draw_rect(painter, application->file_selector_rect, 0x000000);
-      Folder *folder = application->folder;
-      if(folder) {
+      FolderWalk *walk = application->folder_walk;
+      if(walk) {
+        Finder *finder = application->finder;
+        u32 result_count = finder_result_count(finder, walk);
         i32 start_x = application->file_selector_rect.l;
         i32 start_y = application->file_selector_rect.t + platform.font->line_gap;
-        for(u32 i = application->file_selector_offset; i < vector_size(folder->files); ++i) {
-          File *file = folder->files[i];
-          painter_draw_text(painter, file->name, strlen((char *)file->name), start_x, start_y, 0xffffff);
+        /* NOTE: The query takes the first row, the files go below it */
+        u8 text[FINDER_MAX_QUERY_SIZE + 32];
+        i32 text_size = snprintf((char *)text, sizeof(text), "> %.*s  (%u/%u)%s", (i32)finder->query_size, finder->query,
+                                 result_count, vector_size(walk->files), finder_is_done(finder) ? "" : " ...");
+        painter_draw_text(painter, text, (u32)text_size, start_x, start_y, 0xffffff);
+        start_y += platform.font->line_gap;
+        u32 view_count = application_file_selector_view_count(application);
+        u32 last = MIN(application->file_selector_offset + view_count, result_count);
+        /* NOTE: Only the files that fit in the selector are drawn */
+        for(u32 i = application->file_selector_offset; i < last; ++i) {
+          FolderFile *file = finder_result(finder, walk, i);
+          u32 color = file->kind == FOLDER_FILE_BINARY ? 0x666666 : 0xffffff;
+          painter_draw_text(painter, file->path, strlen((char *)file->path), start_x, start_y, color);
+          if(file->kind != FOLDER_FILE_TEXT || file->failed) {
+            /* NOTE: The kind is drawn at the right of the selector, binary files cannot be opened */
+            char *tag = file->failed ? "[cannot open]" : (file->kind == FOLDER_FILE_BINARY ? "[binary]" : "[huge]");
+            u32 tag_size = strlen(tag);
+            i32 tag_x = application->file_selector_rect.r - (i32)(tag_size * platform.font->advance);
+            painter_draw_text(painter, (u8 *)tag, tag_size, tag_x, start_y, 0x888888);
+          }
           start_y += platform.font->line_gap;
         }
         Rect selected_rect = application->file_selector_rect;
-        selected_rect.t = application->file_selector_rect.t + ((application->file_selected_index - application->file_selector_offset)*platform.font->line_gap - platform.font->descender);
+        selected_rect.t = application->file_selector_rect.t + ((application->file_selected_index - application->file_selector_offset + 1)*platform.font->line_gap - platform.font->descender);
         selected_rect.b = selected_rect.t + platform.font->line_gap;
         painter_draw_rect_outline(painter, selected_rect, 0x0000ff);
       }
       painter->clipping = old_clipping;
     }
 
+    if(application->goto_prompt) {
+      Rect prompt_rect = application_goto_prompt_rect(application);
+      painter_draw_rect(painter, prompt_rect, 0x000000);
+      u8 text[64];
+      i32 text_size = snprintf((char *)text, sizeof(text), "goto: %.*s", (i32)application->goto_query_size, application->goto_query);
+      painter_draw_text(painter, text, (u32)text_size, prompt_rect.l, prompt_rect.t + platform.font->line_gap, 0xffffff);
+      painter_draw_rect_outline(painter, prompt_rect, 0x0000ff);
+    }
+
   } break;
   case MESSAGE_RESIZE: {
 
@@ -90,14 +192,38 @@ static int application_default_message_handler(struct Element *element, Message
       element_update(application);
     }
 
-    if(application->file_selector && application->folder && application->folder->files) {
+    if(keycode == (EDITOR_KEY_G|EDITOR_MOD_CRTL)) {
+      application->goto_prompt = !application->goto_prompt;
+      application->goto_query_size = 0;
+      element_redraw(application, 0);
+      element_update(application);
+      break;
+    }
+
+    if(application->goto_prompt) {
+      if(keycode == EDITOR_KEY_ENTER) {
+        application_goto_prompt_submit(application);
+        application->goto_prompt = false;
+        element_redraw(application, 0);
+      } else if(keycode == EDITOR_KEY_RETURN && application->goto_query_size > 0) {
+        --application->goto_query_size;
+        Rect rect = application_goto_prompt_rect(application);
+        element_redraw(application, &rect);
+      }
+      element_update(application);
+      break;
+    }
+
+    if(application->file_selector && application->folder_walk) {
+      FolderWalk *walk = application->folder_walk;
+      Finder *finder = application->finder;
+      u32 result_count = finder_result_count(finder, walk);
       Rect *rect = 0;
 
-      u32 selector_heihgt = application->file_selector_rect.b - application->file_selector_rect.t;
-      u32 total_lines_view = selector_heihgt / platform.font->line_gap;
+      u32 total_lines_view = application_file_selector_view_count(application);
 
       if(keycode == EDITOR_KEY_DOWN) {
-        application->file_selected_index = MIN(application->file_selected_index + 1, MAX(vector_size(application->folder->files)-1, 0));
+        application->file_selected_index = MIN(application->file_selected_index + 1, result_count ? result_count - 1 : 0);
         rect = &application->file_selector_rect;
 
         if(application->file_selected_index > (application->file_selector_offset + (total_lines_view - 1))) {
@@ -112,14 +238,29 @@ static int application_default_message_handler(struct Element *element, Message
           application->file_selector_offset = application->file_selected_index;
         }
 
-      } else if(keycode == EDITOR_KEY_ENTER) {
-        if(application->current_editor->file) {
-          application->current_editor->file->cursor_saved = application->current_editor->cursor;
-        }
-        File *file = application->folder->files[application->file_selected_index];
-        element_message(application->current_editor, MESSAGE_EDITOR_OPEN_FILE, file);
-        if(editor_should_scroll(application->current_editor)) {
-          rect = 0;
+      } else if(keycode == EDITOR_KEY_RETURN) {
+        finder_pop(finder, walk);
+        application_finder_wake_up(application);
+        application->file_selected_index = 0;
+        application->file_selector_offset = 0;
+        rect = &application->file_selector_rect;
+
+      } else if(keycode == EDITOR_KEY_ENTER && application->file_selected_index < result_count) {
+        /* NOTE: The file is loaded the first time it is selected, small files are
+           read on the read pool and opened on MESSAGE_FILE_READ */
+        FolderFile *folder_file = finder_result(finder, walk, application->file_selected_index);
+        application->file_reading = 0;
+        if(folder_file_read(folder_file, &application->element)) {
+          application->file_reading = folder_file;
+        } else {
+          File *file = folder_file_open(folder_file);
+          if(file) {
+            folder_walk_add_loaded(walk, folder_file);
+            application_open_file(application, file);
+            if(editor_should_scroll(application->current_editor)) {
+              rect = 0;
+            }
+          }
         }
       }
       element_redraw(application, rect);
@@ -134,7 +275,93 @@ static int application_default_message_handler(struct Element *element, Message
 
   } break;
   case MESSAGE_TEXTINPUT: {
-    element_message(application->current_editor, message, data);
+    if(application->goto_prompt) {
+      u32 codepoint = (u32)(u64)data;
+      bool is_digit = (codepoint >= '0' && codepoint <= '9');
+      bool is_offset_mark = (codepoint == '#' && application->goto_query_size == 0);
+      if((is_digit || is_offset_mark) && application->goto_query_size < sizeof(application->goto_query)) {
+        application->goto_query[application->goto_query_size++] = (u8)codepoint;
+        Rect rect = application_goto_prompt_rect(application);
+        element_redraw(application, &rect);
+        element_update(application);
+      }
+    } else if(application->file_selector && application->folder_walk) {
+      /* NOTE: Typing in the selector narrows the files down */
+      u8 bytes[UTF8_MAX_SIZE];
+      u32 size = utf8_encode((u32)(u64)data, bytes);
+      if(finder_push(application->finder, application->folder_walk, bytes, size)) {
+        application_finder_wake_up(application);
+        application->file_selected_index = 0;
+        application->file_selector_offset = 0;
+        element_redraw(application, &application->file_selector_rect);
+        element_update(application);
+      }
+    } else {
+      element_message(application->current_editor, message, data);
+    }
+  } break;
+  case MESSAGE_FILE_READ: {
+    PlatformFileRead *read = (PlatformFileRead *)data;
+    File *file = folder_file_read_done(read);
+    if(file && application->folder_walk) {
+      folder_walk_add_loaded(application->folder_walk, (FolderFile *)read->data);
+    }
+    if(file && read->data == application->file_reading) {
+      application->file_reading = 0;
+      application_open_file(application, file);
+      element_redraw(application, 0);
+      element_update(application);
+    } else if(!file && application->file_selector) {
+      element_redraw(application, &application->file_selector_rect);
+      element_update(application);
+    }
+  } break;
+  case MESSAGE_FILE_CHANGED: {
+    /* NOTE: Only the files that were loaded are reloaded, the rest are read when opened */
+    u8 *path = (u8 *)data;
+    FolderWalk *walk = application->folder_walk;
+    FolderFile *folder_file = walk ? folder_walk_find_loaded(walk, path) : 0;
+    if(folder_file && !application_reload_file(application, folder_file)) {
+      bool pending = false;
+      for(u32 i = 0; i < vector_size(application->reload_pending) && !pending; ++i) {
+        pending = (application->reload_pending[i] == folder_file);
+      }
+      if(!pending) {
+        vector_push(application->reload_pending, folder_file);
+      }
+    }
+  } break;
+  case MESSAGE_BACKGROUND_UPDATE: {
+    u32 pending_count = 0;
+    for(u32 i = 0; i < vector_size(application->reload_pending); ++i) {
+      FolderFile *folder_file = application->reload_pending[i];
+      if(!application_reload_file(application, folder_file)) {
+        application->reload_pending[pending_count++] = folder_file;
+      }
+    }
+    if(application->reload_pending) {
+      vector_header(application->reload_pending)->size = pending_count;
+    }
+    FolderWalk *walk = application->folder_walk;
+    bool walk_updated = walk && folder_walk_update(walk);
+    if(walk_updated) {
+      /* NOTE: Files from the index that are gone from disk are removed once the walk is done */
+      finder_update(application->finder, walk);
+    }
+    /* NOTE: The finder filters a step for every update until the results are the ones of the whole query */
+    if(walk && (walk_updated || !finder_is_done(application->finder))) {
+      finder_step(application->finder);
+      application_finder_wake_up(application);
+      u32 file_count = finder_result_count(application->finder, walk);
+      if(application->file_selected_index >= file_count) {
+        application->file_selected_index = file_count ? file_count - 1 : 0;
+      }
+      application->file_selector_offset = MIN(application->file_selector_offset, application->file_selected_index);
+      if(application->file_selector) {
+        element_redraw(application, &application->file_selector_rect);
+        element_update(application);
+      }
+    }
   } break;
   case MESSAGE_BUTTONDOWN: {
 
@@ -165,7 +392,14 @@ static int application_default_message_handler(struct Element *element, Message
 
 static void application_user_derstroy(Element *element) {
   Application *application = (Application *)element;
-  folder_destroy(application->folder);
+  vector_free(application->reload_pending);
+  if(application->folder_walk) {
+    folder_walk_destroy(application->folder_walk);
+  }
+  /* NOTE: The journals of the files are closed by their flush thread */
+  journal_wait_closed();
+  finder_destroy(application->finder);
+  platform_watch_destroy(application->watch);
   printf("application destroy\n");
 }
 
@@ -177,6 +411,9 @@ Application *application_create(BackBuffer *backbuffer) {
 
   application->file_selector = false;
   application->file_selector_offset = 0;
+  application->goto_prompt = false;
+  application->goto_query_size = 0;
+  application->finder = finder_create();
 
   return application;
 }
@@ -6,7 +6,8 @@
 #include "quill_cursor.h"
 
 struct Editor;
-struct Folder;
+struct FolderWalk;
+struct FolderFile;
 
 typedef struct Application {
   QUILL_ELEMENT
@@ -18,8 +19,23 @@ typedef struct Application {
   u32 file_selector_offset;
   Rect file_selector_rect;
 
+  /* NOTE: The goto prompt takes a line number, or a byte offset when it starts with # */
+  bool goto_prompt;
+  u8 goto_query[32];
+  u32 goto_query_size;
+
   struct Editor *current_editor;
-  struct Folder *folder;
+  /* NOTE: The file selector lists the files of the walk as it finds them */
+  struct FolderWalk *folder_walk;
+  /* NOTE: The query typed in the file selector and the files that match it */
+  struct Finder *finder;
+  /* NOTE: The walk adds every folder it lists, changed files that are loaded are reloaded */
+  void *watch;
+  /* NOTE: The file selected last while it is read, only that one is opened */
+  struct FolderFile *file_reading;
+  /* NOTE: Changed files whose reload waits for their pager scan, tried again on
+     every background update */
+  struct FolderFile **reload_pending;
 
 } Application;
 
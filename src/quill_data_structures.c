@@ -15,23 +15,178 @@ void *vector_grow(void *vector, u32 element_size) {
   }
 }
 
-void *gapbuffer_grow(void *buffer, u32 element_size) {
+static void *gapbuffer_resize(void *buffer, u32 new_capacity, u32 element_size) {
   if(buffer == 0) {
-    GapBufferHeader *header = (GapBufferHeader *)malloc(sizeof(GapBufferHeader) + element_size * GAPBUFFER_DEFAULT_CAPACITY);
-    header->capacity = GAPBUFFER_DEFAULT_CAPACITY;
+    GapBufferHeader *header = (GapBufferHeader *)malloc(sizeof(GapBufferHeader) + element_size * new_capacity);
+    header->capacity = new_capacity;
     header->f_index = 0;
-    header->s_index = GAPBUFFER_DEFAULT_CAPACITY;
+    header->s_index = new_capacity;
     return (void *)(header + 1);
   } else {
     GapBufferHeader *header = gapbuffer_header(buffer);
-    u32 new_buffer_size = header->capacity * 2;
-    header = (GapBufferHeader *)realloc(header, sizeof(GapBufferHeader) + new_buffer_size * element_size);
     u32 second_gap_size = header->capacity - header->s_index;
-    void *des = (u8 *)(header + 1) + (new_buffer_size - second_gap_size) * element_size;
-    void *src = (u8 *)(header + 1) + (header->capacity - second_gap_size) * element_size;
-    memmove(des, src, second_gap_size * element_size);
-    header->s_index = new_buffer_size - second_gap_size;
-    header->capacity = new_buffer_size;
+    assert(header->f_index + second_gap_size < new_capacity);
+    /* NOTE: When shrinking, the second segment has to move before realloc cuts the end */
+    if(new_capacity < header->capacity) {
+      u8 *data = (u8 *)(header + 1);
+      memmove(data + (new_capacity - second_gap_size) * element_size,
+              data + header->s_index * element_size, second_gap_size * element_size);
+      header = (GapBufferHeader *)realloc(header, sizeof(GapBufferHeader) + new_capacity * element_size);
+    } else {
+      header = (GapBufferHeader *)realloc(header, sizeof(GapBufferHeader) + new_capacity * element_size);
+      void *des = (u8 *)(header + 1) + (new_capacity - second_gap_size) * element_size;
+      void *src = (u8 *)(header + 1) + (header->capacity - second_gap_size) * element_size;
+      memmove(des, src, second_gap_size * element_size);
+    }
+    header->s_index = new_capacity - second_gap_size;
+    header->capacity = new_capacity;
     return (header + 1);
   }
 }
+
+void *gapbuffer_grow(void *buffer, u32 element_size) {
+  if(buffer == 0) {
+    return gapbuffer_resize(buffer, GAPBUFFER_DEFAULT_CAPACITY, element_size);
+  }
+  return gapbuffer_resize(buffer, gapbuffer_header(buffer)->capacity * 2, element_size);
+}
+
+void *gapbuffer_reserve(void *buffer, u32 count, u32 element_size) {
+  /* NOTE: The gap never gets completely filled, gapbuffer_fit always keep one free element */
+  u32 capacity = gapbuffer_capacity(buffer);
+  u32 gap_size = buffer ? (gapbuffer_s_index(buffer) - gapbuffer_f_index(buffer)) : 0;
+  if(gap_size > count) {
+    return buffer;
+  }
+  /* NOTE: New buffers are allocated at the exact size, existing buffers keep doubling */
+  u32 new_capacity = capacity ? capacity : MAX(GAPBUFFER_DEFAULT_CAPACITY, count + 1);
+  while(new_capacity - (capacity - gap_size) <= count) {
+    new_capacity *= 2;
+  }
+  return gapbuffer_resize(buffer, new_capacity, element_size);
+}
+
+u32 gapbuffer_shrink_capacity(u32 capacity, u32 size, u32 min_capacity) {
+  /* NOTE: The capacity is halved while less than a quarter of it is used, growing
+     doubles when the buffer is full so a buffer never bounces between both */
+  while((capacity / 2 >= min_capacity) && (size < capacity / 4)) {
+    capacity /= 2;
+  }
+  return capacity;
+}
+
+void *gapbuffer_shrink(void *buffer, u32 element_size) {
+  if(buffer == 0) {
+    return buffer;
+  }
+  u32 capacity = gapbuffer_capacity(buffer);
+  u32 new_capacity = gapbuffer_shrink_capacity(capacity, gapbuffer_size(buffer), GAPBUFFER_DEFAULT_CAPACITY);
+  if(new_capacity != capacity) {
+    return gapbuffer_resize(buffer, new_capacity, element_size);
+  }
+  return buffer;
+}
+
+void *gapbuffer_insert_elements(void *buffer, void *elements, u32 count, u32 element_size) {
+  if(count == 0) {
+    return buffer;
+  }
+  buffer = gapbuffer_reserve(buffer, count, element_size);
+  GapBufferHeader *header = gapbuffer_header(buffer);
+  memcpy((u8 *)buffer + header->f_index * element_size, elements, count * element_size);
+  header->f_index += count;
+  return buffer;
+}
+
+void gapbuffer_move_gap(void *buffer, u32 index, u32 element_size) {
+  if(buffer == 0) {
+    assert(index == 0);
+    return;
+  }
+  GapBufferHeader *header = gapbuffer_header(buffer);
+  assert(index <= header->f_index + (header->capacity - header->s_index));
+  u8 *data = (u8 *)buffer;
+  if(index > header->f_index) {
+    u32 count = index - header->f_index;
+    memmove(data + header->f_index * element_size, data + header->s_index * element_size, count * element_size);
+    header->f_index += count;
+    header->s_index += count;
+  } else if(index < header->f_index) {
+    u32 count = header->f_index - index;
+    memmove(data + (header->s_index - count) * element_size, data + index * element_size, count * element_size);
+    header->f_index -= count;
+    header->s_index -= count;
+  }
+}
+
+void *gapbuffer_init(void *memory, u32 capacity) {
+  GapBufferHeader *header = (GapBufferHeader *)memory;
+  header->capacity = capacity;
+  header->f_index = 0;
+  header->s_index = capacity;
+  return (void *)(header + 1);
+}
+
+void gapbuffer_copy(void *des, void *src, u32 element_size) {
+  /* NOTE: des must be empty, the gap of des ends up in the same logical position as the gap of src */
+  GapBufferHeader *des_header = gapbuffer_header(des);
+  GapBufferHeader *src_header = gapbuffer_header(src);
+  u32 second_size = src_header->capacity - src_header->s_index;
+  assert(des_header->f_index == 0 && des_header->s_index == des_header->capacity);
+  assert(src_header->f_index + second_size < des_header->capacity);
+  memcpy(des, src, src_header->f_index * element_size);
+  memcpy((u8 *)des + (des_header->capacity - second_size) * element_size,
+         (u8 *)src + src_header->s_index * element_size, second_size * element_size);
+  des_header->f_index = src_header->f_index;
+  des_header->s_index = des_header->capacity - second_size;
+}
+
+void fenwick_build(u64 *tree, u32 count) {
+  /* NOTE: tree[1..count] must contain the values, the tree is built in place in O(n) */
+  tree[0] = 0;
+  for(u32 i = 1; i <= count; ++i) {
+    u32 parent = i + (i & (~i + 1));
+    if(parent <= count) {
+      tree[parent] += tree[i];
+    }
+  }
+}
+
+void fenwick_add(u64 *tree, u32 count, u32 index, i64 delta) {
+  for(u32 i = index + 1; i <= count; i += (i & (~i + 1))) {
+    tree[i] += (u64)delta;
+  }
+}
+
+u64 fenwick_prefix(u64 *tree, u32 index) {
+  /* NOTE: Sum of the values in [0, index) */
+  u64 result = 0;
+  for(u32 i = index; i > 0; i -= (i & (~i + 1))) {
+    result += tree[i];
+  }
+  return result;
+}
+
+u64 fenwick_get(u64 *tree, u32 index) {
+  return fenwick_prefix(tree, index + 1) - fenwick_prefix(tree, index);
+}
+
+u32 fenwick_find(u64 *tree, u32 count, u64 value, u64 *remainder) {
+  /* NOTE: Return the index of the element that contains value, that is the biggest
+     index with fenwick_prefix(index) <= value, remainder is value - fenwick_prefix(index) */
+  u32 step = 1;
+  while((step << 1) <= count) {
+    step <<= 1;
+  }
+  u32 index = 0;
+  for(; step > 0; step >>= 1) {
+    if(index + step <= count && tree[index + step] <= value) {
+      index += step;
+      value -= tree[index];
+    }
+  }
+  if(remainder) {
+    *remainder = value;
+  }
+  return index;
+}
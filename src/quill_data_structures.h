@@ -51,6 +51,14 @@ typedef struct GapBufferHeader {
 } GapBufferHeader;
 
 void *gapbuffer_grow(void *buffer, u32 element_size);
+void *gapbuffer_reserve(void *buffer, u32 count, u32 element_size);
+void *gapbuffer_shrink(void *buffer, u32 element_size);
+u32 gapbuffer_shrink_capacity(u32 capacity, u32 size, u32 min_capacity);
+void *gapbuffer_insert_elements(void *buffer, void *elements, u32 count, u32 element_size);
+void gapbuffer_move_gap(void *buffer, u32 index, u32 element_size);
+/* NOTE: Helpers for gap buffers whose memory is not managed with malloc/realloc */
+void *gapbuffer_init(void *memory, u32 capacity);
+void gapbuffer_copy(void *des, void *src, u32 element_size);
 
 #define gapbuffer_header(buffer) ((GapBufferHeader *)((u8 *)(buffer) - sizeof(GapBufferHeader)))
 
@@ -80,6 +88,13 @@ void *gapbuffer_grow(void *buffer, u32 element_size);
 #define gapbuffer_remove(buffer) (gapbuffer_f_index((buffer)) > 0 ? \
   gapbuffer_header((buffer))->f_index-- : 0)
 
+/* NOTE: Span operations grow the buffer at most once and copy the elements with a single memcpy */
+#define gapbuffer_insert_span(buffer, elements, count) \
+  ((buffer) = gapbuffer_insert_elements((buffer), (elements), (count), sizeof(*(buffer))))
+
+#define gapbuffer_remove_span(buffer, count) ((count) > 0 ? \
+  (assert((count) <= gapbuffer_f_index((buffer))), gapbuffer_header((buffer))->f_index -= (count)) : 0)
+
 #define gapbuffer_free(buffer) ((buffer != 0) ? (free(gapbuffer_header((buffer)))) : 0)
 
 #define gapbuffer_get_at_gap(buffer) ((buffer)[gapbuffer_f_index((buffer))-1])
@@ -89,22 +104,15 @@ void *gapbuffer_grow(void *buffer, u32 element_size);
   (buffer)[index + (gapbuffer_s_index((buffer)) - gapbuffer_f_index((buffer)))] : \
   (buffer)[index])
 
-#define gapbuffer_move_to(buffer, index) \
-  do {\
-  if(index != gapbuffer_f_index(buffer)) { \
-  assert(index < gapbuffer_capacity(buffer)); \
-  i32 distance = (i32)index - (i32)gapbuffer_f_index(buffer); \
-  if(distance > 0) { \
-  for(u32 i = gapbuffer_f_index(buffer); i < index; ++i) { \
-  gapbuffer_step_foward(buffer); \
-  } \
-  } else if(distance < 0) { \
-  for(u32 i = gapbuffer_f_index(buffer); i > index; --i) { \
-  gapbuffer_step_backward(buffer); \
-  } \
-  } \
-  } \
-  } while(0)
+/* NOTE: Relocate the gap with a single memmove of the elements between the gap and index */
+#define gapbuffer_move_to(buffer, index) gapbuffer_move_gap((buffer), (index), sizeof(*(buffer)))
+
+/* NOTE: Fenwick tree of count u64 values, the tree array is 1-based and has count + 1 elements */
+void fenwick_build(u64 *tree, u32 count);
+void fenwick_add(u64 *tree, u32 count, u32 index, i64 delta);
+u64 fenwick_prefix(u64 *tree, u32 index);
+u64 fenwick_get(u64 *tree, u32 index);
+u32 fenwick_find(u64 *tree, u32 count, u64 value, u64 *remainder);
 
 #endif /* _QUILL_DATA_STRUCTURE_H_ */
 
@@ -3,6 +3,7 @@
 #include "quill_file.h"
 #include "quill_painter.h"
 #include "quill_data_structures.h"
+#include "quill_utf8.h"
 
 extern Platform platform;
 
@@ -59,7 +60,7 @@ static inline Cursor cursor_max(Cursor a, Cursor b) {
   return (a.line > b.line) ? a : b;
 }
 
-static u8 editor_get_current_codepoint(Editor *editor) {
+static u32 editor_get_current_codepoint(Editor *editor) {
   if(editor->cursor.col > 0) {
     return line_get_codepoint_at(file_get_line_at(editor->file, editor->cursor.line), (editor->cursor.col - 1));
   } else {
@@ -69,13 +70,9 @@ static u8 editor_get_current_codepoint(Editor *editor) {
 
 static inline void editor_undo_file_command_start_end(Editor *editor, u8 *text, Cursor start, Cursor end, FileCommandType type, Cursor *save_cusor) {
   File *file = editor->file;
-  FileCommand *command = file_command_stack_push(file->undo_stack);
+  FileCommand *command = file_history_push(file->history);
   command->type = type;
-
-  vector_clear(command->text);
-  while(*text != '\0') {
-    vector_push(command->text, *text++);
-  }
+  file_history_push_text(file->history, command, text, strlen((char *)text));
 
   command->start = start;
   command->end = end;
@@ -94,11 +91,9 @@ static inline void editor_undo_file_command_selection(Editor *editor, u8 *select
 
 static inline void editor_undo_file_command_line(Editor *editor, FileCommandType type) {
   File *file = editor->file;
-  FileCommand *command = file_command_stack_push(file->undo_stack);
+  FileCommand *command = file_history_push(file->history);
   command->type = type;
 
-  vector_clear(command->text);
-
   switch(type) {
   case FILE_COMMAND_JOIN_LINES: {
     command->start = editor->cursor;
@@ -111,13 +106,19 @@ static inline void editor_undo_file_command_line(Editor *editor, FileCommandType
   command->saved_cursor = editor->cursor;
 }
 
-static inline void editor_undo_file_command_start(Editor *editor, u8 codepoint, FileCommandType type, bool sequence_enable, Cursor *saved_cursor) {
+static inline void editor_undo_file_command_start(Editor *editor, u32 codepoint, FileCommandType type, bool sequence_enable, Cursor *saved_cursor) {
   File *file = editor->file;
-  FileCommand *command = file_command_stack_top(file->undo_stack);
+  FileCommand *command = file_history_current(file->history);
+
+  /* NOTE: The command text is stored as utf8 */
+  u8 bytes[UTF8_MAX_SIZE];
+  u32 size = utf8_encode(codepoint, bytes);
 
   bool is_sequence = false;
   if(sequence_enable) {
+    /* NOTE: A command with states after it cannot grow, they were made from it */
     is_sequence = (command &&
+                   !command->child &&
                    (command->type == type) &&
                    (command->end.line == editor->cursor.line) &&
                    (command->end.col == editor->cursor.col));
@@ -125,13 +126,9 @@ static inline void editor_undo_file_command_start(Editor *editor, u8 codepoint,
     is_sequence = is_sequence && (codepoint != ' ');
   }
 
-  if(is_sequence) {
-    vector_push(command->text, codepoint);
-  } else {
-    command = file_command_stack_push(file->undo_stack);
+  if(!is_sequence) {
+    command = file_history_push(file->history);
     command->type = type;
-    vector_clear(command->text);
-    vector_push(command->text, codepoint);
     command->start = editor->cursor;
     if(saved_cursor) {
       command->saved_cursor = *saved_cursor;
@@ -139,50 +136,93 @@ static inline void editor_undo_file_command_start(Editor *editor, u8 codepoint,
       command->saved_cursor = editor->cursor;
     }
   }
+  file_history_push_text(file->history, command, bytes, size);
 }
 
 static inline void editor_undo_file_command_end(Editor *editor) {
   File *file = editor->file;
-  FileCommand *command = file_command_stack_top(file->undo_stack);
+  FileCommand *command = file_history_current(file->history);
   assert(command);
   command->end = editor->cursor;
 }
 
-static inline void editor_push_and_process_command(Editor *editor, FileCommandStack *stack, FileCommandStack *other_stack) {
-  if(stack->size > 0) {
-    FileCommand *command = file_command_stack_pop(stack);
-    Cursor start = cursor_min(command->start, command->end);
-    Cursor end = cursor_max(command->start, command->end);
-
-    FileCommand *other_command = file_command_stack_push(other_stack);
-    vector_clear(other_command->text);
-    file_command_copy(other_command, command);
-    other_command->saved_cursor = cursor_equals(command->saved_cursor, command->start) ?
-          command->end : command->start;
-
-    switch(command->type) {
-    case FILE_COMMAND_REMOVE: {
-      editor_remove_range(editor, start, end);
-      other_command->type = FILE_COMMAND_INSERT;
-    } break;
-    case FILE_COMMAND_INSERT: {
-      editor_add_range(editor, command->text, start, end);
-      other_command->type = FILE_COMMAND_REMOVE;
-    } break;
-    case FILE_COMMAND_JOIN_LINES: {
-      editor_join_lines(editor, command->start.line, command->end.line, command->start.col);
-      other_command->type = FILE_COMMAND_SPLIT_LINE;
-      other_command->saved_cursor. col = 0;
-      other_command->saved_cursor.save_col = 0;
-    } break;
-    case FILE_COMMAND_SPLIT_LINE: {
-      editor_split_line(editor, command->start.line, command->start.col);
-      other_command->type = FILE_COMMAND_JOIN_LINES;
-    } break;
-    default: {} break;
-    }
+static inline FileCommandType editor_command_inverse(FileCommandType type) {
+  switch(type) {
+  case FILE_COMMAND_INSERT: return FILE_COMMAND_REMOVE;
+  case FILE_COMMAND_REMOVE: return FILE_COMMAND_INSERT;
+  case FILE_COMMAND_JOIN_LINES: return FILE_COMMAND_SPLIT_LINE;
+  case FILE_COMMAND_SPLIT_LINE: return FILE_COMMAND_JOIN_LINES;
+  default: return type;
+  }
+}
+
+/* NOTE: Undo applies the command as it was recorded and puts the cursor where it
+   was before the edit, redo applies the inverse and puts it after the edit */
+static void editor_apply_command(Editor *editor, FileCommand *command, bool undo) {
+  Cursor start = cursor_min(command->start, command->end);
+  Cursor end = cursor_max(command->start, command->end);
+  FileCommandType type = undo ? command->type : editor_command_inverse(command->type);
+  switch(type) {
+  case FILE_COMMAND_REMOVE: {
+    editor_remove_range(editor, start, end);
+  } break;
+  case FILE_COMMAND_INSERT: {
+    editor_add_range(editor, command->text, command->text_size, start, end);
+  } break;
+  case FILE_COMMAND_JOIN_LINES: {
+    editor_join_lines(editor, command->start.line, command->end.line, command->start.col);
+  } break;
+  case FILE_COMMAND_SPLIT_LINE: {
+    editor_split_line(editor, command->start.line, command->start.col);
+  } break;
+  default: {} break;
+  }
 
+  if(undo) {
     editor->cursor = command->saved_cursor;
+  } else {
+    editor->cursor = cursor_equals(command->saved_cursor, command->start) ? command->end : command->start;
+    if(command->type == FILE_COMMAND_JOIN_LINES) {
+      editor->cursor.col = 0;
+      editor->cursor.save_col = 0;
+    }
+  }
+}
+
+static inline void editor_undo(Editor *editor) {
+  FileCommand *command = file_history_undo(editor->file->history);
+  if(command) {
+    editor_apply_command(editor, command, true);
+  }
+}
+
+static inline void editor_redo(Editor *editor) {
+  FileCommand *command = file_history_redo(editor->file->history);
+  if(command) {
+    editor_apply_command(editor, command, false);
+  }
+}
+
+/* NOTE: Only the commands between the two states and their common ancestor are applied */
+static void editor_history_goto(Editor *editor, FileCommand *target) {
+  FileHistory *history = editor->file->history;
+  if(!target) {
+    return;
+  }
+  FileCommand *ancestor = file_history_route(history, target);
+  while(history->current != ancestor) {
+    FileCommand *command = file_history_undo(history);
+    if(!command) {
+      return;
+    }
+    editor_apply_command(editor, command, true);
+  }
+  while(history->current != target) {
+    FileCommand *command = file_history_redo(history);
+    if(!command) {
+      return;
+    }
+    editor_apply_command(editor, command, false);
   }
 }
 
@@ -250,7 +290,7 @@ static int editor_default_message_handler(struct Element *element, Message messa
       } break;
       case EDITOR_KEY_RETURN: {
         if(!editor->selected) {
-          u8 codepoint = editor_get_current_codepoint(editor);
+          u32 codepoint = editor_get_current_codepoint(editor);
           editor_undo_file_command_start(editor, codepoint, FILE_COMMAND_INSERT, false, 0);
           editor_cursor_remove(editor);
           editor_undo_file_command_end(editor);
@@ -264,7 +304,7 @@ static int editor_default_message_handler(struct Element *element, Message messa
         if(!editor->selected) {
           Cursor saved_cursor = editor->cursor;
           editor_step_cursor_right(editor);
-          u8 codepoint = editor_get_current_codepoint(editor);
+          u32 codepoint = editor_get_current_codepoint(editor);
           editor_undo_file_command_start(editor, codepoint, FILE_COMMAND_INSERT, false, &saved_cursor);
           editor_cursor_remove(editor);
           editor_undo_file_command_end(editor);
@@ -301,9 +341,35 @@ static int editor_default_message_handler(struct Element *element, Message messa
       } break;
       case EDITOR_KEY_Z: {
         if(EDITOR_MOD_IS_SET(mod, EDITOR_MOD_CRTL) && EDITOR_MOD_IS_SET(mod, EDITOR_MOD_SHIFT)) {
-          editor_push_and_process_command(editor, editor->file->redo_stack, editor->file->undo_stack);
+          editor_redo(editor);
         }else if(EDITOR_MOD_IS_SET(mod, EDITOR_MOD_CRTL)) {
-          editor_push_and_process_command(editor, editor->file->undo_stack, editor->file->redo_stack);
+          editor_undo(editor);
+        }
+      } break;
+      case EDITOR_KEY_Y: {
+        /* NOTE: Step through the states in the order they were made, across branches */
+        FileHistory *history = editor->file->history;
+        if(EDITOR_MOD_IS_SET(mod, EDITOR_MOD_CRTL) && EDITOR_MOD_IS_SET(mod, EDITOR_MOD_SHIFT)) {
+          editor_history_goto(editor, file_history_next_in_time(history));
+        } else if(EDITOR_MOD_IS_SET(mod, EDITOR_MOD_CRTL)) {
+          editor_history_goto(editor, file_history_previous_in_time(history));
+        }
+      } break;
+      case EDITOR_KEY_S: {
+        if(EDITOR_MOD_IS_SET(mod, EDITOR_MOD_CRTL)) {
+          file_save(editor->file);
+        }
+      } break;
+      case EDITOR_KEY_T: {
+        if(EDITOR_MOD_IS_SET(mod, EDITOR_MOD_CRTL)) {
+          File *file = editor->file;
+          file->follow = !file->follow;
+          if(file->follow && file_line_count(file) > 0) {
+            /* NOTE: Following starts at the end of the file */
+            editor_update_selected(editor, false);
+            editor_goto_line(editor, file_line_count(file) - 1);
+            editor_step_cursor_end(editor);
+          }
         }
       } break;
 
@@ -317,7 +383,7 @@ static int editor_default_message_handler(struct Element *element, Message messa
   case MESSAGE_TEXTINPUT: {
     /* TODO: Find a good way to handle when the editor has no file */
     if(editor->file) {
-      u8 codepoint = (u8)(u64)data;
+      u32 codepoint = (u32)(u64)data;
       if(editor->selected) {
         u8 *selection = editor_get_selection(editor);
         editor_undo_file_command_selection(editor, selection, FILE_COMMAND_INSERT);
@@ -335,9 +401,39 @@ static int editor_default_message_handler(struct Element *element, Message messa
   } break;
   case MESSAGE_EDITOR_OPEN_FILE: {
     File *file = (File *)data;
+    file_start_journal(file);
     editor->file = file;
     editor->cursor = file->cursor_saved;
   } break;
+  case MESSAGE_EDITOR_FILE_RELOADED: {
+    FileReload *reload = (FileReload *)data;
+    if(editor->file == reload->file) {
+      File *file = editor->file;
+      bool follow = file->follow && reload->appended && editor->cursor.line == reload->first_line;
+      editor->cursor = file_reload_map_cursor(file, reload, editor->cursor);
+      editor->selection_mark = file_reload_map_cursor(file, reload, editor->selection_mark);
+      if(follow) {
+        editor->cursor.line = file_line_count(file) - 1;
+        editor->cursor.col = line_size(file_get_line_at(file, editor->cursor.line));
+        editor->cursor.save_col = editor->cursor.col;
+      }
+      editor->line_offset = MIN(editor->line_offset, editor->cursor.line);
+      bool scroll = editor_should_scroll(editor);
+      if(reload->appended && !scroll) {
+        /* NOTE: Only the lines from the old last line down changed, nothing is drawn
+           when they are below the view */
+        if(reload->first_line < editor->line_offset + editor_max_visible_lines(editor)) {
+          u32 first_line = MAX(reload->first_line, editor->line_offset);
+          Rect rect = element_get_rect(editor);
+          rect.t = editor_line_to_screen_pos(editor, first_line - editor->line_offset) - platform.font->descender;
+          element_redraw(editor, &rect);
+        }
+      } else {
+        element_redraw(editor, 0);
+      }
+      element_update(editor);
+    }
+  } break;
   default: {} break;
   }
 
@@ -379,6 +475,11 @@ bool editor_should_scroll(Editor *editor) {
     }
   }
 
+  if(old_line_offset != editor->line_offset) {
+    bool down = editor->line_offset > old_line_offset;
+    file_prefetch(editor->file, down ? editor->line_offset + total_lines_view : editor->line_offset, down ? 1 : -1);
+  }
+
   bool scroll = (old_line_offset != editor->line_offset) || (old_col_offset != editor->col_offset);
   return scroll;
 }
@@ -458,6 +559,28 @@ void editor_step_cursor_down(Editor *editor) {
   element_redraw(editor, scroll ? &element_get_rect(editor) : &rect);
 }
 
+void editor_goto_cursor(Editor *editor, Cursor cursor) {
+  File *file = editor->file;
+  assert(cursor.line < file_line_count(file));
+  editor->cursor = cursor;
+  editor->cursor.col = MIN(cursor.col, line_size(file_get_line_at(file, cursor.line)));
+  editor->cursor.save_col = editor->cursor.col;
+
+  editor_should_scroll(editor);
+  element_redraw(editor, 0);
+}
+
+void editor_goto_line(Editor *editor, u32 line) {
+  Cursor cursor;
+  memset(&cursor, 0, sizeof(Cursor));
+  cursor.line = MIN(line, file_line_count(editor->file) - 1);
+  editor_goto_cursor(editor, cursor);
+}
+
+void editor_goto_offset(Editor *editor, u64 offset) {
+  editor_goto_cursor(editor, file_offset_to_cursor(editor->file, offset));
+}
+
 float page_percentage = 0.7f;
 
 void editor_step_cursor_page_down(Editor *editor) {
@@ -502,7 +625,7 @@ void editor_step_cursor_end(Editor *editor) {
   element_redraw(editor, scroll ? &element_get_rect(editor) : &rect);
 }
 
-static inline bool codepoint_is_separator(u8 codepoint) {
+static inline bool codepoint_is_separator(u32 codepoint) {
   return (codepoint == ',') || (codepoint == ';') || (codepoint == '.') ||
       (codepoint == '-') || (codepoint == '_') || (codepoint == '>') ||
       (codepoint == '(') || (codepoint == ')') || (codepoint == ' ') ||
@@ -517,8 +640,8 @@ void editor_step_next_token_left(Editor *editor) {
       editor_step_cursor_left(editor);
     }
 
-    u8 codepoint = line_get_codepoint_at(line, editor->cursor.col);
-    u8 left_codepoint = line_get_codepoint_at(line, editor->cursor.col - 1);
+    u32 codepoint = line_get_codepoint_at(line, editor->cursor.col);
+    u32 left_codepoint = line_get_codepoint_at(line, editor->cursor.col - 1);
     if(codepoint_is_separator(left_codepoint)) {
       editor_step_cursor_left(editor);
       codepoint = line_get_codepoint_at(line, editor->cursor.col);
@@ -532,7 +655,7 @@ void editor_step_next_token_left(Editor *editor) {
           return;
         }
 
-        u8 codepoint = line_get_codepoint_at(line, editor->cursor.col);
+        u32 codepoint = line_get_codepoint_at(line, editor->cursor.col);
         if(codepoint != ' ') {
           break;
         }
@@ -545,7 +668,7 @@ void editor_step_next_token_left(Editor *editor) {
         return;
       }
 
-      u8 codepoint = line_get_codepoint_at(line, editor->cursor.col);
+      u32 codepoint = line_get_codepoint_at(line, editor->cursor.col);
 
       if(codepoint_is_separator(codepoint)) {
         editor_step_cursor_right(editor);
@@ -562,7 +685,7 @@ void editor_step_next_token_right(Editor *editor) {
   Line *line = file_get_line_at(editor->file, editor->cursor.line);
   if(editor->cursor.col < (line_size(line))) {
 
-    u8 codepoint = line_get_codepoint_at(line, editor->cursor.col);
+    u32 codepoint = line_get_codepoint_at(line, editor->cursor.col);
     if(codepoint == ' ') {
       while(editor->cursor.col < line_size(line)) {
         editor_step_cursor_right(editor);
@@ -571,7 +694,7 @@ void editor_step_next_token_right(Editor *editor) {
           return;
         }
 
-        u8 codepoint = line_get_codepoint_at(line, editor->cursor.col);
+        u32 codepoint = line_get_codepoint_at(line, editor->cursor.col);
         if(codepoint != ' ') {
           break;
         }
@@ -584,7 +707,7 @@ void editor_step_next_token_right(Editor *editor) {
         return;
       }
 
-      u8 codepoint = line_get_codepoint_at(line, editor->cursor.col);
+      u32 codepoint = line_get_codepoint_at(line, editor->cursor.col);
 
       if(codepoint_is_separator(codepoint)) {
         return;
@@ -596,12 +719,11 @@ void editor_step_next_token_right(Editor *editor) {
   }
 }
 
-void editor_cursor_insert(Editor *editor, u8 codepoint) {
+void editor_cursor_insert(Editor *editor, u32 codepoint) {
   File *file = editor->file;
   Cursor *cursor = &editor->cursor;
   assert(cursor->line < file_line_count(file));
-  Line *line = file_get_line_at(file, cursor->line);
-  line_insert_at_index(line, cursor->col, codepoint);
+  file_insert_codepoint_at(file, cursor->line, cursor->col, codepoint);
   editor_step_cursor_right(editor);
 }
 
@@ -609,13 +731,7 @@ void editor_cursor_insert(Editor *editor, u8 codepoint) {
 void editor_split_line(Editor *editor, u32 line, u32 col) {
   File *file = editor->file;
   assert(line < file_line_count(file));
-  file_insert_new_line_at(file, line);
-
-  Line *new_line = file_get_line_at(file, line);
-  Line *old_line = file_get_line_at(file, line + 1);
-
-  line_copy(new_line, old_line, col);
-  line_remove_from_front_up_to(old_line, col);
+  file_split_line_at(file, line, col);
 
   Cursor *cursor = &editor->cursor;
   cursor->line = line + 1;
@@ -628,14 +744,8 @@ void editor_split_line(Editor *editor, u32 line, u32 col) {
 
 void editor_join_lines(Editor *editor, u32 line0, u32 line1, u32 col) {
   File *file = editor->file;
-  Line *first_line = file_get_line_at(file, line0);
-  Line *second_line = file_get_line_at(file, line1);
-
-  u32 second_line_size = line_size(second_line);
-
-  line_copy_at(first_line, second_line, second_line_size, col);
-
-  file_remove_line_at(file, line1 + 1);
+  assert(line1 == line0 + 1);
+  file_join_lines_at(file, line0);
 
   Cursor *cursor = &editor->cursor;
   cursor->line = line0;
@@ -655,20 +765,16 @@ void editor_cursor_remove(Editor *editor) {
   File *file = editor->file;
   Cursor *cursor = &editor->cursor;
   assert(cursor->line < file_line_count(file));
-  Line *line = file_get_line_at(file, cursor->line);
   if(cursor->col == 0) {
     if(cursor->line > 0) {
-      Line *first_line = file_get_line_at(file, cursor->line);
-      Line *second_line = file_get_line_at(file, cursor->line - 1);
-      u32 second_line_size = line_size(second_line);
-      line_copy_at(first_line, second_line, second_line_size, 0);
-      file_remove_line_at(file, cursor->line);
+      u32 second_line_size = line_size(file_get_line_at(file, cursor->line - 1));
+      file_join_lines_at(file, cursor->line - 1);
 
       cursor->save_col = second_line_size;
       editor_step_cursor_up(editor);
     }
   } else {
-    line_remove_at_index(line, cursor->col);
+    file_remove_codepoint_at(file, cursor->line, cursor->col);
     editor_step_cursor_left(editor);
   }
 
@@ -682,35 +788,23 @@ void editor_cursor_remove_right(Editor *editor) {
   Line *line = file_get_line_at(file, cursor->line);
   if(cursor->col == line_size(line)) {
     if(cursor->line < (file_line_count(file) - 1)) {
-      Line *first_line = file_get_line_at(file, cursor->line);
-      Line *second_line = file_get_line_at(file, cursor->line + 1);
-      u32 first_line_size = line_size(first_line);
-      line_copy_at(second_line, first_line, first_line_size, 0);
-      file_remove_line_at(file, cursor->line + 1);
+      file_join_lines_at(file, cursor->line);
     }
   } else {
-    line_remove_at_index(line, cursor->col + 1);
+    file_remove_codepoint_at(file, cursor->line, cursor->col + 1);
   }
 
   element_redraw(editor, 0);
 }
 
-/* TODO: Move this function into line API */
-static inline void line_remove_range(Line *line, u32 start, u32 end) {
-  u32 remove_cout = end - start;
-  for(u32 i = 0; i < remove_cout; ++i) {
-    line_remove_at_index(line, start + 1);
-  }
-}
-
 void editor_paste_clipboard(Editor *editor) {
   u8 *clipboard = platform_get_clipboard();
   u8 *iterator = clipboard;
-  for(;;) {
-    u8 codepoint = *iterator++;
-    if(codepoint == '\0') {
-      break;
-    }
+  u32 size = strlen((char *)clipboard);
+  u8 *end = clipboard + size;
+  while(iterator < end) {
+    u32 codepoint;
+    iterator += utf8_decode(iterator, (u32)(end - iterator), &codepoint);
     if(codepoint == '\n') {
       editor_cursor_insert_new_line(editor);
       continue;
@@ -720,6 +814,14 @@ void editor_paste_clipboard(Editor *editor) {
   platform_free_clipboard(clipboard);
 }
 
+static void editor_temp_clipboard_push_codepoint(u32 codepoint) {
+  u8 bytes[UTF8_MAX_SIZE];
+  u32 size = utf8_encode(codepoint, bytes);
+  for(u32 i = 0; i < size; ++i) {
+    platform_temp_clipboard_push(&platform, bytes[i]);
+  }
+}
+
 u8 *editor_get_range(Editor *editor, Cursor start, Cursor end) {
   File *file = editor->file;
   platform_temp_clipboard_clear(&platform);
@@ -729,19 +831,19 @@ u8 *editor_get_range(Editor *editor, Cursor start, Cursor end) {
     u32 size = line_size(line);
     if(start.line == end.line) {
       for(u32 j = start.col; j < end.col; ++j) {
-        platform_temp_clipboard_push(&platform, line_get_codepoint_at(line, j));
+        editor_temp_clipboard_push_codepoint(line_get_codepoint_at(line, j));
       }
     } else if(i == start.line) {
       for(u32 j = start.col; j < size; ++j) {
-        platform_temp_clipboard_push(&platform, line_get_codepoint_at(line, j));
+        editor_temp_clipboard_push_codepoint(line_get_codepoint_at(line, j));
       }
     } else if(i == end.line) {
       for(u32 j = 0; j < end.col; ++j) {
-        platform_temp_clipboard_push(&platform, line_get_codepoint_at(line, j));
+        editor_temp_clipboard_push_codepoint(line_get_codepoint_at(line, j));
       }
     } else {
       for(u32 j = 0; j < size; ++j) {
-        platform_temp_clipboard_push(&platform, line_get_codepoint_at(line, j));
+        editor_temp_clipboard_push_codepoint(line_get_codepoint_at(line, j));
       }
     }
     if(i < end.line) {
@@ -774,11 +876,11 @@ void editor_copy_selection_to_clipboard(Editor *editor) {
   }
 }
 
-void editor_add_range(Editor *editor, u8 *text, Cursor start, Cursor end) {
+void editor_add_range(Editor *editor, u8 *text, u64 text_size, Cursor start, Cursor end) {
   editor->cursor = start;
-  u32 text_size = vector_size(text);
-  for(u32 i = 0; i < text_size; ++i) {
-    u8 codepoint = text[i];
+  for(u64 i = 0; i < text_size;) {
+    u32 codepoint;
+    i += utf8_decode(text + i, text_size - i, &codepoint);
     if(codepoint == '\n') {
       editor_cursor_insert_new_line(editor);
     } else {
@@ -794,23 +896,7 @@ void editor_add_range(Editor *editor, u8 *text, Cursor start, Cursor end) {
 void editor_remove_range(Editor *editor, Cursor start, Cursor end) {
   File *file = editor->file;
   Cursor *cursor = &editor->cursor;
-  if(start.line == end.line) {
-    Line *line = file_get_line_at(file, start.line);
-    line_remove_range(line, start.col, end.col);
-  } else if((end.line - start.line) > 0) {
-
-    Line *line_start = file_get_line_at(file, start.line);
-    line_remove_range(line_start, start.col, line_size(line_start));
-    Line *line_end = file_get_line_at(file, end.line);
-    line_remove_range(line_end, 0, end.col);
-    line_copy_at(line_start, line_end, line_size(line_end), line_size(line_start));
-    file_remove_line_at(file, end.line + 1);
-
-    u32 middle_lines_count = end.line - start.line - 1;
-    for(u32 i = 0; i < middle_lines_count; ++i) {
-      file_remove_line_at(file, start.line + 2);
-    }
-  }
+  file_remove_range(file, start, end);
 
   editor->selected = false;
   *cursor = start;
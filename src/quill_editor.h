@@ -47,7 +47,11 @@ typedef enum EditorMessageType {
 
   EDITOR_BUTTON_LEFT,
 
-  EDITOR_KEY_P
+  EDITOR_KEY_P,
+  EDITOR_KEY_G,
+  EDITOR_KEY_S,
+  EDITOR_KEY_T,
+  EDITOR_KEY_Y
 
 } EditorMessageType;
 
@@ -97,7 +101,11 @@ void editor_step_next_token_right(Editor *editor);
 void editor_step_cursor_start(Editor *editor);
 void editor_step_cursor_end(Editor *editor);
 
-void editor_cursor_insert(Editor *editor, u8 codepoint);
+void editor_goto_cursor(Editor *editor, Cursor cursor);
+void editor_goto_line(Editor *editor, u32 line);
+void editor_goto_offset(Editor *editor, u64 offset);
+
+void editor_cursor_insert(Editor *editor, u32 codepoint);
 void editor_cursor_insert_new_line(Editor *editor);
 void editor_cursor_remove(Editor *editor);
 void editor_cursor_remove_right(Editor *editor);
@@ -113,7 +121,7 @@ void editor_update_selected(Editor *editor, bool selected);
 
 u8 *editor_get_range(Editor *editor, Cursor start, Cursor end);
 void editor_remove_range(Editor *editor, Cursor start, Cursor end);
-void editor_add_range(Editor *editor, u8 *text, Cursor start, Cursor end);
+void editor_add_range(Editor *editor, u8 *text, u64 text_size, Cursor start, Cursor end);
 
 bool editor_should_scroll(Editor *editor);
 
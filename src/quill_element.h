@@ -12,6 +12,14 @@ typedef enum Message {
   MESSAGE_TEXTINPUT,
   MESSAGE_BUTTONDOWN,
   MESSAGE_EDITOR_OPEN_FILE,
+  /* NOTE: Something a background thread works on has progressed */
+  MESSAGE_BACKGROUND_UPDATE,
+  /* NOTE: A platform_read_file_async finished, data is the PlatformFileRead */
+  MESSAGE_FILE_READ,
+  /* NOTE: A watched file changed on disk, data is its path */
+  MESSAGE_FILE_CHANGED,
+  /* NOTE: The file of the editor was reloaded, data is the FileReload */
+  MESSAGE_EDITOR_FILE_RELOADED,
 } Message;
 
 struct Element;
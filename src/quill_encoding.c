@@ -0,0 +1,265 @@
+#include "quill_encoding.h"
+#include "quill_scan.h"
+#include "quill_utf8.h"
+
+static u8 encoding_bom_utf8[] = {0xef, 0xbb, 0xbf};
+static u8 encoding_bom_utf16_le[] = {0xff, 0xfe};
+static u8 encoding_bom_utf16_be[] = {0xfe, 0xff};
+
+u8 *encoding_bom(Encoding encoding) {
+  switch(encoding) {
+  case ENCODING_UTF8: return encoding_bom_utf8;
+  case ENCODING_UTF16_LE: return encoding_bom_utf16_le;
+  case ENCODING_UTF16_BE: return encoding_bom_utf16_be;
+  default: return 0;
+  }
+}
+
+u32 encoding_bom_size(Encoding encoding) {
+  switch(encoding) {
+  case ENCODING_UTF8: return sizeof(encoding_bom_utf8);
+  case ENCODING_UTF16_LE: return sizeof(encoding_bom_utf16_le);
+  case ENCODING_UTF16_BE: return sizeof(encoding_bom_utf16_be);
+  default: return 0;
+  }
+}
+
+bool encoding_is_utf8(u8 *data, u64 size) {
+  u8 *end = data + size;
+  for(;;) {
+    data += scan_ascii_size(data, (u64)(end - data));
+    if(data == end) {
+      return true;
+    }
+    u32 sequence_size = utf8_sequence_size(*data);
+    if(sequence_size == 1) {
+      return false;
+    }
+    if(sequence_size > (u64)(end - data)) {
+      return true;
+    }
+    u32 codepoint;
+    if(utf8_decode(data, sequence_size, &codepoint) != sequence_size) {
+      return false;
+    }
+    /* NOTE: Overlong sequences and surrogates are not utf8 */
+    if((sequence_size == 3 && codepoint < 0x800) || (sequence_size == 4 && codepoint < 0x10000) ||
+       (codepoint >= 0xd800 && codepoint <= 0xdfff) || codepoint > 0x10ffff) {
+      return false;
+    }
+    data += sequence_size;
+  }
+}
+
+Encoding encoding_detect(u8 *data, u64 size, bool *bom) {
+  *bom = true;
+  for(Encoding encoding = ENCODING_UTF8; encoding <= ENCODING_UTF16_BE; ++encoding) {
+    u32 bom_size = encoding_bom_size(encoding);
+    if(size >= bom_size && memcmp(data, encoding_bom(encoding), bom_size) == 0) {
+      return encoding;
+    }
+  }
+  *bom = false;
+  /* NOTE: Without a byte order mark utf16 text in a latin script has a zero in
+     most of the high bytes and almost none in the low bytes */
+  u64 unit_count = size / 2;
+  if(unit_count > 0) {
+    u64 even_zeros = 0;
+    u64 odd_zeros = 0;
+    for(u64 i = 0; i < unit_count; ++i) {
+      even_zeros += (data[i * 2] == 0);
+      odd_zeros += (data[i * 2 + 1] == 0);
+    }
+    if(odd_zeros * 2 > unit_count && even_zeros * 8 < unit_count) {
+      return ENCODING_UTF16_LE;
+    }
+    if(even_zeros * 2 > unit_count && odd_zeros * 8 < unit_count) {
+      return ENCODING_UTF16_BE;
+    }
+  }
+  return encoding_is_utf8(data, size) ? ENCODING_UTF8 : ENCODING_LATIN1;
+}
+
+static inline u32 encoding_utf16_unit(u8 *data, bool big_endian) {
+  return big_endian ? ((u32)data[0] << 8 | data[1]) : ((u32)data[1] << 8 | data[0]);
+}
+
+static u8 *encoding_decode_utf16(u8 *des, u8 *data, u64 size, bool big_endian) {
+  u64 unit_count = size / 2;
+  u64 i = 0;
+  for(;;) {
+    u64 ascii_count = scan_narrow_utf16_ascii(des, data + i * 2, unit_count - i, big_endian);
+    des += ascii_count;
+    i += ascii_count;
+    if(i == unit_count) {
+      break;
+    }
+    u32 codepoint = encoding_utf16_unit(data + i * 2, big_endian);
+    ++i;
+    if(codepoint >= 0xd800 && codepoint <= 0xdbff && i < unit_count) {
+      u32 low = encoding_utf16_unit(data + i * 2, big_endian);
+      if(low >= 0xdc00 && low <= 0xdfff) {
+        codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (low - 0xdc00);
+        ++i;
+      }
+    }
+    /* NOTE: Lone surrogates are encoded as the replacement codepoint */
+    des += utf8_encode(codepoint, des);
+  }
+  if(size % 2) {
+    des += utf8_encode(UTF8_REPLACEMENT_CODEPOINT, des);
+  }
+  return des;
+}
+
+static u8 *encoding_decode_latin1(u8 *des, u8 *data, u64 size) {
+  u8 *end = data + size;
+  for(;;) {
+    u64 ascii_size = scan_ascii_size(data, (u64)(end - data));
+    memcpy(des, data, ascii_size);
+    des += ascii_size;
+    data += ascii_size;
+    if(data == end) {
+      break;
+    }
+    des += utf8_encode(*data++, des);
+  }
+  return des;
+}
+
+ByteArray encoding_decode(Encoding encoding, u8 *data, u64 size) {
+  assert(encoding == ENCODING_UTF16_LE || encoding == ENCODING_UTF16_BE || encoding == ENCODING_LATIN1);
+  /* NOTE: A utf16 code unit is never more than 3 bytes of utf8 and a latin1 byte never more than 2 */
+  u64 capacity = (encoding == ENCODING_LATIN1) ? size * 2 : size / 2 * 3 + UTF8_MAX_SIZE;
+  ByteArray result;
+  result.data = (u8 *)malloc(MAX(capacity, 1));
+  u8 *end = 0;
+  if(encoding == ENCODING_LATIN1) {
+    end = encoding_decode_latin1(result.data, data, size);
+  } else {
+    end = encoding_decode_utf16(result.data, data, size, encoding == ENCODING_UTF16_BE);
+  }
+  result.size = (u64)(end - result.data);
+  result.data = (u8 *)realloc(result.data, MAX(result.size, 1));
+  return result;
+}
+
+static bool encoding_put(Encoding encoding, u8 **des, u32 codepoint) {
+  u8 *iterator = *des;
+  if(encoding == ENCODING_LATIN1) {
+    if(codepoint > 0xff) {
+      return false;
+    }
+    *iterator++ = (u8)codepoint;
+  } else if(encoding == ENCODING_UTF16_LE || encoding == ENCODING_UTF16_BE) {
+    u32 units[2];
+    u32 unit_count = 1;
+    units[0] = codepoint;
+    if(codepoint >= 0x10000) {
+      units[0] = 0xd800 + ((codepoint - 0x10000) >> 10);
+      units[1] = 0xdc00 + ((codepoint - 0x10000) & 0x3ff);
+      unit_count = 2;
+    }
+    for(u32 i = 0; i < unit_count; ++i) {
+      iterator[encoding == ENCODING_UTF16_BE ? 0 : 1] = (u8)(units[i] >> 8);
+      iterator[encoding == ENCODING_UTF16_BE ? 1 : 0] = (u8)units[i];
+      iterator += 2;
+    }
+  } else {
+    iterator += utf8_encode(codepoint, iterator);
+  }
+  *des = iterator;
+  return true;
+}
+
+static u8 *encoding_put_ascii(Encoding encoding, u8 *des, u8 *data, u64 size) {
+  if(encoding == ENCODING_UTF16_LE || encoding == ENCODING_UTF16_BE) {
+    scan_widen_ascii_utf16(des, data, size, encoding == ENCODING_UTF16_BE);
+    return des + size * 2;
+  }
+  memcpy(des, data, size);
+  return des + size;
+}
+
+bool encoding_encode(Encoding encoding, bool bom, ByteArray *spans, u32 span_count, ByteArray *result) {
+  u64 size = 0;
+  for(u32 i = 0; i < span_count; ++i) {
+    size += spans[i].size;
+  }
+  u32 bom_size = bom ? encoding_bom_size(encoding) : 0;
+  /* NOTE: Every byte of utf8 is at most 2 bytes of utf16 */
+  u8 *data = (u8 *)malloc(MAX(size * 2 + bom_size, 1));
+  if(bom_size) {
+    memcpy(data, encoding_bom(encoding), bom_size);
+  }
+  u8 *des = data + bom_size;
+  if(encoding == ENCODING_UTF8) {
+    /* NOTE: The bytes are written as they are, malformed sequences included */
+    for(u32 i = 0; i < span_count; ++i) {
+      memcpy(des, spans[i].data, spans[i].size);
+      des += spans[i].size;
+    }
+    result->data = data;
+    result->size = (u64)(des - data);
+    return true;
+  }
+
+  /* NOTE: A sequence can be cut between two spans, its first bytes wait in pending */
+  u8 pending[UTF8_MAX_SIZE];
+  u32 pending_size = 0;
+  u32 pending_need = 0;
+  bool success = true;
+  for(u32 i = 0; i < span_count && success; ++i) {
+    u8 *iterator = spans[i].data;
+    u8 *end = iterator + spans[i].size;
+    while(iterator < end && success) {
+      if(pending_size) {
+        bool continuation = (*iterator & 0xc0) == 0x80;
+        if(continuation) {
+          pending[pending_size++] = *iterator++;
+        }
+        if(continuation && pending_size < pending_need) {
+          continue;
+        }
+        u32 codepoint;
+        u32 decoded = utf8_decode(pending, pending_size, &codepoint);
+        success = encoding_put(encoding, &des, codepoint);
+        /* NOTE: What is left of a malformed sequence is one replacement codepoint per byte */
+        for(u32 j = decoded; j < pending_size && success; ++j) {
+          success = encoding_put(encoding, &des, UTF8_REPLACEMENT_CODEPOINT);
+        }
+        pending_size = 0;
+        continue;
+      }
+      u64 ascii_size = scan_ascii_size(iterator, (u64)(end - iterator));
+      des = encoding_put_ascii(encoding, des, iterator, ascii_size);
+      iterator += ascii_size;
+      if(iterator == end) {
+        break;
+      }
+      u32 sequence_size = utf8_sequence_size(*iterator);
+      if(sequence_size > (u64)(end - iterator)) {
+        pending_size = (u32)(end - iterator);
+        pending_need = sequence_size;
+        memcpy(pending, iterator, pending_size);
+        break;
+      }
+      u32 codepoint;
+      iterator += utf8_decode(iterator, sequence_size, &codepoint);
+      success = encoding_put(encoding, &des, codepoint);
+    }
+  }
+  for(u32 j = 0; j < pending_size && success; ++j) {
+    success = encoding_put(encoding, &des, UTF8_REPLACEMENT_CODEPOINT);
+  }
+
+  if(!success) {
+    free(data);
+    result->data = 0;
+    result->size = 0;
+    return false;
+  }
+  result->data = data;
+  result->size = (u64)(des - data);
+  return true;
+}
@@ -0,0 +1,34 @@
+#ifndef _QUILL_ENCODING_H_
+#define _QUILL_ENCODING_H_
+
+#include "quill.h"
+
+/* NOTE: Lines always hold utf8, files in other encodings are decoded when they are
+   loaded and encoded again when they are saved. The encoding comes from the byte
+   order mark or from a sample of the start of the file */
+#define ENCODING_SAMPLE_SIZE (64 * 1024)
+
+typedef enum Encoding {
+  ENCODING_UTF8,
+  ENCODING_UTF16_LE,
+  ENCODING_UTF16_BE,
+  ENCODING_LATIN1,
+} Encoding;
+
+/* NOTE: bom tells whether the data starts with the byte order mark of the encoding */
+Encoding encoding_detect(u8 *data, u64 size, bool *bom);
+/* NOTE: Latin1 has no byte order mark, its size is zero */
+u8 *encoding_bom(Encoding encoding);
+u32 encoding_bom_size(Encoding encoding);
+/* NOTE: The size is cut at the end of the last whole sequence, a sample can end in
+   the middle of one */
+bool encoding_is_utf8(u8 *data, u64 size);
+
+/* NOTE: Decode the bytes after the byte order mark into a heap buffer of utf8, only
+   the utf16 and latin1 encodings need it */
+ByteArray encoding_decode(Encoding encoding, u8 *data, u64 size);
+/* NOTE: Encode the utf8 spans into a heap buffer, with the byte order mark first
+   when bom is set. Returns false when a codepoint has no place in the encoding */
+bool encoding_encode(Encoding encoding, bool bom, ByteArray *spans, u32 span_count, ByteArray *result);
+
+#endif /* _QUILL_ENCODING_H_ */
@@ -1,70 +1,269 @@
 #include "quill_file.h"
 #include "quill_data_structures.h"
 #include "quill_line.h"
+#include "quill_piece_table.h"
+#include "quill_pager.h"
+#include "quill_journal.h"
+#include "quill_scan.h"
+#include "quill_utf8.h"
 
 extern Platform platform;
 
-FileCommandStack *file_command_stack_create() {
-  FileCommandStack *stack = (FileCommandStack *)malloc(sizeof(FileCommandStack));
-  memset(stack, 0, sizeof(FileCommandStack));
-  return stack;
+static FileCommand *file_history_allocate(FileHistory *history) {
+  FileCommand *command = history->free_commands;
+  if(command) {
+    history->free_commands = command->sibling;
+  } else {
+    if(vector_size(history->blocks) == 0 || history->block_used == FILE_HISTORY_BLOCK_SIZE) {
+      vector_push(history->blocks, (FileCommand *)malloc(sizeof(FileCommand) * FILE_HISTORY_BLOCK_SIZE));
+      history->block_used = 0;
+    }
+    command = &history->blocks[vector_size(history->blocks) - 1][history->block_used++];
+  }
+  memset(command, 0, sizeof(FileCommand));
+  command->spill_offset = FILE_COMMAND_NOT_SPILLED;
+  command->sequence = vector_size(history->sequence);
+  vector_push(history->sequence, command);
+  return command;
 }
 
-void file_command_stack_destroy(FileCommandStack *stack) {
-  for(u32 i = 0; i < FILE_MAX_UNDO_REDO_SIZE; ++i) {
-    vector_free(stack->commands[i].text);
+static void file_history_free_command(FileHistory *history, FileCommand *command) {
+  history->text_size -= command->text_capacity;
+  free(command->text);
+  history->sequence[command->sequence] = 0;
+  command->sibling = history->free_commands;
+  history->free_commands = command;
+}
+
+static void file_history_unlink(FileCommand *command) {
+  FileCommand *parent = command->parent;
+  if(!parent) {
+    return;
   }
-  free(stack);
+  FileCommand **link = &parent->child;
+  while(*link != command) {
+    link = &(*link)->sibling;
+  }
+  *link = command->sibling;
+  if(parent->redo == command) {
+    parent->redo = parent->child;
+  }
+  command->parent = 0;
+  command->sibling = 0;
 }
 
-FileCommand *file_command_stack_push(FileCommandStack *stack) {
-  assert(stack->size <= FILE_MAX_UNDO_REDO_SIZE);
-  assert(stack->top < FILE_MAX_UNDO_REDO_SIZE);
-  FileCommand *command = &stack->commands[stack->top];
-  stack->top = (stack->top + 1) % FILE_MAX_UNDO_REDO_SIZE;
-  stack->size += (stack->size < FILE_MAX_UNDO_REDO_SIZE);
-  return command;
+/* NOTE: Free the command and every state after it, the branches can be as deep as
+   the history so they are walked without recursion */
+static void file_history_free_branch(FileHistory *history, FileCommand *command) {
+  file_history_unlink(command);
+  FileCommand **pending = 0;
+  vector_push(pending, command);
+  while(vector_size(pending) > 0) {
+    FileCommand *next = pending[--vector_header(pending)->size];
+    for(FileCommand *child = next->child; child; child = child->sibling) {
+      vector_push(pending, child);
+    }
+    file_history_free_command(history, next);
+  }
+  vector_free(pending);
 }
 
-FileCommand *file_command_stack_pop(FileCommandStack *stack) {
-  assert(stack->size > 0);
+/* NOTE: The command becomes the root, the states before it and the branches that
+   leave from them are freed */
+static void file_history_reroot(FileHistory *history, FileCommand *command) {
+  if(command == history->root) {
+    return;
+  }
+  file_history_unlink(command);
+  file_history_free_branch(history, history->root);
+  history->root = command;
+  history->text_size -= command->text_capacity;
+  free(command->text);
+  command->type = FILE_COMMAN_NONE;
+  command->text = 0;
+  command->text_size = 0;
+  command->text_capacity = 0;
+  command->spill_offset = FILE_COMMAND_NOT_SPILLED;
+  /* NOTE: A parent is always made before its children */
+  for(u32 i = command->sequence; i < vector_size(history->sequence); ++i) {
+    FileCommand *next = history->sequence[i];
+    if(next) {
+      next->depth = next->parent ? next->parent->depth + 1 : 0;
+    }
+  }
+}
+
+FileHistory *file_history_create(u64 budget) {
+  FileHistory *history = (FileHistory *)malloc(sizeof(FileHistory));
+  memset(history, 0, sizeof(FileHistory));
+  history->budget = budget;
+  history->root = file_history_allocate(history);
+  history->current = history->root;
+  return history;
+}
+
+void file_history_destroy(FileHistory *history) {
+  file_history_free_branch(history, history->root);
+  assert(history->text_size == 0);
+  for(u32 i = 0; i < vector_size(history->blocks); ++i) {
+    free(history->blocks[i]);
+  }
+  vector_free(history->blocks);
+  vector_free(history->sequence);
+  if(history->spill_file) {
+    platform_close_append_file(history->spill_file);
+  }
+  free(history);
+}
+
+static bool file_history_spill_command(FileHistory *history, FileCommand *command) {
+  if(command->spill_offset == FILE_COMMAND_NOT_SPILLED) {
+    if(!history->spill_file) {
+      history->spill_file = platform_open_temp_file();
+    }
+    if(!history->spill_file || !platform_append_file(history->spill_file, command->text, command->text_size)) {
+      return false;
+    }
+    command->spill_offset = history->spill_size;
+    history->spill_size += command->text_size;
+  }
+  history->text_size -= command->text_capacity;
+  free(command->text);
+  command->text = 0;
+  command->text_capacity = 0;
+  return true;
+}
 
-  i32 top = (i32)stack->top - 1;
-  if(top < 0) {
-    top = FILE_MAX_UNDO_REDO_SIZE - 1;
+/* NOTE: Spill the oldest commands first. Past the budget the text goes down to half
+   of it so the commands are not walked again on the next keystroke. When the spill
+   file fails the text stays */
+static void file_history_spill(FileHistory *history, FileCommand *keep) {
+  if(history->text_size <= history->budget) {
+    return;
+  }
+  for(u32 i = 0; i < vector_size(history->sequence) && history->text_size > history->budget / 2; ++i) {
+    FileCommand *command = history->sequence[i];
+    if(command && command != keep && command->text &&
+       !file_history_spill_command(history, command)) {
+      return;
+    }
   }
+}
 
-  stack->top = top;
+static bool file_history_load(FileHistory *history, FileCommand *command) {
+  if(command->text || command->text_size == 0) {
+    return true;
+  }
+  assert(command->spill_offset != FILE_COMMAND_NOT_SPILLED);
+  u8 *text = (u8 *)malloc(command->text_size);
+  if(!platform_read_file_at(history->spill_file, command->spill_offset, text, command->text_size)) {
+    free(text);
+    return false;
+  }
+  command->text = text;
+  command->text_capacity = command->text_size;
+  history->text_size += command->text_capacity;
+  file_history_spill(history, command);
+  return true;
+}
 
-  FileCommand *command = &stack->commands[stack->top];
-  stack->size--;
+FileCommand *file_history_push(FileHistory *history) {
+  FileCommand *parent = history->current;
+  FileCommand *command = file_history_allocate(history);
+  command->parent = parent;
+  command->sibling = parent->child;
+  command->depth = parent->depth + 1;
+  parent->child = command;
+  parent->redo = command;
+  history->current = command;
   return command;
 }
 
-FileCommand *file_command_stack_top(FileCommandStack *stack) {
-  FileCommand *command = 0;
-  if(stack->size > 0) {
+void file_history_push_text(FileHistory *history, FileCommand *command, u8 *text, u64 size) {
+  if(size == 0) {
+    return;
+  }
+  if(!file_history_load(history, command)) {
+    /* NOTE: The text before is lost, the command keeps only what comes now */
+    command->text_size = 0;
+  }
+  u64 text_size = command->text_size + size;
+  if(text_size > command->text_capacity) {
+    /* NOTE: Typing appends a codepoint at a time, the capacity doubles */
+    u64 capacity = MAX(MAX(command->text_capacity * 2, text_size), 16);
+    command->text = (u8 *)realloc(command->text, capacity);
+    history->text_size += capacity - command->text_capacity;
+    command->text_capacity = capacity;
+  }
+  memcpy(command->text + command->text_size, text, size);
+  command->text_size = text_size;
+  command->spill_offset = FILE_COMMAND_NOT_SPILLED;
+  file_history_spill(history, command);
+}
 
-    i32 top = (i32)stack->top - 1;
-    if(top < 0) {
-      top = (FILE_MAX_UNDO_REDO_SIZE - 1);
-    }
+FileCommand *file_history_current(FileHistory *history) {
+  return (history->current == history->root) ? 0 : history->current;
+}
 
-    command = &stack->commands[top];
+FileCommand *file_history_undo(FileHistory *history) {
+  FileCommand *command = history->current;
+  if(command == history->root) {
+    return 0;
+  }
+  if(!file_history_load(history, command)) {
+    file_history_reroot(history, command);
+    return 0;
+  }
+  history->current = command->parent;
+  return command;
+}
+
+FileCommand *file_history_redo(FileHistory *history) {
+  FileCommand *command = history->current->redo;
+  if(!command) {
+    return 0;
+  }
+  if(!file_history_load(history, command)) {
+    file_history_free_branch(history, command);
+    return 0;
+  }
+  history->current = command;
+  return command;
+}
+
+FileCommand *file_history_route(FileHistory *history, FileCommand *command) {
+  FileCommand *from = history->current;
+  while(from->depth > command->depth) {
+    from = from->parent;
+  }
+  while(command->depth > from->depth) {
+    command->parent->redo = command;
+    command = command->parent;
+  }
+  while(from != command) {
+    from = from->parent;
+    command->parent->redo = command;
+    command = command->parent;
   }
   return command;
 }
 
-void file_command_copy(FileCommand *des, FileCommand *src) {
-  des->type = src->type;
-  des->start = src->start;
-  des->end = src->end;
-  des->saved_cursor = src->saved_cursor;
+FileCommand *file_history_previous_in_time(FileHistory *history) {
+  for(u32 i = history->current->sequence; i-- > 0;) {
+    if(history->sequence[i]) {
+      return history->sequence[i];
+    }
+  }
+  return 0;
+}
 
-  u32 text_size = vector_size(src->text);
-  for(u32 i = 0; i < text_size; ++i) {
-    vector_push(des->text, src->text[i]);
+FileCommand *file_history_next_in_time(FileHistory *history) {
+  for(u32 i = history->current->sequence + 1; i < vector_size(history->sequence); ++i) {
+    if(history->sequence[i]) {
+      return history->sequence[i];
+    }
   }
+  return 0;
 }
 
 File *file_create(u8 *filename) {
@@ -74,29 +273,47 @@ File *file_create(u8 *filename) {
   assert(filename_size <= FILE_MAX_NAME_SIZE);
   memcpy(file->name, filename, filename_size);
 
-  file->undo_stack = file_command_stack_create();
-  file->redo_stack = file_command_stack_create();
+  file->history = file_history_create(FILE_DEFAULT_HISTORY_BUDGET);
+  file->line_allocator = line_allocator_create();
+  file->line_free_budget = FILE_DEFAULT_LINE_FREE_BUDGET;
 
   return file;
 }
 
 inline static void file_free_all_lines(File * file) {
 
-  file_command_stack_destroy(file->undo_stack);
-  file_command_stack_destroy(file->redo_stack);
+  file_history_destroy(file->history);
 
-  for(u32 i = 0; i < file_line_count(file); ++i) {
-    line_destroy(file_get_line_at(file, i));
+  if(file->storage == FILE_STORAGE_PIECE_TABLE) {
+    for(u32 i = 0; i < FILE_LINE_CACHE_SIZE; ++i) {
+      if(file->line_cache[i].line) {
+        line_destroy(file->line_cache[i].line);
+      }
+    }
+    piece_table_destroy(file->piece_table);
   }
-  Line *line = file->line_first_free;
-  while(line) {
-    Line *to_free = line;
-    line = line->next;
-    line_destroy(to_free);
+  if(file->storage == FILE_STORAGE_PAGED) {
+    pager_destroy(file->pager);
   }
+
+  line_allocator_destroy(file->line_allocator);
+  for(u32 i = 0; i < vector_size(file->load_allocators); ++i) {
+    line_allocator_destroy(file->load_allocators[i]);
+  }
+  vector_free(file->load_allocators);
+  if(file->mapping_is_heap) {
+    free(file->mapping.data);
+  } else {
+    platform_unmap_file(file->mapping);
+  }
+  free(file->line_index);
 }
 
 void file_destroy(File *file) {
+  file_save_wait(file);
+  if(file->journal) {
+    journal_destroy(file->journal);
+  }
   file_free_all_lines(file);
   gapbuffer_free(file->buffer);
   //printf("File destroy\n");
@@ -104,94 +321,631 @@ void file_destroy(File *file) {
 
 
 Line *file_line_create(File *file) {
-  if(file->line_first_free) {
-    Line *line = file->line_first_free;
-    file->line_first_free = file->line_first_free->next;
-    line_reset(line);
-    return line;
-  }
-  return line_create();
+  return line_allocator_alloc_line(file->line_allocator);
 }
 
 void file_line_free(File *file, Line *line) {
-  line->next = file->line_first_free;
-  file->line_first_free = line;
+  if(line_is_shared(line)) {
+    line_drop_share(line);
+    --file->shared_line_count;
+    return;
+  }
+  line_allocator_free_line(line->allocator, line);
 }
 
-File *file_load_from_existing_file(u8 *filename) {
-  /* TODO: Maybe load the file with memcpy into the seconds gap */
+/* NOTE: Hash eight bytes at a time, it only has to spread identical lines apart
+   from the others, the table compares the bytes on every hit */
+static u64 file_hash_bytes(u8 *data, u32 size) {
+  u64 hash = 0x9e3779b97f4a7c15ull ^ size;
+  while(size >= 8) {
+    u64 word;
+    memcpy(&word, data, 8);
+    hash = (hash ^ word) * 0xff51afd7ed558ccdull;
+    hash ^= hash >> 32;
+    data += 8;
+    size -= 8;
+  }
+  u64 word = 0;
+  memcpy(&word, data, size);
+  hash = (hash ^ word) * 0xc4ceb9fe1a85ec53ull;
+  return hash ^ (hash >> 29);
+}
+
+typedef struct FileInternEntry {
+  u64 hash;
+  Line *line;
+  u8 *data;
+  u32 size;
+} FileInternEntry;
+
+/* NOTE: Return the line already loaded with the same bytes or store line as the
+   first one with them, the table only lives while the file is loaded */
+static Line *file_intern_line(FileInternEntry *table, u32 mask, Line *line, u8 *data, u32 size) {
+  u64 hash = file_hash_bytes(data, size);
+  u32 index = (u32)hash & mask;
+  for(;;) {
+    FileInternEntry *entry = &table[index];
+    if(!entry->line) {
+      entry->hash = hash;
+      entry->line = line;
+      entry->data = data;
+      entry->size = size;
+      return line;
+    }
+    if(entry->hash == hash && entry->size == size && !memcmp(entry->data, data, size)) {
+      return entry->line;
+    }
+    index = (index + 1) & mask;
+  }
+}
+
+typedef struct FileLoadChunk {
+  u8 *start;
+  u8 *end;
+  bool last;
+  LineAllocator *allocator;
+  Line **lines;
+  bool crlf;
+} FileLoadChunk;
+
+static i32 file_load_chunk(void *data) {
+  FileLoadChunk *chunk = (FileLoadChunk *)data;
+  u8 *line_start = chunk->start;
+  for(;;) {
+    /* NOTE: Only the last chunk has a line after its last newline */
+    if(!chunk->last && line_start == chunk->end) {
+      break;
+    }
+    u8 *line_end = scan_find_byte(line_start, chunk->end, '\n');
+    u8 *content_end = line_end;
+    if(line_end != chunk->end && content_end > line_start && content_end[-1] == '\r') {
+      --content_end;
+      chunk->crlf = true;
+    }
+    Line *line = line_allocator_alloc_line(chunk->allocator);
+    line_set_mapped(line, line_start, (u32)(content_end - line_start));
+    vector_push(chunk->lines, line);
+    if(line_end == chunk->end) {
+      break;
+    }
+    line_start = line_end + 1;
+  }
+  return 0;
+}
+
+/* NOTE: Every chunk gets its own allocator, the main thread loads the first chunk
+   and then stitches the lines of all the chunks into the file buffer in order */
+static void file_load_lines_parallel(File *file, MappedFile mapping, u32 thread_count) {
+  FileLoadChunk chunks[FILE_LOAD_MAX_THREADS];
+  void *threads[FILE_LOAD_MAX_THREADS];
+  memset(chunks, 0, sizeof(chunks));
+
+  u8 *start = mapping.data;
+  u8 *end = mapping.data + mapping.size;
+  u32 chunk_count = 0;
+  while(!chunk_count || !chunks[chunk_count - 1].last) {
+    FileLoadChunk *chunk = &chunks[chunk_count];
+    u8 *chunk_end = end;
+    if(chunk_count + 1 < thread_count) {
+      chunk_end = MAX(start, mapping.data + mapping.size / thread_count * (chunk_count + 1));
+      chunk_end = scan_find_byte(chunk_end, end, '\n');
+      chunk_end += (chunk_end != end) ? 1 : 0;
+    }
+    chunk->start = start;
+    chunk->end = chunk_end;
+    chunk->last = (chunk_end == end);
+    chunk->allocator = (chunk_count == 0) ? file->line_allocator : line_allocator_create();
+    start = chunk_end;
+    ++chunk_count;
+  }
+
+  for(u32 i = 1; i < chunk_count; ++i) {
+    threads[i] = platform_create_thread(file_load_chunk, &chunks[i]);
+  }
+  file_load_chunk(&chunks[0]);
+  u32 line_count = vector_size(chunks[0].lines);
+  for(u32 i = 1; i < chunk_count; ++i) {
+    platform_wait_thread(threads[i]);
+    line_count += vector_size(chunks[i].lines);
+  }
 
-  ByteArray buffer = load_entire_file(filename);
+  file->buffer = gapbuffer_reserve(file->buffer, line_count, sizeof(*file->buffer));
+  for(u32 i = 0; i < chunk_count; ++i) {
+    gapbuffer_insert_span(file->buffer, chunks[i].lines, vector_size(chunks[i].lines));
+    file->crlf = file->crlf || chunks[i].crlf;
+    vector_free(chunks[i].lines);
+    if(i > 0) {
+      vector_push(file->load_allocators, chunks[i].allocator);
+    }
+  }
+}
+
+static File *file_load_lines(u8 *filename, MappedFile mapping, bool intern) {
   File *file = file_create(filename);
-  if(buffer.size > 0) {
-    file_insert_new_line(file);
-
-    u32 line_count = 0;
-    Line *line = file->buffer[line_count++];
-    for(u32 i = 0; i < buffer.size; ++i) {
-      u8 codepoint = buffer.data[i];
-      if(codepoint != '\n') {
-        line_insert(line, codepoint);
-      } else {
-        file_insert_new_line(file);
-        line = file->buffer[line_count++];
+  file->mapping = mapping;
+  u32 thread_count = MIN((u32)(mapping.size / FILE_LOAD_CHUNK_MIN_SIZE), platform_get_processor_count());
+  thread_count = MIN(thread_count, FILE_LOAD_MAX_THREADS);
+  if(!intern && thread_count > 1) {
+    /* NOTE: Interning shares one table between all the lines so it stays on one thread */
+    file_load_lines_parallel(file, mapping, thread_count);
+  } else if(mapping.size > 0) {
+    /* NOTE: Count the lines first so the file buffer is allocated once at its final size */
+    u32 line_count = (u32)scan_count_byte(mapping.data, mapping.size, '\n') + 1;
+    file->buffer = gapbuffer_reserve(file->buffer, line_count, sizeof(*file->buffer));
+
+    FileInternEntry *intern_table = 0;
+    u32 intern_mask = 0;
+    if(intern) {
+      u32 intern_capacity = 16;
+      while(intern_capacity < line_count * 2) {
+        intern_capacity *= 2;
       }
+      intern_table = (FileInternEntry *)malloc(sizeof(FileInternEntry) * intern_capacity);
+      memset(intern_table, 0, sizeof(FileInternEntry) * intern_capacity);
+      intern_mask = intern_capacity - 1;
     }
 
+    /* NOTE: The lines only reference the mapped bytes, nothing is copied until a line is modified */
+    u8 *line_start = mapping.data;
+    u8 *end = mapping.data + mapping.size;
+    for(;;) {
+      u8 *line_end = scan_find_byte(line_start, end, '\n');
+      u8 *content_end = line_end;
+      if(line_end != end && content_end > line_start && content_end[-1] == '\r') {
+        --content_end;
+        file->crlf = true;
+      }
+      u32 size = (u32)(content_end - line_start);
+      file_insert_new_line(file);
+      Line *line = gapbuffer_get_at_gap(file->buffer);
+      line_set_mapped(line, line_start, size);
+      if(intern_table) {
+        Line *interned = file_intern_line(intern_table, intern_mask, line, line_start, size);
+        if(interned != line) {
+          /* NOTE: The header that was just allocated is the next one handed out */
+          line_allocator_free_line(file->line_allocator, line);
+          line_share(interned);
+          file->buffer[gapbuffer_f_index(file->buffer) - 1] = interned;
+          ++file->shared_line_count;
+        }
+      }
+      if(line_end == end) {
+        break;
+      }
+      line_start = line_end + 1;
+    }
+    assert(file_line_count(file) == line_count);
+    free(intern_table);
   }
   return file;
 }
 
-void file_print(File *file) {
-  printf("file lines: %d\n", gapbuffer_size(file->buffer));
-  for(u32 i = 0; i < gapbuffer_f_index(file->buffer); ++i) {
-    Line *line = file->buffer[i];
-    for(u32 j = 0; j < gapbuffer_f_index(line->buffer); ++j) {
-      printf("%c", line->buffer[j]);
+static File *file_load_piece_table(u8 *filename, MappedFile mapping) {
+  File *file = file_create(filename);
+  file->storage = FILE_STORAGE_PIECE_TABLE;
+  file->mapping = mapping;
+  /* NOTE: The mapped bytes are the piece table original buffer, they are never copied */
+  file->piece_table = piece_table_create(mapping.data, mapping.size);
+  /* NOTE: The first line decides the newline of the file like in the pager */
+  u8 *first_line_end = scan_find_byte(mapping.data, mapping.data + mapping.size, '\n');
+  file->crlf = (first_line_end != mapping.data + mapping.size && first_line_end > mapping.data && first_line_end[-1] == '\r');
+  return file;
+}
+
+static File *file_load_paged(u8 *filename, MappedFile mapping, PagerOffsets *offsets) {
+  File *file = file_create(filename);
+  file->storage = FILE_STORAGE_PAGED;
+  file->mapping = mapping;
+  file->pager = pager_create(mapping, file->line_allocator, offsets);
+  file->crlf = file->pager->crlf;
+  return file;
+}
+
+static Encoding file_detect_encoding(MappedFile mapping, bool *bom) {
+  /* NOTE: Paged files are too big to be decoded up front, they are read as utf8 */
+  if(mapping.size >= FILE_PAGED_MIN_SIZE) {
+    *bom = false;
+    return ENCODING_UTF8;
+  }
+  return encoding_detect(mapping.data, MIN(mapping.size, (u64)ENCODING_SAMPLE_SIZE), bom);
+}
+
+static inline bool file_encoding_is_decoded(Encoding encoding) {
+  return encoding != ENCODING_UTF8;
+}
+
+/* NOTE: The bytes the lines are made of, utf8 files use the mapping after the byte
+   order mark and the other encodings are decoded into a heap buffer */
+static MappedFile file_mapping_content(MappedFile mapping, Encoding encoding, bool bom) {
+  MappedFile content = mapping;
+  u32 bom_size = bom ? encoding_bom_size(encoding) : 0;
+  if(bom_size) {
+    content.data += bom_size;
+    content.size -= bom_size;
+  }
+  if(file_encoding_is_decoded(encoding)) {
+    ByteArray bytes = encoding_decode(encoding, content.data, content.size);
+    content.data = bytes.data;
+    content.size = bytes.size;
+  }
+  return content;
+}
+
+/* NOTE: The file takes the mapping, heap mappings are freed instead of unmapped */
+static File *file_load_mapping(u8 *filename, MappedFile mapping, PlatformFileInfo info, bool intern, bool heap,
+                               PagerOffsets *offsets) {
+  ByteArray span;
+  span.data = mapping.data;
+  span.size = mapping.size;
+  JournalBase base = journal_base_from_spans(&span, 1);
+
+  bool bom = false;
+  Encoding encoding = file_detect_encoding(mapping, &bom);
+  bool decoded = file_encoding_is_decoded(encoding);
+  MappedFile content = file_mapping_content(mapping, encoding, bom);
+  File *file = 0;
+  if(content.size >= FILE_PAGED_MIN_SIZE && !decoded) {
+    /* NOTE: Offsets of another version of the file would split the lines anywhere */
+    if(offsets && (offsets->size != info.size || offsets->modified_time != info.modified_time || bom)) {
+      offsets = 0;
     }
-    for(u32 j = gapbuffer_s_index(line->buffer); j < gapbuffer_capacity(line->buffer); ++j) {
-      printf("%c", line->buffer[j]);
+    file = file_load_paged(filename, content, offsets);
+  } else if(content.size >= FILE_PIECE_TABLE_MIN_SIZE) {
+    /* NOTE: Piece table files have no line headers to share */
+    file = file_load_piece_table(filename, content);
+  } else {
+    file = file_load_lines(filename, content, intern);
+  }
+  file->encoding = encoding;
+  file->bom = bom;
+  if(decoded) {
+    /* NOTE: The lines point into the decoded bytes, the bytes on disk are not needed anymore */
+    if(heap) {
+      free(mapping.data);
+    } else {
+      platform_unmap_file(mapping);
     }
-    printf("\n");
+    heap = true;
+  } else {
+    file->mapping = mapping;
+  }
+  file->mapping_is_heap = heap;
+  file->disk_info = info;
+  file->disk_base = base;
+  /* NOTE: A heap copy never changes with the file on disk */
+  if(!heap) {
+    file->mapping_info = info;
+  }
+  return file;
+}
+
+/* NOTE: Files below FILE_PIECE_TABLE_MIN_SIZE are read into the heap, so a change of
+   the file on disk can never reach their lines. Bigger files are mapped, heap is set
+   when the bytes were read */
+static bool file_read_or_map(u8 *filename, MappedFile *mapping, PlatformFileInfo *info, bool *heap) {
+  PlatformFileInfo head_info;
+  if(!platform_get_file_info(filename, &head_info)) {
+    return false;
+  }
+  *heap = (head_info.size < FILE_PIECE_TABLE_MIN_SIZE);
+  if(*heap) {
+    ByteArray bytes;
+    if(!platform_try_read_file(filename, &bytes, info)) {
+      return false;
+    }
+    mapping->data = bytes.data;
+    mapping->size = bytes.size;
+    return true;
+  }
+  return platform_try_map_file(filename, mapping, info);
+}
+
+static void file_release_mapping(MappedFile mapping, bool heap) {
+  if(heap) {
+    free(mapping.data);
+  } else {
+    platform_unmap_file(mapping);
+  }
+}
+
+/* NOTE: A mapped file written in place changes the pages under the lines that point
+   into the mapping, a file replaced by a rename leaves the mapped pages as they were */
+static bool file_mapping_changed(File *file) {
+  if(file->mapping_changed) {
+    return true;
+  }
+  PlatformFileInfo info;
+  if(file->mapping_is_heap || !file->mapping.data || !platform_get_file_info(file->name, &info)) {
+    return false;
+  }
+  file->mapping_changed = (info.device == file->mapping_info.device && info.inode == file->mapping_info.inode &&
+                           (info.size != file->mapping_info.size || info.modified_time != file->mapping_info.modified_time));
+  return file->mapping_changed;
+}
+
+/* NOTE: Zero when the file cannot be opened or read, it may have been deleted or be
+   unreadable since it was listed */
+static File *file_load(u8 *filename, bool intern, PagerOffsets *offsets) {
+  MappedFile mapping;
+  PlatformFileInfo info;
+  bool heap = false;
+  if(!file_read_or_map(filename, &mapping, &info, &heap)) {
+    return 0;
+  }
+  return file_load_mapping(filename, mapping, info, intern, heap, offsets);
+}
+
+File *file_load_from_existing_file(u8 *filename) {
+  return file_load(filename, false, 0);
+}
+
+File *file_load_from_bytes(u8 *filename, ByteArray bytes, PlatformFileInfo info) {
+  assert(bytes.size < FILE_PIECE_TABLE_MIN_SIZE);
+  MappedFile mapping;
+  mapping.data = bytes.data;
+  mapping.size = bytes.size;
+  return file_load_mapping(filename, mapping, info, false, true, 0);
+}
+
+File *file_load_from_existing_file_interned(u8 *filename) {
+  return file_load(filename, true, 0);
+}
+
+File *file_load_from_existing_file_paged(u8 *filename, PagerOffsets *offsets) {
+  return file_load(filename, false, offsets);
+}
+
+bool file_get_page_offsets(File *file, PagerOffsets *offsets) {
+  /* NOTE: The offsets are the ones of the mapping, edits only change the pages in memory */
+  if(file->storage != FILE_STORAGE_PAGED || !pager_get_offsets(file->pager, offsets)) {
+    return false;
+  }
+  offsets->size = file->mapping_info.size;
+  offsets->modified_time = file->mapping_info.modified_time;
+  return true;
+}
+
+FileInternStats file_intern_stats(File *file) {
+  FileInternStats stats;
+  stats.line_count = file_line_count(file);
+  stats.shared_line_count = (file->storage == FILE_STORAGE_LINES) ? file->shared_line_count : 0;
+  stats.saved_bytes = (u64)stats.shared_line_count * sizeof(Line);
+  return stats;
+}
+
+void file_print(File *file) {
+  printf("file lines: %d\n", file_line_count(file));
+  for(u32 i = 0; i < file_line_count(file); ++i) {
+    line_print(file_get_line_at(file, i));
+  }
+}
+
+static inline u32 file_newline_size(File *file) {
+  return file->crlf ? 2 : 1;
+}
+
+static inline u32 file_line_physical_index(File *file, u32 index) {
+  if(index < gapbuffer_f_index(file->buffer)) {
+    return index;
+  }
+  return index + (gapbuffer_s_index(file->buffer) - gapbuffer_f_index(file->buffer));
+}
+
+static void file_line_index_build(File *file) {
+  u32 capacity = gapbuffer_capacity(file->buffer);
+  file->line_index = (u64 *)realloc(file->line_index, sizeof(u64) * (capacity + 1));
+  file->line_index_capacity = capacity;
+  memset(file->line_index, 0, sizeof(u64) * (capacity + 1));
+  for(u32 i = 0; i < gapbuffer_size(file->buffer); ++i) {
+    Line *line = file_get_line_at(file, i);
+    file->line_index[file_line_physical_index(file, i) + 1] = line_byte_size(line) + file_newline_size(file);
   }
-  for(u32 i = gapbuffer_s_index(file->buffer); i < gapbuffer_capacity(file->buffer); ++i) {
-    Line *line = file->buffer[i];
-    for(u32 j = 0; j < gapbuffer_f_index(line->buffer); ++j) {
-      printf("%c", line->buffer[j]);
+  fenwick_build(file->line_index, capacity);
+}
+
+static inline void file_line_index_set(File *file, u32 physical_index, u64 value) {
+  u64 old_value = fenwick_get(file->line_index, physical_index);
+  fenwick_add(file->line_index, file->line_index_capacity, physical_index, (i64)value - (i64)old_value);
+}
+
+static void file_line_index_update(File *file, u32 index) {
+  if(file->line_index) {
+    Line *line = file_get_line_at(file, index);
+    file_line_index_set(file, file_line_physical_index(file, index), line_byte_size(line) + file_newline_size(file));
+  }
+}
+
+static void file_move_gap(File *file, u32 index) {
+  u32 f_index = gapbuffer_f_index(file->buffer);
+  u32 s_index = gapbuffer_s_index(file->buffer);
+  if(!file->line_index || index == f_index) {
+    gapbuffer_move_to(file->buffer, index);
+    return;
+  }
+
+  /* NOTE: The lines that cross the gap change their physical slot, when too many
+     lines move it is cheaper to rebuild the whole index */
+  u32 count = (index > f_index) ? (index - f_index) : (f_index - index);
+  if(count > file->line_index_capacity / 16) {
+    gapbuffer_move_to(file->buffer, index);
+    file_line_index_build(file);
+    return;
+  }
+
+  u64 *tree = file->line_index;
+  u32 capacity = file->line_index_capacity;
+  if(index > f_index) {
+    for(u32 i = 0; i < count; ++i) {
+      u64 value = fenwick_get(tree, s_index + i);
+      fenwick_add(tree, capacity, s_index + i, -(i64)value);
+      fenwick_add(tree, capacity, f_index + i, (i64)value);
     }
-    for(u32 j = gapbuffer_s_index(line->buffer); j < gapbuffer_capacity(line->buffer); ++j) {
-      printf("%c", line->buffer[j]);
+  } else {
+    for(u32 i = count; i > 0; --i) {
+      u64 value = fenwick_get(tree, index + i - 1);
+      fenwick_add(tree, capacity, index + i - 1, -(i64)value);
+      fenwick_add(tree, capacity, s_index - count + i - 1, (i64)value);
     }
-    printf("\n");
   }
+  gapbuffer_move_to(file->buffer, index);
 }
 
 void file_insert_new_line(File *file) {
   assert(file);
+  assert(file->storage == FILE_STORAGE_LINES);
   Line *new_line = file_line_create(file);
   gapbuffer_insert(file->buffer, new_line);
+  if(file->line_index) {
+    if(gapbuffer_capacity(file->buffer) != file->line_index_capacity) {
+      file_line_index_build(file);
+    } else {
+      file_line_index_set(file, gapbuffer_f_index(file->buffer) - 1, file_newline_size(file));
+    }
+  }
 }
 
 void file_insert_new_line_at(File *file, u32 index) {
   assert(file);
-  gapbuffer_move_to(file->buffer, index);
+  if(file->storage == FILE_STORAGE_PAGED) {
+    pager_insert_line(file->pager, index, file_line_create(file));
+    return;
+  }
+  file_move_gap(file, index);
   file_insert_new_line(file);
 }
 
 void file_remove_line(File *file) {
   assert(file);
+  assert(file->storage == FILE_STORAGE_LINES);
   Line *line = gapbuffer_get_at_gap(file->buffer);
   file_line_free(file, line);
+  if(file->line_index) {
+    file_line_index_set(file, gapbuffer_f_index(file->buffer) - 1, 0);
+  }
   gapbuffer_remove(file->buffer);
+  u32 capacity = gapbuffer_capacity(file->buffer);
+  file->buffer = gapbuffer_shrink(file->buffer, sizeof(*file->buffer));
+  if(file->line_index && gapbuffer_capacity(file->buffer) != capacity) {
+    file_line_index_build(file);
+  }
 }
 
 void file_remove_line_at(File *file, u32 index) {
   assert(file);
-  gapbuffer_move_to(file->buffer, index);
+  if(file->storage == FILE_STORAGE_PAGED) {
+    assert(index > 0);
+    file_line_free(file, pager_remove_line(file->pager, index - 1));
+    return;
+  }
+  file_move_gap(file, index);
   file_remove_line(file);
 }
 
+void file_compact(File *file) {
+  if(file->storage == FILE_STORAGE_PIECE_TABLE) {
+    /* NOTE: The cached lines are the only line buffers of a piece table file */
+    for(u32 i = 0; i < FILE_LINE_CACHE_SIZE; ++i) {
+      if(file->line_cache[i].line) {
+        line_destroy(file->line_cache[i].line);
+      }
+    }
+    memset(file->line_cache, 0, sizeof(file->line_cache));
+    return;
+  }
+  if(file->storage == FILE_STORAGE_PAGED) {
+    /* NOTE: The lines of evicted pages are recycled by the next page that is loaded */
+    return;
+  }
+
+  LineAllocator *allocator = line_allocator_create();
+  u32 f_index = gapbuffer_f_index(file->buffer);
+  u32 s_index = gapbuffer_s_index(file->buffer);
+  for(u32 i = 0; i < gapbuffer_capacity(file->buffer); ++i) {
+    if(i < f_index || i >= s_index) {
+      Line *line = file->buffer[i];
+      if(line_is_shared(line)) {
+        /* NOTE: The first slot of an interned line repacks it and leaves the copy
+           in next, a field live lines don't use, for the other slots */
+        if(!line->next) {
+          line->next = line_repack(allocator, line);
+        }
+        file->buffer[i] = line->next;
+      } else {
+        file->buffer[i] = line_repack(allocator, line);
+      }
+    }
+  }
+  line_allocator_destroy(file->line_allocator);
+  file->line_allocator = allocator;
+  for(u32 i = 0; i < vector_size(file->load_allocators); ++i) {
+    line_allocator_destroy(file->load_allocators[i]);
+  }
+  vector_clear(file->load_allocators);
+
+  u32 capacity = gapbuffer_capacity(file->buffer);
+  file->buffer = gapbuffer_shrink(file->buffer, sizeof(*file->buffer));
+  if(file->line_index && gapbuffer_capacity(file->buffer) != capacity) {
+    file_line_index_build(file);
+  }
+}
+
+static inline void file_trim(File *file) {
+  u64 free_bytes = file->line_allocator->free_bytes;
+  for(u32 i = 0; i < vector_size(file->load_allocators); ++i) {
+    free_bytes += file->load_allocators[i]->free_bytes;
+  }
+  if(free_bytes > file->line_free_budget) {
+    file_compact(file);
+  }
+}
+
+/* NOTE: The piece table keeps the \r of a \r\n and saves it as it is, a line
+   leaves it out like in the other storages */
+static u64 file_piece_table_line_size(File *file, u32 index) {
+  PieceTable *table = file->piece_table;
+  u64 size = piece_table_line_size(table, index);
+  if(size > 0 && index + 1 < piece_table_line_count(table)) {
+    u8 last = 0;
+    piece_table_copy(table, piece_table_line_start(table, index) + size - 1, 1, &last);
+    size -= (last == '\r') ? 1 : 0;
+  }
+  return size;
+}
+
+static Line *file_piece_table_get_line_at(File *file, u32 index) {
+  FileLineCacheEntry *entry = &file->line_cache[index % FILE_LINE_CACHE_SIZE];
+  if(!entry->line) {
+    entry->line = line_create();
+  } else if(entry->index == index && entry->version == file->version) {
+    return entry->line;
+  }
+
+  Line *line = entry->line;
+  line_reset(line);
+
+  u64 start = piece_table_line_start(file->piece_table, index);
+  u64 size = file_piece_table_line_size(file, index);
+  u8 scratch[4096];
+  while(size > 0) {
+    u64 count = MIN(size, (u64)sizeof(scratch));
+    piece_table_copy(file->piece_table, start, count, scratch);
+    line_insert_bytes(line, line_byte_size(line), scratch, (u32)count);
+    start += count;
+    size -= count;
+  }
+
+  entry->index = index;
+  entry->version = file->version;
+  return line;
+}
+
 Line *file_get_line_at(File *file, u32 index) {
+  if(file->storage == FILE_STORAGE_PIECE_TABLE) {
+    return file_piece_table_get_line_at(file, index);
+  }
+  if(file->storage == FILE_STORAGE_PAGED) {
+    return pager_get_line(file->pager, index);
+  }
   /* TODO: Make this iterator a macro to use in all gap buffers */
   assert(index < gapbuffer_size(file->buffer));
   if(index < gapbuffer_f_index(file->buffer)) {
@@ -202,47 +956,926 @@ Line *file_get_line_at(File *file, u32 index) {
   }
 }
 
+/* NOTE: Lines and paged storage only, an interned line is replaced in its slot by
+   a private copy before it is modified and a paged line marks its page as modified */
+static Line *file_get_line_for_write(File *file, u32 index) {
+  if(file->storage == FILE_STORAGE_PAGED) {
+    return pager_get_line_for_write(file->pager, index);
+  }
+  Line *line = file_get_line_at(file, index);
+  if(line_is_shared(line)) {
+    line = line_unshare(line);
+    file->buffer[file_line_physical_index(file, index)] = line;
+    --file->shared_line_count;
+  }
+  return line;
+}
+
 u32 file_line_count(File *file) {
+  if(file->storage == FILE_STORAGE_PIECE_TABLE) {
+    return (u32)piece_table_line_count(file->piece_table);
+  }
+  if(file->storage == FILE_STORAGE_PAGED) {
+    return pager_line_count(file->pager);
+  }
   return gapbuffer_size(file->buffer);
 }
 
+void file_prefetch(File *file, u32 line, i32 direction) {
+  if(file->storage == FILE_STORAGE_PAGED) {
+    pager_prefetch(file->pager, line, direction);
+  }
+}
+
+static inline u64 file_piece_table_offset(File *file, u32 line, u32 col) {
+  u32 byte = line_col_to_byte(file_get_line_at(file, line), col);
+  assert(byte <= file_piece_table_line_size(file, line));
+  return piece_table_line_start(file->piece_table, line) + byte;
+}
+
+static inline void file_journal_record(File *file, JournalOp op, u32 a, u32 b, u32 c, u32 d) {
+  if(!file->journal && file->journaled) {
+    /* NOTE: The edits made while a save is written apply to the saved file */
+    file->journal = journal_create(file->name, file->save ? file->save->base : file->disk_base);
+  }
+  if(file->journal) {
+    journal_record(file->journal, op, a, b, c, d);
+  }
+}
+
+void file_insert_codepoint_at(File *file, u32 line, u32 col, u32 codepoint) {
+  file_journal_record(file, JOURNAL_OP_INSERT_CODEPOINT, line, col, codepoint, 0);
+  if(file->storage == FILE_STORAGE_PIECE_TABLE) {
+    u8 bytes[UTF8_MAX_SIZE];
+    u32 size = utf8_encode(codepoint, bytes);
+    piece_table_insert(file->piece_table, file_piece_table_offset(file, line, col), bytes, size);
+    ++file->version;
+  } else {
+    line_insert_at_index(file_get_line_for_write(file, line), col, codepoint);
+    file_line_index_update(file, line);
+  }
+}
+
+void file_remove_codepoint_at(File *file, u32 line, u32 col) {
+  assert(col > 0);
+  file_journal_record(file, JOURNAL_OP_REMOVE_CODEPOINT, line, col, 0, 0);
+  if(file->storage == FILE_STORAGE_PIECE_TABLE) {
+    u64 start = file_piece_table_offset(file, line, col - 1);
+    u64 end = file_piece_table_offset(file, line, col);
+    piece_table_remove(file->piece_table, start, end - start);
+    ++file->version;
+  } else {
+    line_remove_at_index(file_get_line_for_write(file, line), col);
+    file_line_index_update(file, line);
+    file_trim(file);
+  }
+}
+
+void file_split_line_at(File *file, u32 line, u32 col) {
+  assert(line < file_line_count(file));
+  file_journal_record(file, JOURNAL_OP_SPLIT_LINE, line, col, 0, 0);
+  if(file->storage == FILE_STORAGE_PIECE_TABLE) {
+    u8 newline[2] = {'\r', '\n'};
+    u32 size = file_newline_size(file);
+    piece_table_insert(file->piece_table, file_piece_table_offset(file, line, col), newline + 2 - size, size);
+    ++file->version;
+  } else {
+    file_insert_new_line_at(file, line);
+    Line *new_line = file_get_line_at(file, line);
+    Line *old_line = file_get_line_for_write(file, line + 1);
+    line_copy(new_line, old_line, col);
+    line_remove_from_front_up_to(old_line, col);
+    file_line_index_update(file, line);
+    file_line_index_update(file, line + 1);
+  }
+}
+
+void file_join_lines_at(File *file, u32 line) {
+  assert(line + 1 < file_line_count(file));
+  file_journal_record(file, JOURNAL_OP_JOIN_LINES, line, 0, 0, 0);
+  if(file->storage == FILE_STORAGE_PIECE_TABLE) {
+    /* NOTE: The newline goes whatever it is, a file can mix them */
+    u64 offset = piece_table_line_start(file->piece_table, line) + file_piece_table_line_size(file, line);
+    piece_table_remove(file->piece_table, offset, piece_table_line_start(file->piece_table, line + 1) - offset);
+    ++file->version;
+  } else {
+    Line *first_line = file_get_line_for_write(file, line);
+    Line *second_line = file_get_line_at(file, line + 1);
+    line_copy_at(first_line, second_line, line_size(second_line), line_size(first_line));
+    file_remove_line_at(file, line + 2);
+    file_line_index_update(file, line);
+    file_trim(file);
+  }
+}
+
+void file_remove_range(File *file, Cursor start, Cursor end) {
+  file_journal_record(file, JOURNAL_OP_REMOVE_RANGE, start.line, start.col, end.line, end.col);
+  if(file->storage == FILE_STORAGE_PIECE_TABLE) {
+    u64 start_offset = file_piece_table_offset(file, start.line, start.col);
+    u64 end_offset = file_piece_table_offset(file, end.line, end.col);
+    assert(start_offset <= end_offset);
+    piece_table_remove(file->piece_table, start_offset, end_offset - start_offset);
+    ++file->version;
+  } else if(start.line == end.line) {
+    Line *line = file_get_line_for_write(file, start.line);
+    line_remove_range(line, start.col, end.col);
+    file_line_index_update(file, start.line);
+    file_trim(file);
+  } else if((end.line - start.line) > 0) {
+
+    Line *line_start = file_get_line_for_write(file, start.line);
+    line_remove_range(line_start, start.col, line_size(line_start));
+    Line *line_end = file_get_line_for_write(file, end.line);
+    line_remove_range(line_end, 0, end.col);
+    line_copy_at(line_start, line_end, line_size(line_end), line_size(line_start));
+    file_remove_line_at(file, end.line + 1);
+
+    u32 middle_lines_count = end.line - start.line - 1;
+    for(u32 i = 0; i < middle_lines_count; ++i) {
+      file_remove_line_at(file, start.line + 2);
+    }
+    file_line_index_update(file, start.line);
+    file_trim(file);
+  }
+}
+
+u64 file_cursor_to_offset(File *file, Cursor cursor) {
+  assert(cursor.line < file_line_count(file));
+  u32 byte = line_col_to_byte(file_get_line_at(file, cursor.line), cursor.col);
+  if(file->storage == FILE_STORAGE_PIECE_TABLE) {
+    return piece_table_line_start(file->piece_table, cursor.line) + byte;
+  }
+  if(file->storage == FILE_STORAGE_PAGED) {
+    return pager_line_offset(file->pager, cursor.line) + byte;
+  }
+  if(!file->line_index) {
+    file_line_index_build(file);
+  }
+  return fenwick_prefix(file->line_index, file_line_physical_index(file, cursor.line)) + byte;
+}
+
+Cursor file_offset_to_cursor(File *file, u64 offset) {
+  Cursor cursor;
+  memset(&cursor, 0, sizeof(Cursor));
+  if(file_line_count(file) == 0) {
+    return cursor;
+  }
+
+  /* NOTE: The col is computed in bytes and translated to codepoints at the end */
+  if(file->storage == FILE_STORAGE_PIECE_TABLE) {
+    offset = MIN(offset, piece_table_size(file->piece_table));
+    cursor.line = (u32)piece_table_offset_to_line(file->piece_table, offset);
+    cursor.col = (u32)(offset - piece_table_line_start(file->piece_table, cursor.line));
+    cursor.col = (u32)MIN((u64)cursor.col, file_piece_table_line_size(file, cursor.line));
+  } else if(file->storage == FILE_STORAGE_PAGED) {
+    u64 col = 0;
+    cursor.line = MIN(pager_offset_to_line(file->pager, offset, &col), file_line_count(file) - 1);
+    cursor.col = (u32)MIN(col, (u64)0xffffffff);
+  } else {
+    if(!file->line_index) {
+      file_line_index_build(file);
+    }
+    u64 total = fenwick_prefix(file->line_index, file->line_index_capacity);
+    if(offset >= total) {
+      cursor.line = file_line_count(file) - 1;
+      cursor.col = line_byte_size(file_get_line_at(file, cursor.line));
+    } else {
+      u64 col = 0;
+      u32 physical_index = fenwick_find(file->line_index, file->line_index_capacity, offset, &col);
+      u32 f_index = gapbuffer_f_index(file->buffer);
+      u32 gap_size = gapbuffer_s_index(file->buffer) - f_index;
+      assert(physical_index < f_index || physical_index >= f_index + gap_size);
+      cursor.line = (physical_index < f_index) ? physical_index : physical_index - gap_size;
+      cursor.col = (u32)col;
+    }
+  }
+
+  /* NOTE: Offsets that point into a line ending are moved to the end of the line
+     and offsets inside of a codepoint are moved to its start */
+  Line *line = file_get_line_at(file, cursor.line);
+  cursor.col = line_byte_to_col(line, MIN(cursor.col, line_byte_size(line)));
+  cursor.save_col = cursor.col;
+  return cursor;
+}
 
-Folder *folder_create(u8 *name) {
-  Folder *folder = (Folder *)malloc(sizeof(Folder));
-  memset(folder, 0, sizeof(Folder));
-  u32 name_size = strlen((char *)name);
-  assert(name_size <= FOLDER_MAX_NAME_SIZE);
-  memcpy(folder->name, name, name_size);
-  return folder;
+static inline bool file_save_is_mapped(FileSave *save, u8 *data) {
+  return data >= save->mapping.data && data < save->mapping.data + save->mapping.size;
 }
 
-Folder *folder_load(u8 *folderpath) {
-  return platform_load_folder(folderpath);
+static void file_save_push(FileSave *save, u8 *data, u64 size) {
+  if(size == 0) {
+    return;
+  }
+  u32 span_count = vector_size(save->spans);
+  if(span_count > 0) {
+    /* NOTE: Untouched lines are next to each other in the mapping, so most of a
+       file that was barely modified is written with a few spans */
+    ByteArray *last = &save->spans[span_count - 1];
+    if(last->data + last->size == data) {
+      last->size += size;
+      return;
+    }
+  }
+  ByteArray span;
+  span.data = data;
+  span.size = size;
+  vector_push(save->spans, span);
 }
 
-void folder_destroy(Folder *folder) {
-  if(!folder) {
+static void file_save_push_bytes(FileSave *save, u8 *data, u64 size) {
+  if(!save->frozen || size == 0 || file_save_is_mapped(save, data)) {
+    file_save_push(save, data, size);
     return;
   }
-  for(u32 i = 0; i < vector_size(folder->files); ++i) {
-    file_destroy(folder->files[i]);
+  /* NOTE: Frozen saves copy the bytes that can change while the save thread runs */
+  if(save->copy_block_used + size > save->copy_block_size) {
+    save->copy_block_size = MAX(size, (u64)FILE_SAVE_COPY_BLOCK_SIZE);
+    save->copy_block_used = 0;
+    vector_push(save->copy_blocks, (u8 *)malloc(save->copy_block_size));
+  }
+  u8 *copy = save->copy_blocks[vector_size(save->copy_blocks) - 1] + save->copy_block_used;
+  memcpy(copy, data, size);
+  save->copy_block_used += size;
+  file_save_push(save, copy, size);
+}
+
+static void file_save_push_newline(FileSave *save, bool crlf) {
+  static u8 newline[] = "\r\n";
+  u8 *data = crlf ? newline : newline + 1;
+  u32 size = crlf ? 2 : 1;
+  u32 span_count = vector_size(save->spans);
+  if(span_count > 0) {
+    /* NOTE: After an untouched line the newline is taken from the mapping too */
+    ByteArray *last = &save->spans[span_count - 1];
+    u8 *end = last->data + last->size;
+    if(file_save_is_mapped(save, end) && (u64)(end - save->mapping.data) + size <= save->mapping.size &&
+       memcmp(end, data, size) == 0) {
+      data = end;
+    }
+  }
+  file_save_push(save, data, size);
+}
+
+static void file_save_push_line(FileSave *save, Line *line) {
+  ByteArray first, second;
+  line_get_segments(line, &first, &second);
+  file_save_push_bytes(save, first.data, first.size);
+  file_save_push_bytes(save, second.data, second.size);
+}
+
+static void file_save_push_piece(void *data, u8 *bytes, u64 size) {
+  file_save_push_bytes((FileSave *)data, bytes, size);
+}
+
+static void file_save_push_pages(FileSave *save, File *file) {
+  Pager *pager = file->pager;
+  pager_update(pager);
+  MappedFile mapping = save->mapping;
+  bool first = true;
+  u64 end = 0;
+  for(u32 i = 0; i < vector_size(pager->pages); ++i) {
+    Page *page = &pager->pages[i];
+    end = page->offset + pager_page_byte_size(pager, i);
+    if(page->dirty) {
+      for(u32 j = 0; j < vector_size(page->lines); ++j) {
+        if(!first) {
+          file_save_push_newline(save, file->crlf);
+        }
+        file_save_push_line(save, page->lines[j]);
+        first = false;
+      }
+      continue;
+    }
+    /* NOTE: Clean pages are written from the mapping without the newline of their
+       last line, it is written before the next line like every other newline */
+    u8 *data = mapping.data + page->offset;
+    u64 size = end - page->offset;
+    if(end < mapping.size) {
+      size -= (file->crlf && size >= 2 && data[size - 2] == '\r') ? 2 : 1;
+    }
+    if(!first) {
+      file_save_push_newline(save, file->crlf);
+    }
+    file_save_push(save, data, size);
+    first = false;
+  }
+  /* NOTE: The lines the scan has not reached yet are still untouched */
+  if(end < mapping.size) {
+    if(!first) {
+      file_save_push_newline(save, file->crlf);
+    }
+    file_save_push(save, mapping.data + end, mapping.size - end);
+  }
+}
+
+static i32 file_save_thread(void *data) {
+  FileSave *save = (FileSave *)data;
+  save->result = platform_write_file_spans(save->name, save->spans, vector_size(save->spans), &save->info, save->in_place);
+  __atomic_store_n(&save->done, true, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static void file_save_destroy(FileSave *save) {
+  for(u32 i = 0; i < vector_size(save->copy_blocks); ++i) {
+    free(save->copy_blocks[i]);
+  }
+  vector_free(save->copy_blocks);
+  vector_free(save->spans);
+  free(save->encoded);
+  free(save);
+}
+
+static FileSave *file_save_collect(File *file, bool frozen) {
+  FileSave *save = (FileSave *)malloc(sizeof(FileSave));
+  memset(save, 0, sizeof(FileSave));
+  memcpy(save->name, file->name, FILE_MAX_NAME_SIZE);
+  save->mapping = file->mapping;
+  save->frozen = frozen;
+  save->in_place = file->mapping_is_heap || !file->mapping.data;
+
+  if(file->storage == FILE_STORAGE_PIECE_TABLE) {
+    piece_table_visit(file->piece_table, file_save_push_piece, save);
+  } else if(file->storage == FILE_STORAGE_PAGED) {
+    file_save_push_pages(save, file);
+  } else {
+    for(u32 i = 0; i < file_line_count(file); ++i) {
+      if(i > 0) {
+        file_save_push_newline(save, file->crlf);
+      }
+      file_save_push_line(save, file_get_line_at(file, i));
+    }
+  }
+  return save;
+}
+
+/* NOTE: The spans are utf8, files in other encodings are encoded into one buffer */
+static bool file_save_encode(File *file, FileSave *save) {
+  if(file->encoding == ENCODING_UTF8 && !file->bom) {
+    return true;
+  }
+  ByteArray *spans = 0;
+  if(file->encoding == ENCODING_UTF8) {
+    /* NOTE: Only the byte order mark goes in front, the spans are not copied */
+    ByteArray bom;
+    bom.data = encoding_bom(file->encoding);
+    bom.size = encoding_bom_size(file->encoding);
+    vector_push(spans, bom);
+    for(u32 i = 0; i < vector_size(save->spans); ++i) {
+      vector_push(spans, save->spans[i]);
+    }
+  } else {
+    ByteArray encoded;
+    if(!encoding_encode(file->encoding, file->bom, save->spans, vector_size(save->spans), &encoded)) {
+      /* NOTE: The file on disk is left as it is, the user removes the characters first */
+      vector_free(spans);
+      return false;
+    }
+    save->encoded = encoded.data;
+    vector_push(spans, encoded);
+  }
+  vector_free(save->spans);
+  save->spans = spans;
+  return true;
+}
+
+static void file_save_end(File *file, FileSave *save) {
+  if(save->result) {
+    file->disk_info = save->info;
+    file->disk_base = save->base;
+    file->save_error = 0;
+  } else {
+    file->save_error = "cannot save: the file could not be written";
+  }
+  if(file->journal) {
+    journal_commit(file->journal, save->result);
+  }
+  file_save_destroy(save);
+}
+
+bool file_save(File *file) {
+  /* NOTE: One save at a time, the new save has every change of the previous one anyway */
+  file_save_wait(file);
+
+  /* NOTE: The lines that point into a changed mapping are not the ones that were loaded */
+  if(file_mapping_changed(file)) {
+    file->save_error = "cannot save: the file was changed on disk while it was open";
+    return false;
+  }
+
+  FileSave *save = file_save_collect(file, file->storage != FILE_STORAGE_LINES);
+  if(!file_save_encode(file, save)) {
+    file->save_error = "cannot save: characters the file encoding cannot hold";
+    file_save_destroy(save);
+    return false;
+  }
+  save->base = journal_base_from_spans(save->spans, vector_size(save->spans));
+
+  /* NOTE: The edits made from here on apply to the saved file */
+  if(file->journal) {
+    journal_rotate(file->journal, save->base);
+  }
+
+  if(!save->frozen) {
+    file_save_thread(save);
+    bool result = save->result;
+    file_save_end(file, save);
+    return result;
+  }
+  file->save = save;
+  file->save_thread = platform_create_thread(file_save_thread, save);
+  return true;
+}
+
+bool file_is_saving(File *file) {
+  return file->save && !__atomic_load_n(&file->save->done, __ATOMIC_ACQUIRE);
+}
+
+bool file_save_wait(File *file) {
+  if(!file->save) {
+    return true;
+  }
+  platform_wait_thread(file->save_thread);
+  bool result = file->save->result;
+  file_save_end(file, file->save);
+  file->save = 0;
+  file->save_thread = 0;
+  return result;
+}
+
+static inline bool file_info_equals(PlatformFileInfo *a, PlatformFileInfo *b) {
+  return a->size == b->size && a->modified_time == b->modified_time &&
+         a->device == b->device && a->inode == b->inode;
+}
+
+static u64 file_spans_common_prefix(ByteArray *spans, u32 span_count, u8 *data, u64 size) {
+  u64 prefix = 0;
+  for(u32 i = 0; i < span_count && prefix < size; ++i) {
+    u64 count = MIN(spans[i].size, size - prefix);
+    if(memcmp(spans[i].data, data + prefix, count) == 0) {
+      prefix += count;
+      if(count < spans[i].size) {
+        break;
+      }
+      continue;
+    }
+    for(u64 j = 0; j < count && spans[i].data[j] == data[prefix]; ++j) {
+      ++prefix;
+    }
+    break;
+  }
+  return prefix;
+}
+
+/* NOTE: The suffix never grows past limit, so it does not overlap the prefix */
+static u64 file_spans_common_suffix(ByteArray *spans, u32 span_count, u8 *data, u64 size, u64 limit) {
+  u64 suffix = 0;
+  for(u32 i = span_count; i > 0 && suffix < limit; --i) {
+    ByteArray *span = &spans[i - 1];
+    u64 count = MIN(span->size, limit - suffix);
+    u8 *span_end = span->data + span->size;
+    u8 *data_end = data + size - suffix;
+    if(memcmp(span_end - count, data_end - count, count) == 0) {
+      suffix += count;
+      if(count < span->size) {
+        break;
+      }
+      continue;
+    }
+    for(u64 j = 1; j <= count && span_end[-(i64)j] == data_end[-(i64)j]; ++j) {
+      ++suffix;
+    }
+    break;
+  }
+  return suffix;
+}
+
+static bool file_command_touches_reload(FileCommand *command, FileReload *reload) {
+  u32 start_line = MIN(command->start.line, command->end.line);
+  u32 end_line = MAX(command->start.line, command->end.line);
+  return end_line >= reload->first_line && start_line < reload->first_line + reload->removed_line_count;
+}
+
+static void file_history_reload(FileHistory *history, FileReload *reload) {
+  /* NOTE: A command between the root and the current state that touched lines that
+     changed on disk cannot be undone anymore, the nearest one becomes the root */
+  for(FileCommand *command = history->current; command != history->root; command = command->parent) {
+    if(file_command_touches_reload(command, reload)) {
+      file_history_reroot(history, command);
+      break;
+    }
+  }
+  /* NOTE: Parents come first, a command that touched those lines in another branch
+     goes with the states after it before they are looked at */
+  u32 removed_end = reload->first_line + reload->removed_line_count;
+  i64 delta = (i64)reload->inserted_line_count - (i64)reload->removed_line_count;
+  for(u32 i = history->root->sequence + 1; i < vector_size(history->sequence); ++i) {
+    FileCommand *command = history->sequence[i];
+    if(!command) {
+      continue;
+    }
+    if(file_command_touches_reload(command, reload)) {
+      file_history_free_branch(history, command);
+      continue;
+    }
+    if(MIN(command->start.line, command->end.line) >= removed_end) {
+      command->start.line = (u32)(command->start.line + delta);
+      command->end.line = (u32)(command->end.line + delta);
+      if(command->saved_cursor.line >= removed_end) {
+        command->saved_cursor.line = (u32)(command->saved_cursor.line + delta);
+      }
+    }
+  }
+}
+
+Cursor file_reload_map_cursor(File *file, FileReload *reload, Cursor cursor) {
+  if(!reload->reloaded) {
+    return cursor;
+  }
+  u32 removed_end = reload->first_line + reload->removed_line_count;
+  if(cursor.line >= removed_end) {
+    cursor.line = cursor.line - reload->removed_line_count + reload->inserted_line_count;
+  } else if(cursor.line >= reload->first_line) {
+    cursor.line = MIN(cursor.line, reload->first_line + reload->inserted_line_count - 1);
+  }
+  if(file_line_count(file) == 0) {
+    memset(&cursor, 0, sizeof(Cursor));
+    return cursor;
+  }
+  cursor.line = MIN(cursor.line, file_line_count(file) - 1);
+  cursor.col = MIN(cursor.col, line_size(file_get_line_at(file, cursor.line)));
+  cursor.save_col = MIN(cursor.save_col, cursor.col);
+  return cursor;
+}
+
+/* NOTE: Lines and paged storage only, the bytes go at the start of an empty line.
+   The \r of a \r\n is dropped like when the file is loaded */
+static void file_insert_bytes_at(File *file, u32 line, u8 *data, u64 size) {
+  u8 *line_start = data;
+  u8 *end = data + size;
+  for(;;) {
+    u8 *line_end = scan_find_byte(line_start, end, '\n');
+    u8 *content_end = line_end;
+    if(line_end != end && content_end > line_start && content_end[-1] == '\r') {
+      --content_end;
+      if(!file->crlf) {
+        /* NOTE: The newline size of every line changes, the index is built again */
+        file->crlf = true;
+        free(file->line_index);
+        file->line_index = 0;
+        file->line_index_capacity = 0;
+      }
+    }
+    Line *target = file_get_line_for_write(file, line);
+    line_insert_bytes(target, line_byte_size(target), line_start, (u32)(content_end - line_start));
+    file_line_index_update(file, line);
+    if(line_end == end) {
+      break;
+    }
+    /* NOTE: Split at the end so the line keeps its bytes and the next one starts empty */
+    file_split_line_at(file, line, line_size(target));
+    ++line;
+    line_start = line_end + 1;
+  }
+}
+
+/* NOTE: Replace the lines [first_line, last_line] with the lines of the new file
+   in [start, end), where start is the start of a line and end is the end of one.
+   Lines are found by their newlines, the offsets of the old lines are never used
+   so files with mixed line endings work the same */
+static void file_reload_lines(File *file, FileReload *reload, u32 first_line, u32 last_line, MappedFile mapping, u64 start, u64 end) {
+  u8 *data = mapping.data + start;
+  u64 size = end - start;
+  if(file->storage == FILE_STORAGE_PIECE_TABLE) {
+    PieceTable *table = file->piece_table;
+    u64 old_start = piece_table_line_start(table, first_line);
+    u64 old_end = piece_table_line_start(table, last_line) + piece_table_line_size(table, last_line);
+    piece_table_remove(table, old_start, old_end - old_start);
+    piece_table_insert(table, old_start, data, size);
+    ++file->version;
+  } else {
+    Cursor first;
+    Cursor last;
+    memset(&first, 0, sizeof(Cursor));
+    memset(&last, 0, sizeof(Cursor));
+    first.line = first_line;
+    last.line = last_line;
+    last.col = line_size(file_get_line_at(file, last_line));
+    file_remove_range(file, first, last);
+    /* NOTE: The lines storage keeps the \r of the last line out of it too */
+    if(end < mapping.size && size > 0 && data[size - 1] == '\r') {
+      --size;
+    }
+    file_insert_bytes_at(file, first_line, data, size);
+    file_trim(file);
+  }
+  reload->first_line = first_line;
+  reload->removed_line_count = last_line - first_line + 1;
+  reload->inserted_line_count = (u32)scan_count_byte(data, size, '\n') + 1;
+}
+
+static bool file_tail_compare(u8 *bytes, u64 size, u8 *data, u64 *end, u64 *remaining) {
+  u64 count = MIN(size, *remaining);
+  if(count == 0) {
+    return true;
+  }
+  if(count > *end || memcmp(bytes + size - count, data + *end - count, count) != 0) {
+    return false;
+  }
+  *end -= count;
+  *remaining -= count;
+  return true;
+}
+
+/* NOTE: The lines are the file on disk the last time it was read, their last bytes
+   are compared with the bytes of data before end, from the last line backwards. The
+   lines of a crlf file do not keep the \r so a newline there is \r\n or \n */
+static bool file_tail_matches(File *file, u8 *data, u64 end, u64 size) {
+  static u8 newline[] = "\r\n";
+  u64 remaining = MIN(size, end);
+  u32 line_count = file_line_count(file);
+  for(u32 i = line_count; i-- > 0 && remaining > 0;) {
+    ByteArray first, second;
+    line_get_segments(file_get_line_at(file, i), &first, &second);
+    if(!file_tail_compare(second.data, second.size, data, &end, &remaining) ||
+       !file_tail_compare(first.data, first.size, data, &end, &remaining)) {
+      return false;
+    }
+    if(i > 0) {
+      bool crlf = file->crlf && end >= 2 && remaining >= 2 && data[end - 2] == '\r';
+      if(!file_tail_compare(crlf ? newline : newline + 1, crlf ? 2 : 1, data, &end, &remaining)) {
+        return false;
+      }
+    }
   }
-  for(u32 i = 0; i < vector_size(folder->folders); ++i) {
-    folder_destroy(folder->folders[i]);
+  return remaining == 0;
+}
+
+static u64 file_line_start_before(u8 *data, u64 offset) {
+  while(offset > 0 && data[offset - 1] != '\n') {
+    --offset;
   }
-  vector_free(folder->files);
-  vector_free(folder->folders);
-  free(folder);
+  return offset;
 }
 
-void folder_add_file(Folder *folder, File *file) {
-  vector_push(folder->files, file);
+/* NOTE: The new file takes the place of the storage, everything else stays */
+static void file_reload_all(File *file, FileReload *reload, MappedFile mapping, PlatformFileInfo info, bool heap) {
+  File *fresh = file_load_mapping(file->name, mapping, info, false, heap, 0);
+  reload->first_line = 0;
+  reload->removed_line_count = file_line_count(file);
+  reload->inserted_line_count = file_line_count(fresh);
+
+  File old = *file;
+  *file = *fresh;
+  file->line_free_budget = old.line_free_budget;
+  file->cursor_saved = old.cursor_saved;
+  file->version = old.version + 1;
+  file->save = old.save;
+  file->save_thread = old.save_thread;
+  file->journal = old.journal;
+  file->history = old.history;
+  file->follow = old.follow;
+
+  old.history = fresh->history;
+  file_free_all_lines(&old);
+  gapbuffer_free(old.buffer);
+  free(fresh);
 }
 
-void folder_add_folder(Folder *parent, Folder *child) {
-  vector_push(parent->folders, child);
+FileReload file_reload(File *file) {
+  FileReload reload;
+  memset(&reload, 0, sizeof(FileReload));
+  reload.file = file;
+  /* NOTE: The file being saved is the file on disk once the save ends */
+  if(file_is_saving(file)) {
+    return reload;
+  }
+  file_save_wait(file);
+
+  PlatformFileInfo info;
+  if(!platform_get_file_info(file->name, &info) || file_info_equals(&info, &file->disk_info)) {
+    return reload;
+  }
+  if(file->journal && !file->journal->empty) {
+    printf("File changed on disk, the unsaved edits are kept: %s\n", file->name);
+    if(file_mapping_changed(file)) {
+      /* NOTE: The edits stay on screen and in the journal but they cannot be saved */
+      file->save_error = "cannot save: the file was changed on disk while it was open";
+    }
+    file->disk_info = info;
+    return reload;
+  }
+  if(file->storage == FILE_STORAGE_PAGED) {
+    if(pager_is_scanning(file->pager)) {
+      reload.deferred = true;
+      return reload;
+    }
+    /* NOTE: The scan is over, this only joins its thread and takes the last pages */
+    pager_wait_scan(file->pager);
+  }
+  MappedFile mapping;
+  bool heap = false;
+  if(!file_read_or_map(file->name, &mapping, &info, &heap)) {
+    return reload;
+  }
+  ByteArray span;
+  span.data = mapping.data;
+  span.size = mapping.size;
+  JournalBase disk_base = journal_base_from_spans(&span, 1);
+  /* NOTE: A file that changed its encoding is loaded again */
+  bool bom = false;
+  Encoding encoding = file_detect_encoding(mapping, &bom);
+  bool same_encoding = (encoding == file->encoding && bom == file->bom);
+
+  /* NOTE: An append is found by hashing the new file up to the old size and then
+     comparing the last bytes before the old size with the lines, a hash that only
+     samples the file is not trusted alone. Only utf8 files map the new bytes
+     straight to lines */
+  u64 old_size = file->disk_base.size;
+  bool appended = false;
+  if(encoding == ENCODING_UTF8 && !bom && same_encoding && mapping.size >= old_size && file_line_count(file) > 0) {
+    ByteArray head;
+    head.data = mapping.data;
+    head.size = old_size;
+    JournalBase base = journal_base_from_spans(&head, 1);
+    appended = (base.hash == file->disk_base.hash) &&
+               file_tail_matches(file, mapping.data, old_size, FILE_RELOAD_TAIL_CHECK_SIZE);
+  }
+  /* NOTE: A file written in place changed the pages under the mapped lines, what
+     they were is lost so every line is replaced */
+  bool in_place = (!file->mapping_is_heap && info.device == file->mapping_info.device &&
+                   info.inode == file->mapping_info.inode);
+
+  /* NOTE: The lines replaced by the reload are not edits of the user */
+  Journal *journal = file->journal;
+  bool journaled = file->journaled;
+  file->journal = 0;
+  file->journaled = false;
+  bool keep_mapping = false;
+  if(appended) {
+    if(mapping.size > old_size) {
+      /* NOTE: Only the last line and the new bytes are touched */
+      u32 last_line = file_line_count(file) - 1;
+      u64 start = file_line_start_before(mapping.data, old_size);
+      file_reload_lines(file, &reload, last_line, last_line, mapping, start, mapping.size);
+      reload.reloaded = true;
+      reload.appended = true;
+    }
+  } else if(!in_place && same_encoding && file_line_count(file) > 0) {
+    /* NOTE: The spans of the file are utf8, they are compared to the new file decoded */
+    MappedFile content = file_mapping_content(mapping, encoding, bom);
+    FileSave *save = file_save_collect(file, false);
+    u32 span_count = vector_size(save->spans);
+    old_size = 0;
+    for(u32 i = 0; i < span_count; ++i) {
+      old_size += save->spans[i].size;
+    }
+    u64 prefix = file_spans_common_prefix(save->spans, span_count, content.data, content.size);
+    u64 suffix = file_spans_common_suffix(save->spans, span_count, content.data, content.size, MIN(old_size, content.size) - prefix);
+    file_save_destroy(save);
+    if(prefix != old_size || old_size != content.size) {
+      /* NOTE: The bytes of the prefix and the suffix are the same in both files, so
+         are their newlines */
+      u64 suffix_start = content.size - suffix;
+      u32 first_line = (u32)scan_count_byte(content.data, prefix, '\n');
+      u32 last_line = file_line_count(file) - 1 - (u32)scan_count_byte(content.data + suffix_start, suffix, '\n');
+      u64 start = file_line_start_before(content.data, prefix);
+      u64 end = scan_find_byte(content.data + suffix_start, content.data + content.size, '\n') - content.data;
+      file_reload_lines(file, &reload, first_line, last_line, content, start, end);
+      reload.reloaded = true;
+    }
+    if(file_encoding_is_decoded(encoding)) {
+      free(content.data);
+    }
+  } else {
+    file_reload_all(file, &reload, mapping, info, heap);
+    reload.reloaded = true;
+    keep_mapping = true;
+  }
+
+  file->disk_info = info;
+  file->disk_base = disk_base;
+  if(!keep_mapping) {
+    file_release_mapping(mapping, heap);
+  }
+  file->journaled = journaled;
+  if(journal) {
+    /* NOTE: The journal had no records, the next edit starts one from the new file */
+    journal_destroy(journal);
+  }
+  if(reload.reloaded) {
+    file->cursor_saved = file_reload_map_cursor(file, &reload, file->cursor_saved);
+    file_history_reload(file->history, &reload);
+  }
+  return reload;
 }
 
+/* NOTE: Records that do not fit the file come from a torn or foreign journal, the replay stops there */
+static bool file_apply_journal_record(File *file, JournalRecord *record) {
+  u32 *values = record->values;
+  u32 line_count = file_line_count(file);
+  if(values[0] >= line_count) {
+    return false;
+  }
+  u32 size = line_size(file_get_line_at(file, values[0]));
+  switch(record->op) {
+  case JOURNAL_OP_INSERT_CODEPOINT: {
+    if(values[1] > size) {
+      return false;
+    }
+    file_insert_codepoint_at(file, values[0], values[1], values[2]);
+  } break;
+  case JOURNAL_OP_REMOVE_CODEPOINT: {
+    if(values[1] == 0 || values[1] > size) {
+      return false;
+    }
+    file_remove_codepoint_at(file, values[0], values[1]);
+  } break;
+  case JOURNAL_OP_SPLIT_LINE: {
+    if(values[1] > size) {
+      return false;
+    }
+    file_split_line_at(file, values[0], values[1]);
+  } break;
+  case JOURNAL_OP_JOIN_LINES: {
+    if(values[0] + 1 >= line_count) {
+      return false;
+    }
+    file_join_lines_at(file, values[0]);
+  } break;
+  case JOURNAL_OP_REMOVE_RANGE: {
+    if(values[1] > size || values[2] < values[0] || values[2] >= line_count ||
+       values[3] > line_size(file_get_line_at(file, values[2])) ||
+       (values[2] == values[0] && values[3] < values[1])) {
+      return false;
+    }
+    Cursor start, end;
+    memset(&start, 0, sizeof(Cursor));
+    memset(&end, 0, sizeof(Cursor));
+    start.line = values[0];
+    start.col = values[1];
+    end.line = values[2];
+    end.col = values[3];
+    file_remove_range(file, start, end);
+  } break;
+  default: {
+    return false;
+  } break;
+  }
+  return true;
+}
 
+/* NOTE: Replay the journal at name when it starts from base, false when it does not */
+static bool file_replay_journal(File *file, u8 *name, JournalBase base, bool check_base) {
+  ByteArray bytes;
+  PlatformFileInfo info;
+  /* NOTE: A journal that cannot be read is left on disk, the file opens without it */
+  if(!platform_try_read_file(name, &bytes, &info)) {
+    return false;
+  }
+  JournalBase journal_base;
+  bool valid = journal_read_base(bytes, &journal_base);
+  if(valid && check_base) {
+    valid = (journal_base.size == base.size && journal_base.hash == base.hash);
+  }
+  if(valid) {
+    u64 offset = JOURNAL_HEADER_SIZE;
+    u32 record_count = 0;
+    JournalRecord record;
+    while(journal_read_record(bytes, &offset, &record) && file_apply_journal_record(file, &record)) {
+      ++record_count;
+    }
+    if(record_count > 0) {
+      printf("Recovered %d unsaved edits of: %s\n", record_count, file->name);
+    }
+  }
+  free(bytes.data);
+  return valid;
+}
 
+void file_start_journal(File *file) {
+  if(file->journaled) {
+    return;
+  }
+  u8 name[JOURNAL_MAX_NAME_SIZE];
+  u8 previous_name[JOURNAL_MAX_NAME_SIZE];
+  journal_get_names(file->name, name, previous_name);
+  /* NOTE: The file has no edits yet, it is the file on disk */
+  JournalBase base = file->disk_base;
 
+  /* NOTE: Both journals are there when the editor stopped in the middle of a save,
+     the previous one applies when the save did not replace the file */
+  bool recovered = false;
+  if(platform_file_exists(previous_name) && platform_file_exists(name) &&
+     file_replay_journal(file, previous_name, base, true)) {
+    file_replay_journal(file, name, base, false);
+    journal_fold(name, previous_name);
+    recovered = true;
+  } else if(platform_file_exists(name)) {
+    recovered = file_replay_journal(file, name, base, true);
+  }
+  if(recovered) {
+    file->journal = journal_open(file->name);
+  }
+  /* NOTE: Set after the replay, the replayed edits are in the journal already */
+  file->journaled = true;
+}
@@ -3,6 +3,9 @@
 
 #include "quill.h"
 #include "quill_cursor.h"
+#include "quill_journal.h"
+#include "quill_encoding.h"
+#include "quill_pager.h"
 
 typedef enum FileCommandType {
   FILE_COMMAN_NONE,
@@ -12,38 +15,200 @@ typedef enum FileCommandType {
   FILE_COMMAND_SPLIT_LINE,
 } FileCommandType;
 
+/* NOTE: A command is the change from the state of its parent to its own state,
+   undo applies it as it was recorded and redo applies its inverse */
 typedef struct FileCommand {
   FileCommandType type;
   Cursor start;
   Cursor end;
-  u8 *text;
   Cursor saved_cursor;
+  /* NOTE: The text is zero when it was spilled and is only in the spill file */
+  u8 *text;
+  u64 text_size;
+  u64 text_capacity;
+  /* NOTE: Where the text is in the spill file, FILE_COMMAND_NOT_SPILLED when it was
+     never written there or changed since */
+  u64 spill_offset;
+  struct FileCommand *parent;
+  /* NOTE: The newest child, the older ones follow through sibling */
+  struct FileCommand *child;
+  struct FileCommand *sibling;
+  /* NOTE: The child redo goes to, the branch the file was in last */
+  struct FileCommand *redo;
+  u32 depth;
+  /* NOTE: The order the commands were made in, index into the sequence of the history */
+  u32 sequence;
 } FileCommand;
 
-#define FILE_MAX_UNDO_REDO_SIZE 256
-typedef struct FileCommandStack {
-  FileCommand commands[FILE_MAX_UNDO_REDO_SIZE];
-  u32 top;
-  u32 size;
-} FileCommandStack;
+#define FILE_COMMAND_NOT_SPILLED 0xffffffffffffffffull
+
+/* NOTE: The undo history of a file is a tree, typing after an undo starts a new
+   branch and the old one stays. Going from a state to any other undoes up to
+   their common ancestor and redoes down from it, the rest of the tree is not
+   touched. The text of the commands stays in memory up to the budget, past it
+   the text of the oldest commands goes into a temporary spill file and is read
+   back when they are applied */
+#define FILE_DEFAULT_HISTORY_BUDGET (64 * 1024 * 1024)
+/* NOTE: Commands are allocated in blocks of this many */
+#define FILE_HISTORY_BLOCK_SIZE 256
+typedef struct FileHistory {
+  /* NOTE: The state the file was loaded in, its command is empty */
+  FileCommand *root;
+  /* NOTE: The state the file is in */
+  FileCommand *current;
+  /* NOTE: Vector of blocks, only the last one has unused commands. Freed
+     commands are reused first, they are linked through sibling */
+  FileCommand **blocks;
+  u32 block_used;
+  FileCommand *free_commands;
+  /* NOTE: Vector with every command by its sequence, zero once it was freed */
+  FileCommand **sequence;
+  u64 budget;
+  /* NOTE: Bytes allocated for the text of the commands */
+  u64 text_size;
+  void *spill_file;
+  u64 spill_size;
+} FileHistory;
+
+FileHistory *file_history_create(u64 budget);
+void file_history_destroy(FileHistory *history);
+/* NOTE: A new command with no text after the current state, it is the new state */
+FileCommand *file_history_push(FileHistory *history);
+void file_history_push_text(FileHistory *history, FileCommand *command, u8 *text, u64 size);
+/* NOTE: The command of the current state, zero at the root */
+FileCommand *file_history_current(FileHistory *history);
+/* NOTE: Step to the parent or to the redo child with the text of the command in
+   memory, they return the command to apply or zero when there is none. When the
+   text cannot be read back the states only reachable through it are freed */
+FileCommand *file_history_undo(FileHistory *history);
+FileCommand *file_history_redo(FileHistory *history);
+/* NOTE: Point the redo children from the common ancestor of the current state and
+   command down to command, returns the common ancestor */
+FileCommand *file_history_route(FileHistory *history, FileCommand *command);
+/* NOTE: The state made right before or right after the current one, zero when there is none */
+FileCommand *file_history_previous_in_time(FileHistory *history);
+FileCommand *file_history_next_in_time(FileHistory *history);
+
+typedef enum FileStorage {
+  FILE_STORAGE_LINES,
+  FILE_STORAGE_PIECE_TABLE,
+  FILE_STORAGE_PAGED,
+} FileStorage;
+
+/* NOTE: Files bigger than this are loaded into a piece table instead of a gap buffer of lines */
+#define FILE_PIECE_TABLE_MIN_SIZE (32 * 1024 * 1024)
+/* NOTE: Files bigger than this are paged, see quill_pager.h */
+#define FILE_PAGED_MIN_SIZE (1024ull * 1024 * 1024)
+/* NOTE: Bytes before the old end of a file that a reload compares with the lines
+   before it takes the change for an append */
+#define FILE_RELOAD_TAIL_CHECK_SIZE (64 * 1024)
 
-FileCommandStack *file_command_stack_create();
-void file_command_stack_destroy(FileCommandStack *stack);
-FileCommand *file_command_stack_push(FileCommandStack *stack);
-FileCommand *file_command_stack_pop(FileCommandStack *stack);
-FileCommand *file_command_stack_top(FileCommandStack *stack);
-void file_command_copy(FileCommand *des, FileCommand *src);
+/* NOTE: Piece table files materialize the lines the editor ask for into this cache,
+   the cache is invalidated every time the file is modified */
+#define FILE_LINE_CACHE_SIZE 128
+typedef struct FileLineCacheEntry {
+  struct Line *line;
+  u32 index;
+  u32 version;
+} FileLineCacheEntry;
+
+/* NOTE: Files with at least this many bytes per thread are loaded on several threads,
+   each thread builds the lines of a chunk that ends on a newline */
+#define FILE_LOAD_CHUNK_MIN_SIZE (2 * 1024 * 1024)
+#define FILE_LOAD_MAX_THREADS 16
+
+/* NOTE: When the line allocator holds more free bytes than the budget the file is compacted */
+#define FILE_DEFAULT_LINE_FREE_BUDGET (4 * 1024 * 1024)
 
 #define FILE_MAX_NAME_SIZE 256
+
+/* NOTE: Bytes copied for a background save are packed into blocks of this size */
+#define FILE_SAVE_COPY_BLOCK_SIZE (64 * 1024)
+
+/* NOTE: A save is the list of spans written to disk, the spans point straight into
+   the mapping and the line buffers. A background save runs against a frozen copy:
+   the mapped bytes never change so they are still referenced and everything else
+   is copied into blocks that belong to the save */
+typedef struct FileSave {
+  u8 name[FILE_MAX_NAME_SIZE + 1];
+  MappedFile mapping;
+  ByteArray *spans;
+  bool frozen;
+  /* NOTE: The spans do not point into a mapping of the file, it can be written in place */
+  bool in_place;
+
+  u8 **copy_blocks;
+  u64 copy_block_used;
+  u64 copy_block_size;
+  /* NOTE: Files that are not utf8 are written from one buffer in their encoding */
+  u8 *encoded;
+
+  /* NOTE: Written by the save thread, done is read with atomics */
+  bool result;
+  bool done;
+  /* NOTE: What was written, the file takes them when the save succeeds */
+  JournalBase base;
+  PlatformFileInfo info;
+} FileSave;
+
 typedef struct File {
 
   u8 name[FILE_MAX_NAME_SIZE];
+  FileStorage storage;
   struct Line **buffer;
-  struct Line *line_first_free;
+  struct LineAllocator *line_allocator;
+  /* NOTE: Allocators of the lines built by the load threads, the lines keep using
+     them until the file is compacted */
+  struct LineAllocator **load_allocators;
+  u64 line_free_budget;
+  /* NOTE: Lines that were never modified and the piece table original buffer point into this mapping */
+  MappedFile mapping;
+  /* NOTE: The mapping is a heap buffer that was read whole or decoded instead of a mapped file */
+  bool mapping_is_heap;
+  /* NOTE: The mapped file was written in place on disk, the lines that point into the
+     mapping are not the ones that were loaded anymore so the file is never saved */
+  bool mapping_changed;
+  /* NOTE: The encoding of the file on disk, the lines are always utf8 and a save
+     writes the file back in its encoding */
+  Encoding encoding;
+  bool bom;
+  /* NOTE: The file uses \r\n line endings, the \r is not stored in the lines */
+  bool crlf;
+  /* NOTE: The file on disk the last time the file was loaded, saved or reloaded, a
+     change on disk is only reloaded when it does not match. mapping_info is the
+     file the mapping comes from */
+  PlatformFileInfo disk_info;
+  JournalBase disk_base;
+  PlatformFileInfo mapping_info;
+  /* NOTE: Follow mode, the editors keep a cursor on the last line at the end of the
+     file as the file grows on disk, like tail -f */
+  bool follow;
+
+  /* NOTE: Fenwick tree over the physical slots of buffer, each slot holds the size
+     of its line plus the newline and gap slots hold zero. It is built the first time
+     an offset is needed and then kept up to date by every line mutation */
+  u64 *line_index;
+  u32 line_index_capacity;
+  /* NOTE: Slots that reference an interned line another slot also references */
+  u32 shared_line_count;
   Cursor cursor_saved;
 
-  FileCommandStack *undo_stack;
-  FileCommandStack *redo_stack;
+  struct PieceTable *piece_table;
+  FileLineCacheEntry line_cache[FILE_LINE_CACHE_SIZE];
+  struct Pager *pager;
+  u32 version;
+
+  /* NOTE: Background save in flight, the mapping must outlive it */
+  FileSave *save;
+  void *save_thread;
+  /* NOTE: Why the last save failed, the application shows it until a save succeeds */
+  char *save_error;
+  /* NOTE: Edits are recorded here once the file is opened in an editor, the journal
+     is created by the first edit so files that are only read never start one */
+  struct Journal *journal;
+  bool journaled;
+
+  FileHistory *history;
 
 } File;
 
@@ -53,28 +218,88 @@ void file_destroy(File *file);
 struct Line *file_line_create(File *file);
 void file_line_free(File *file, struct Line *line);
 
+/* NOTE: The loaders of existing files return zero when the file cannot be mapped */
 File *file_load_from_existing_file(u8 *filename);
+/* NOTE: Load a file below FILE_PIECE_TABLE_MIN_SIZE that was already read, for example
+   with platform_read_file_async, the file takes the bytes and frees them */
+File *file_load_from_bytes(u8 *filename, ByteArray bytes, PlatformFileInfo info);
+/* NOTE: Identical lines share one read only Line, a line gets its own copy the
+   first time it is modified. Meant for logs, csv dumps and generated code */
+File *file_load_from_existing_file_interned(u8 *filename);
+/* NOTE: Paged files take the page offsets of an earlier scan when the file on disk
+   still has the size and modified time they were scanned from, offsets can be zero */
+File *file_load_from_existing_file_paged(u8 *filename, PagerOffsets *offsets);
+/* NOTE: The page offsets of a paged file once its scan is over, into a heap buffer */
+bool file_get_page_offsets(File *file, PagerOffsets *offsets);
 void file_insert_new_line(File *file);
 void file_insert_new_line_at(File *file, u32 index);
 void file_remove_line(File *file);
 /* TODO: file_remove_line_at must remove (index + 1) */
 void file_remove_line_at(File *file, u32 index);
 void file_print(File *file);
+/* NOTE: Repack every line into a new allocator at its exact size and release the old one */
+void file_compact(File *file);
 struct Line *file_get_line_at(File *file, u32 index);
 u32 file_line_count(File *file);
+/* NOTE: Called when the view scrolls, paged files bring in the lines ahead of line */
+void file_prefetch(File *file, u32 line, i32 direction);
+
+typedef struct FileInternStats {
+  u32 line_count;
+  u32 shared_line_count;
+  u64 saved_bytes;
+} FileInternStats;
+
+FileInternStats file_intern_stats(File *file);
+
+/* NOTE: Write the file back to its name. Lines files are written right away, piece
+   table and paged files are written by a background thread so the file can still
+   be edited, it returns false when the save failed or could not start. A file with
+   characters its encoding cannot hold is not saved, its encoding never changes
+   behind the user's back */
+bool file_save(File *file);
+bool file_is_saving(File *file);
+/* NOTE: Wait for the background save and return whether it succeeded */
+bool file_save_wait(File *file);
+
+/* NOTE: Lines [first_line, first_line + removed_line_count) of the file were replaced
+   by inserted_line_count lines */
+typedef struct FileReload {
+  File *file;
+  bool reloaded;
+  /* NOTE: The paged file is still being scanned, the reload is tried again once the
+     scan is done instead of waiting for it */
+  bool deferred;
+  /* NOTE: Bytes were only added at the end, first_line is the old last line */
+  bool appended;
+  u32 first_line;
+  u32 removed_line_count;
+  u32 inserted_line_count;
+} FileReload;
+
+/* NOTE: Bring the file up to date with the file on disk when it changed and it has
+   no unsaved edits. Only the lines that changed are replaced, an append only reads
+   the new bytes. The cursor_saved and the undo history are moved with the lines */
+FileReload file_reload(File *file);
+Cursor file_reload_map_cursor(File *file, FileReload *reload, Cursor cursor);
 
-#define FOLDER_MAX_NAME_SIZE 256
-typedef struct Folder {
-  u8 name[FOLDER_MAX_NAME_SIZE];
-  File **files;
-  struct Folder **folders;
-} Folder;
+/* NOTE: Replay the edits a crash left in the journal of the file and record every
+   edit from now on, it has to be called before the file is modified. The journal
+   file is only created by the first edit when nothing was replayed */
+void file_start_journal(File *file);
 
-Folder *folder_create(u8 *name);
-Folder *folder_load(u8 *folderpath);
-void folder_destroy(Folder *folder);
+/* NOTE: Offsets are in bytes of the utf8 content of the file and columns are
+   codepoints. They are bytes of the file on disk only for utf8 files without a
+   bom, a bom is not counted and other encodings are counted once decoded */
+u64 file_cursor_to_offset(File *file, Cursor cursor);
+Cursor file_offset_to_cursor(File *file, u64 offset);
 
-void folder_add_file(Folder *folder, File *file);
-void folder_add_folder(Folder *parent, Folder *child);
+/* NOTE: Text editing API, this functions work for every file storage */
+void file_insert_codepoint_at(File *file, u32 line, u32 col, u32 codepoint);
+/* NOTE: Same as line_remove_at_index, remove the codepoint before col */
+void file_remove_codepoint_at(File *file, u32 line, u32 col);
+void file_split_line_at(File *file, u32 line, u32 col);
+void file_join_lines_at(File *file, u32 line);
+void file_remove_range(File *file, Cursor start, Cursor end);
 
 #endif /* _QUILL_FILE_H_ */
@@ -0,0 +1,361 @@
+#include "quill_finder.h"
+#include "quill_folder.h"
+#include "quill_data_structures.h"
+#include "quill_scan.h"
+
+static inline bool finder_is_lower(u8 byte) {
+  return byte >= 'a' && byte <= 'z';
+}
+
+static inline bool finder_is_upper(u8 byte) {
+  return byte >= 'A' && byte <= 'Z';
+}
+
+static inline bool finder_byte_matches(u8 path_byte, u8 query_byte) {
+  return path_byte == query_byte || (finder_is_lower(query_byte) && path_byte == query_byte - 32);
+}
+
+static inline u8 *finder_path(Finder *finder, u32 index, u32 *size) {
+  *size = finder->path_starts[index + 1] - finder->path_starts[index];
+  return finder->path_bytes + finder->path_starts[index];
+}
+
+/* NOTE: The root of the walk and its slash start every path, they are left out */
+static void finder_copy_paths(Finder *finder, FolderWalk *walk, u32 first, u32 last) {
+  if(first == 0) {
+    vector_clear(finder->path_bytes);
+    vector_clear(finder->path_starts);
+    vector_push(finder->path_starts, 0);
+  }
+  u32 root_size = strlen((char *)walk->root->name) + 1;
+  for(u32 i = first; i < last; ++i) {
+    u8 *path = walk->files[i]->path;
+    u32 path_size = strlen((char *)path);
+    u32 skip = MIN(root_size, path_size);
+    for(u32 j = skip; j < path_size; ++j) {
+      vector_push(finder->path_bytes, path[j]);
+    }
+    vector_push(finder->path_starts, vector_size(finder->path_bytes));
+  }
+}
+
+static i32 finder_bonus(u8 *path, u32 index) {
+  if(index == 0 || path[index - 1] == '/') {
+    return FINDER_BONUS_SLASH;
+  }
+  u8 previous = path[index - 1];
+  if(previous == '_' || previous == '-' || previous == '.' || previous == ' ') {
+    return FINDER_BONUS_BOUNDARY;
+  }
+  if(finder_is_lower(previous) && finder_is_upper(path[index])) {
+    return FINDER_BONUS_CAMEL;
+  }
+  return 0;
+}
+
+/* NOTE: Returns false when the query is not a subsequence of the path. The first
+   match from the left is found a block of bytes at a time, then the bytes are
+   matched again backwards from its end so the match is as tight as it can be.
+   Only the matched bytes are scored, a gap costs by its size. The first match of
+   the first matched bytes of the query ends at match->end, it is only extended */
+static bool finder_match(u8 *path, u32 path_size, u8 *query, u32 query_size, u32 matched, FinderMatch *match) {
+  u8 *iterator = path + match->end;
+  u8 *path_end = path + path_size;
+  for(u32 q = matched; q < query_size; ++q) {
+    u8 byte = query[q];
+    u8 other = finder_is_lower(byte) ? byte - 32 : byte;
+    iterator = scan_find_either_byte(iterator, path_end, byte, other);
+    if(iterator == path_end) {
+      return false;
+    }
+    ++iterator;
+  }
+  match->end = (u32)(iterator - path);
+  u32 positions[FINDER_MAX_QUERY_SIZE];
+  u32 i = match->end;
+  for(u32 q = query_size; q-- > 0;) {
+    do {
+      --i;
+    } while(!finder_byte_matches(path[i], query[q]));
+    positions[q] = i;
+  }
+
+  i32 score = 0;
+  i32 first_bonus = 0;
+  for(u32 q = 0; q < query_size; ++q) {
+    i32 bonus = finder_bonus(path, positions[q]);
+    u32 gap = q ? positions[q] - positions[q - 1] - 1 : 0;
+    if(q == 0 || gap) {
+      first_bonus = bonus;
+    } else {
+      /* NOTE: A run keeps the bonus of where it started, a boundary inside it raises it */
+      if(bonus >= FINDER_BONUS_BOUNDARY && bonus > first_bonus) {
+        first_bonus = bonus;
+      }
+      bonus = MAX(bonus, MAX(first_bonus, FINDER_BONUS_CONSECUTIVE));
+    }
+    if(gap) {
+      score += FINDER_SCORE_GAP_START + (i32)(gap - 1) * FINDER_SCORE_GAP_EXTENSION;
+    }
+    score += FINDER_SCORE_MATCH + (q == 0 ? bonus * FINDER_BONUS_FIRST_MULTIPLIER : bonus);
+  }
+  match->score = score;
+  return true;
+}
+
+static inline bool finder_is_better(FinderMatch *a, FinderMatch *b) {
+  if(a->score != b->score) {
+    return a->score > b->score;
+  }
+  if(a->path_size != b->path_size) {
+    return a->path_size < b->path_size;
+  }
+  return a->index < b->index;
+}
+
+static int finder_match_compare(const void *a, const void *b) {
+  return finder_is_better((FinderMatch *)a, (FinderMatch *)b) ? -1 : 1;
+}
+
+/* NOTE: ranked is a heap with the worst match on top while the candidates are scored */
+static void finder_heap_sift_down(FinderMatch *heap, u32 size, u32 index) {
+  for(;;) {
+    u32 worst = index;
+    u32 left = index * 2 + 1;
+    u32 right = left + 1;
+    if(left < size && finder_is_better(&heap[worst], &heap[left])) {
+      worst = left;
+    }
+    if(right < size && finder_is_better(&heap[worst], &heap[right])) {
+      worst = right;
+    }
+    if(worst == index) {
+      return;
+    }
+    FinderMatch temp = heap[index];
+    heap[index] = heap[worst];
+    heap[worst] = temp;
+    index = worst;
+  }
+}
+
+static void finder_heap_push(FinderMatch *heap, u32 size) {
+  u32 index = size - 1;
+  while(index > 0) {
+    u32 parent = (index - 1) / 2;
+    if(!finder_is_better(&heap[parent], &heap[index])) {
+      return;
+    }
+    FinderMatch temp = heap[index];
+    heap[index] = heap[parent];
+    heap[parent] = temp;
+    index = parent;
+  }
+}
+
+/* NOTE: Push the file into the level when it matches the query up to the level,
+   match is where it was in the level before */
+static void finder_filter(Finder *finder, u32 level, FinderMatch match) {
+  u32 path_size = 0;
+  u8 *path = finder_path(finder, match.index, &path_size);
+  if(finder_match(path, path_size, finder->query, level + 1, level, &match)) {
+    vector_push(finder->levels[level], match);
+  }
+}
+
+/* NOTE: The first byte of the query is searched for in all the paths of the block
+   at once, the files without it are skipped without being looked at one by one.
+   Returns the number of files looked at */
+static u32 finder_add_files(Finder *finder, u32 count) {
+  u32 first = finder->added_count;
+  u32 last = MIN(first + count, finder->file_count);
+  u8 byte = finder->query[0];
+  u8 other = finder_is_lower(byte) ? byte - 32 : byte;
+  u8 *iterator = finder->path_bytes + finder->path_starts[first];
+  u8 *end = finder->path_bytes + finder->path_starts[last];
+  u32 index = first;
+  for(;;) {
+    iterator = scan_find_either_byte(iterator, end, byte, other);
+    if(iterator == end) {
+      break;
+    }
+    u32 offset = (u32)(iterator - finder->path_bytes);
+    while(finder->path_starts[index + 1] <= offset) {
+      ++index;
+    }
+    FinderMatch match;
+    memset(&match, 0, sizeof(FinderMatch));
+    match.index = index;
+    match.path_size = finder->path_starts[index + 1] - finder->path_starts[index];
+    match.end = offset - finder->path_starts[index];
+    finder_filter(finder, 0, match);
+    iterator = finder->path_bytes + finder->path_starts[index + 1];
+  }
+  finder->added_count = last;
+  return last - first;
+}
+
+/* NOTE: Only the files that matched the shorter query can match the level, returns
+   the number of candidates looked at */
+static u32 finder_filter_level(Finder *finder, u32 level, u32 count) {
+  FinderMatch *candidates = finder->levels[level - 1];
+  u32 first = finder->filtered_counts[level];
+  u32 last = MIN(first + count, vector_size(candidates));
+  for(u32 i = first; i < last; ++i) {
+    finder_filter(finder, level, candidates[i]);
+  }
+  finder->filtered_counts[level] = last;
+  return last - first;
+}
+
+/* NOTE: The scores are kept in the levels, ranking only selects the best of the last one */
+static u32 finder_rank(Finder *finder, u32 count) {
+  FinderMatch *matches = finder->levels[finder->query_size - 1];
+  u32 first = finder->heap_count;
+  u32 last = MIN(first + count, vector_size(matches));
+  for(u32 i = first; i < last; ++i) {
+    u32 size = vector_size(finder->heap);
+    if(size < FINDER_MAX_RANKED) {
+      vector_push(finder->heap, matches[i]);
+      finder_heap_push(finder->heap, size + 1);
+    } else if(finder_is_better(&matches[i], &finder->heap[0])) {
+      finder->heap[0] = matches[i];
+      finder_heap_sift_down(finder->heap, size, 0);
+    }
+  }
+  finder->heap_count = last;
+  return last - first;
+}
+
+static void finder_reset_rank(Finder *finder) {
+  vector_clear(finder->heap);
+  vector_clear(finder->ranked);
+  finder->heap_count = 0;
+}
+
+Finder *finder_create(void) {
+  Finder *finder = (Finder *)malloc(sizeof(Finder));
+  memset(finder, 0, sizeof(Finder));
+  return finder;
+}
+
+void finder_destroy(Finder *finder) {
+  for(u32 i = 0; i < FINDER_MAX_QUERY_SIZE; ++i) {
+    vector_free(finder->levels[i]);
+  }
+  vector_free(finder->heap);
+  vector_free(finder->ranked);
+  vector_free(finder->path_bytes);
+  vector_free(finder->path_starts);
+  free(finder);
+}
+
+void finder_update(Finder *finder, FolderWalk *walk) {
+  bool removed = finder->removed_count != walk->removed_count;
+  if(removed) {
+    for(u32 i = 0; i < finder->query_size; ++i) {
+      vector_clear(finder->levels[i]);
+      finder->filtered_counts[i] = 0;
+    }
+    finder_reset_rank(finder);
+    finder->added_count = 0;
+    finder->file_count = 0;
+    finder->removed_count = walk->removed_count;
+  }
+  u32 file_count = vector_size(walk->files);
+  if(finder->file_count != file_count) {
+    finder_copy_paths(finder, walk, finder->file_count, file_count);
+    finder->file_count = file_count;
+  }
+}
+
+void finder_step(Finder *finder) {
+  if(finder->query_size == 0) {
+    return;
+  }
+  u32 budget = FINDER_STEP_SIZE;
+  bool ranked = false;
+  while(budget > 0) {
+    u32 used = finder_add_files(finder, MIN(budget, (u32)FINDER_BLOCK_SIZE));
+    for(u32 level = 1; level < finder->query_size && used < budget; ++level) {
+      used += finder_filter_level(finder, level, MIN(budget - used, (u32)FINDER_BLOCK_SIZE));
+    }
+    if(used < budget) {
+      u32 rank_used = finder_rank(finder, MIN(budget - used, (u32)FINDER_BLOCK_SIZE));
+      ranked = ranked || rank_used;
+      used += rank_used;
+    }
+    if(used == 0) {
+      break;
+    }
+    budget -= MIN(used, budget);
+  }
+  if(ranked) {
+    vector_clear(finder->ranked);
+    for(u32 i = 0; i < vector_size(finder->heap); ++i) {
+      vector_push(finder->ranked, finder->heap[i]);
+    }
+    qsort(finder->ranked, vector_size(finder->ranked), sizeof(FinderMatch), finder_match_compare);
+  }
+}
+
+bool finder_is_done(Finder *finder) {
+  if(finder->query_size == 0) {
+    return true;
+  }
+  if(finder->added_count != finder->file_count) {
+    return false;
+  }
+  for(u32 level = 1; level < finder->query_size; ++level) {
+    if(finder->filtered_counts[level] != vector_size(finder->levels[level - 1])) {
+      return false;
+    }
+  }
+  return finder->heap_count == vector_size(finder->levels[finder->query_size - 1]);
+}
+
+bool finder_push(Finder *finder, FolderWalk *walk, u8 *bytes, u32 size) {
+  if(finder->query_size + size > FINDER_MAX_QUERY_SIZE) {
+    return false;
+  }
+  finder_update(finder, walk);
+  u32 first = finder->query_size;
+  memcpy(finder->query + first, bytes, size);
+  finder->query_size += size;
+  for(u32 level = first; level < finder->query_size; ++level) {
+    vector_clear(finder->levels[level]);
+    finder->filtered_counts[level] = 0;
+  }
+  if(first == 0) {
+    finder->added_count = 0;
+  }
+  finder_reset_rank(finder);
+  finder_step(finder);
+  return true;
+}
+
+void finder_pop(Finder *finder, FolderWalk *walk) {
+  /* NOTE: The continuation bytes of the last codepoint go with it */
+  while(finder->query_size > 0) {
+    --finder->query_size;
+    vector_clear(finder->levels[finder->query_size]);
+    if((finder->query[finder->query_size] & 0xc0) != 0x80) {
+      break;
+    }
+  }
+  if(finder->query_size == 0) {
+    finder->added_count = 0;
+  }
+  finder_reset_rank(finder);
+  finder_update(finder, walk);
+  finder_step(finder);
+}
+
+u32 finder_result_count(Finder *finder, FolderWalk *walk) {
+  return finder->query_size ? vector_size(finder->ranked) : vector_size(walk->files);
+}
+
+FolderFile *finder_result(Finder *finder, FolderWalk *walk, u32 index) {
+  assert(index < finder_result_count(finder, walk));
+  return finder->query_size ? walk->files[finder->ranked[index].index] : walk->files[index];
+}
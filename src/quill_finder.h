@@ -0,0 +1,89 @@
+#ifndef _QUILL_FINDER_H_
+#define _QUILL_FINDER_H_
+
+#include "quill.h"
+
+struct FolderWalk;
+struct FolderFile;
+
+/* NOTE: Fuzzy filter for the file selector. A file matches when the query is a
+   subsequence of its path relative to the root of the walk, lower case letters of
+   the query match both cases. Every byte typed only filters the files that matched
+   the query before it, the matches of every length of the query are kept so
+   removing a byte only ranks the shorter query again */
+#define FINDER_MAX_QUERY_SIZE 64
+/* NOTE: Only the best matches are sorted and listed */
+#define FINDER_MAX_RANKED 1024
+/* NOTE: A keystroke looks at this many files or candidates, whatever is left is
+   filtered a step at a time between frames. The steps go through the levels in
+   blocks so the best matches of the whole query show up from the first step */
+#define FINDER_STEP_SIZE (16 * 1024)
+#define FINDER_BLOCK_SIZE 1024
+
+/* NOTE: Scores in the style of fzf, every matched byte scores and a byte after a
+   separator or at a camel case hump scores more, gaps between matches cost */
+#define FINDER_SCORE_MATCH 16
+#define FINDER_SCORE_GAP_START -3
+#define FINDER_SCORE_GAP_EXTENSION -1
+#define FINDER_BONUS_SLASH 9
+#define FINDER_BONUS_BOUNDARY 8
+#define FINDER_BONUS_CAMEL 7
+#define FINDER_BONUS_CONSECUTIVE 4
+#define FINDER_BONUS_FIRST_MULTIPLIER 2
+
+typedef struct FinderMatch {
+  /* NOTE: Index into the files of the walk */
+  u32 index;
+  i32 score;
+  /* NOTE: Shorter paths win when the scores are the same */
+  u32 path_size;
+  /* NOTE: End of the first match from the left, the next byte of the query is searched from here */
+  u32 end;
+} FinderMatch;
+
+typedef struct Finder {
+  u8 query[FINDER_MAX_QUERY_SIZE];
+  u32 query_size;
+  /* NOTE: Vectors with the files of the walk that match the first i + 1 bytes of
+     the query and their score for them, each level is a subset of the one before */
+  FinderMatch *levels[FINDER_MAX_QUERY_SIZE];
+  /* NOTE: How far the filtering got, the files that went into the first level and
+     the candidates of the level before that went into each of the others */
+  u32 added_count;
+  u32 filtered_counts[FINDER_MAX_QUERY_SIZE];
+  /* NOTE: The files of the walk that went through the levels, when the walk removes
+     files the indices move and everything is filtered again */
+  u32 file_count;
+  u32 removed_count;
+  /* NOTE: The relative paths of those files one after the other, so a keystroke
+     reads one block of memory instead of following a pointer for every file.
+     path_starts has one more element, the end of the last path */
+  u8 *path_bytes;
+  u32 *path_starts;
+  /* NOTE: Vector heap with the best matches of the last level so far, the worst on
+     top, and how many matches of the level went through it */
+  FinderMatch *heap;
+  u32 heap_count;
+  /* NOTE: Vector with the matches of the heap, best first */
+  FinderMatch *ranked;
+} Finder;
+
+Finder *finder_create(void);
+void finder_destroy(Finder *finder);
+
+/* NOTE: Take in the files the walk linked since the last call, they are filtered by the next steps */
+void finder_update(Finder *finder, struct FolderWalk *walk);
+/* NOTE: Add the bytes of a codepoint to the query and filter a step, returns false when it is full */
+bool finder_push(Finder *finder, struct FolderWalk *walk, u8 *bytes, u32 size);
+/* NOTE: Remove the last codepoint of the query and rank a step */
+void finder_pop(Finder *finder, struct FolderWalk *walk);
+/* NOTE: Filter and rank at most FINDER_STEP_SIZE more files or candidates */
+void finder_step(Finder *finder);
+/* NOTE: False while the results are not the ones of the whole query yet */
+bool finder_is_done(Finder *finder);
+
+/* NOTE: Without a query every file of the walk is listed in the order it was found */
+u32 finder_result_count(Finder *finder, struct FolderWalk *walk);
+struct FolderFile *finder_result(Finder *finder, struct FolderWalk *walk, u32 index);
+
+#endif /* _QUILL_FINDER_H_ */
@@ -0,0 +1,508 @@
+#include "quill_folder.h"
+#include "quill_file.h"
+#include "quill_data_structures.h"
+#include "quill_scan.h"
+#include "quill_encoding.h"
+#include "quill_index.h"
+
+Folder *folder_create(u8 *name) {
+  Folder *folder = (Folder *)malloc(sizeof(Folder));
+  memset(folder, 0, sizeof(Folder));
+  u32 name_size = strlen((char *)name);
+  assert(name_size < FOLDER_MAX_NAME_SIZE);
+  memcpy(folder->name, name, name_size);
+  return folder;
+}
+
+void folder_destroy(Folder *folder) {
+  if(!folder) {
+    return;
+  }
+  for(u32 i = 0; i < vector_size(folder->files); ++i) {
+    folder_file_destroy(folder->files[i]);
+  }
+  for(u32 i = 0; i < vector_size(folder->folders); ++i) {
+    folder_destroy(folder->folders[i]);
+  }
+  vector_free(folder->files);
+  vector_free(folder->folders);
+  free(folder);
+}
+
+void folder_add_file(Folder *folder, FolderFile *file) {
+  vector_push(folder->files, file);
+}
+
+void folder_add_folder(Folder *parent, Folder *child) {
+  vector_push(parent->folders, child);
+}
+
+FolderFile *folder_file_create(u8 *path, u64 size, u64 modified_time) {
+  FolderFile *file = (FolderFile *)malloc(sizeof(FolderFile));
+  memset(file, 0, sizeof(FolderFile));
+  u32 path_size = strlen((char *)path);
+  file->path = (u8 *)malloc(path_size + 1);
+  memcpy(file->path, path, path_size + 1);
+  file->size = size;
+  file->modified_time = modified_time;
+  return file;
+}
+
+void folder_file_destroy(FolderFile *file) {
+  if(file->file) {
+    file_destroy(file->file);
+    free(file->file);
+  }
+  free(file->path);
+  free(file);
+}
+
+FolderFileKind folder_file_classify(u8 *head, u64 head_size, u64 size) {
+  /* NOTE: UTF-16 text is full of NULs, the file loader decodes it */
+  bool bom = false;
+  Encoding encoding = encoding_detect(head, head_size, &bom);
+  if(encoding != ENCODING_UTF16_LE && encoding != ENCODING_UTF16_BE) {
+    bool has_nul = scan_find_byte(head, head + head_size, 0) != head + head_size;
+    if(has_nul || scan_count_binary_bytes(head, head_size) * FOLDER_BINARY_RATIO > head_size) {
+      return FOLDER_FILE_BINARY;
+    }
+  }
+  return size >= FILE_PIECE_TABLE_MIN_SIZE ? FOLDER_FILE_HUGE : FOLDER_FILE_TEXT;
+}
+
+File *folder_file_open(FolderFile *file) {
+  if(file->kind == FOLDER_FILE_BINARY) {
+    return 0;
+  }
+  if(!file->file) {
+    file->file = file_load_from_existing_file_paged(file->path, file->offsets.page_count ? &file->offsets : 0);
+    file->failed = !file->file;
+  }
+  return file->file;
+}
+
+bool folder_file_read(FolderFile *file, void *element) {
+  if(file->file || file->kind != FOLDER_FILE_TEXT || file->size >= FILE_PIECE_TABLE_MIN_SIZE) {
+    return false;
+  }
+  if(!file->reading) {
+    file->reading = true;
+    platform_read_file_async(file->path, element, file);
+  }
+  return true;
+}
+
+File *folder_file_read_done(PlatformFileRead *read) {
+  FolderFile *file = (FolderFile *)read->data;
+  file->reading = false;
+  file->failed = !read->success;
+  if(!file->file && read->success) {
+    if(read->bytes.size < FILE_PIECE_TABLE_MIN_SIZE) {
+      file->file = file_load_from_bytes(file->path, read->bytes, read->info);
+      read->bytes.data = 0;
+    } else {
+      /* NOTE: The file grew since the walk found it */
+      file->file = file_load_from_existing_file_paged(file->path, file->offsets.page_count ? &file->offsets : 0);
+      file->failed = !file->file;
+    }
+  }
+  return file->file;
+}
+
+static int folder_entry_compare(const void *a, const void *b) {
+  return strcmp((char *)((PlatformFolderEntry *)a)->name, (char *)((PlatformFolderEntry *)b)->name);
+}
+
+static u64 folder_hash_path(u8 *path) {
+  /* NOTE: FNV-1a */
+  u64 hash = 0xcbf29ce484222325ull;
+  for(; *path; ++path) {
+    hash = (hash ^ *path) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+/* NOTE: The table is built once before the walk starts and never changes after */
+static void folder_walk_build_cached_table(FolderWalk *walk) {
+  u32 capacity = 16;
+  while(capacity < vector_size(walk->cached) * 2) {
+    capacity *= 2;
+  }
+  walk->cached_mask = capacity - 1;
+  walk->cached_table = (u32 *)malloc(sizeof(u32) * capacity);
+  memset(walk->cached_table, 0xff, sizeof(u32) * capacity);
+  for(u32 i = 0; i < vector_size(walk->cached); ++i) {
+    u32 slot = (u32)folder_hash_path(walk->cached[i].path) & walk->cached_mask;
+    while(walk->cached_table[slot] != 0xffffffff) {
+      slot = (slot + 1) & walk->cached_mask;
+    }
+    walk->cached_table[slot] = i;
+  }
+}
+
+static FolderWalkCached *folder_walk_find_cached(FolderWalk *walk, u8 *path) {
+  if(!walk->cached_table) {
+    return 0;
+  }
+  u32 slot = (u32)folder_hash_path(path) & walk->cached_mask;
+  while(walk->cached_table[slot] != 0xffffffff) {
+    FolderWalkCached *cached = &walk->cached[walk->cached_table[slot]];
+    if(!strcmp((char *)cached->path, (char *)path)) {
+      return cached;
+    }
+    slot = (slot + 1) & walk->cached_mask;
+  }
+  return 0;
+}
+
+FolderFile *folder_walk_find_loaded(FolderWalk *walk, u8 *path) {
+  if(!walk->loaded_table) {
+    return 0;
+  }
+  u32 slot = (u32)folder_hash_path(path) & walk->loaded_mask;
+  while(walk->loaded_table[slot]) {
+    if(!strcmp((char *)walk->loaded_table[slot]->path, (char *)path)) {
+      return walk->loaded_table[slot];
+    }
+    slot = (slot + 1) & walk->loaded_mask;
+  }
+  return 0;
+}
+
+static void folder_walk_insert_loaded(FolderFile **table, u32 mask, FolderFile *file) {
+  u32 slot = (u32)folder_hash_path(file->path) & mask;
+  while(table[slot]) {
+    slot = (slot + 1) & mask;
+  }
+  table[slot] = file;
+}
+
+void folder_walk_add_loaded(FolderWalk *walk, FolderFile *file) {
+  if(folder_walk_find_loaded(walk, file->path)) {
+    return;
+  }
+  u32 capacity = walk->loaded_table ? walk->loaded_mask + 1 : 0;
+  if((walk->loaded_count + 1) * 2 > capacity) {
+    u32 new_capacity = capacity ? capacity * 2 : 16;
+    FolderFile **table = (FolderFile **)malloc(sizeof(FolderFile *) * new_capacity);
+    memset(table, 0, sizeof(FolderFile *) * new_capacity);
+    for(u32 i = 0; i < capacity; ++i) {
+      if(walk->loaded_table[i]) {
+        folder_walk_insert_loaded(table, new_capacity - 1, walk->loaded_table[i]);
+      }
+    }
+    free(walk->loaded_table);
+    walk->loaded_table = table;
+    walk->loaded_mask = new_capacity - 1;
+  }
+  folder_walk_insert_loaded(walk->loaded_table, walk->loaded_mask, file);
+  ++walk->loaded_count;
+}
+
+static void folder_walk_count(FolderWalk *walk, FolderFile *file, i32 sign) {
+  if(file->kind == FOLDER_FILE_BINARY) {
+    walk->binary_count += sign;
+    walk->binary_bytes += (i64)sign * (i64)file->size;
+  } else if(file->kind == FOLDER_FILE_HUGE) {
+    walk->huge_count += sign;
+    walk->huge_bytes += (i64)sign * (i64)file->size;
+  } else {
+    walk->text_count += sign;
+  }
+}
+
+void folder_walk_add_cached(FolderWalk *walk, Folder *parent, Folder *folder, FolderFile *file) {
+  FolderWalkCached cached;
+  memset(&cached, 0, sizeof(FolderWalkCached));
+  cached.parent = parent;
+  cached.folder = folder;
+  cached.file = file;
+  if(folder) {
+    cached.path = folder->name;
+    folder_add_folder(parent, folder);
+  } else {
+    cached.path = file->path;
+    cached.size = file->size;
+    cached.modified_time = file->modified_time;
+    folder_add_file(parent, file);
+    vector_push(walk->files, file);
+    folder_walk_count(walk, file, 1);
+  }
+  vector_push(walk->cached, cached);
+}
+
+static void folder_walk_publish(FolderWalk *walk, Folder *parent, Folder *folder, FolderFile *file, FolderFile *replace) {
+  u32 entry_count = walk->entry_count;
+  u32 block = entry_count / FOLDER_WALK_BLOCK_SIZE;
+  if(!walk->blocks[block]) {
+    walk->blocks[block] = (FolderWalkEntry *)malloc(sizeof(FolderWalkEntry) * FOLDER_WALK_BLOCK_SIZE);
+  }
+  FolderWalkEntry *entry = &walk->blocks[block][entry_count % FOLDER_WALK_BLOCK_SIZE];
+  entry->parent = parent;
+  entry->folder = folder;
+  entry->file = file;
+  entry->replace = replace;
+  __atomic_store_n(&walk->entry_count, entry_count + 1, __ATOMIC_RELEASE);
+}
+
+static i32 folder_walk_thread(void *data) {
+  FolderWalk *walk = (FolderWalk *)data;
+  u32 max_entry_count = FOLDER_WALK_BLOCK_SIZE * FOLDER_WALK_MAX_BLOCKS;
+  PlatformFolderEntry *entries = 0;
+  Folder **queue = 0;
+  vector_push(queue, walk->root);
+  u8 path[FILE_MAX_NAME_SIZE];
+  u8 *head = (u8 *)malloc(FOLDER_SNIFF_SIZE);
+  bool complete = true;
+
+  /* NOTE: The walk only reads the names of the folders it created or took from the
+     index, the main thread owns the vectors of the tree */
+  for(u32 next = 0; next < vector_size(queue); ++next) {
+    if(__atomic_load_n(&walk->cancel, __ATOMIC_RELAXED) || walk->entry_count == max_entry_count) {
+      complete = false;
+      break;
+    }
+    Folder *folder = queue[next];
+    /* NOTE: Watched before it is listed so no change falls in between */
+    platform_watch_folder(walk->watch, folder->name);
+    vector_clear(entries);
+    if(!platform_list_folder(folder->name, &entries)) {
+      continue;
+    }
+    qsort(entries, vector_size(entries), sizeof(*entries), folder_entry_compare);
+
+    for(u32 i = 0; i < vector_size(entries); ++i) {
+      PlatformFolderEntry *entry = &entries[i];
+      /* NOTE: Hidden files are skipped, the edit journals live next to the files as hidden files */
+      if(entry->name[0] == '.') {
+        continue;
+      }
+      i32 path_size = snprintf((char *)path, sizeof(path), "%s/%s", (char *)folder->name, (char *)entry->name);
+      if(path_size < 0 || path_size >= (i32)sizeof(path)) {
+        continue;
+      }
+      if(walk->entry_count == max_entry_count) {
+        complete = false;
+        break;
+      }
+      /* NOTE: What the index already has is not published again, a file that kept its
+         size and modified time is not even read */
+      FolderWalkCached *cached = folder_walk_find_cached(walk, path);
+      if(entry->is_folder) {
+        if(cached && cached->folder) {
+          cached->seen = true;
+          vector_push(queue, cached->folder);
+        } else {
+          Folder *child = folder_create(path);
+          vector_push(queue, child);
+          folder_walk_publish(walk, folder, child, 0, 0);
+        }
+      } else {
+        bool cached_file = cached && cached->file;
+        if(cached_file) {
+          cached->seen = true;
+          if(cached->size == entry->size && cached->modified_time == entry->modified_time) {
+            continue;
+          }
+          cached->replaced = true;
+        }
+        FolderFile *file = folder_file_create(path, entry->size, entry->modified_time);
+        u64 head_size = platform_read_file_head(path, head, FOLDER_SNIFF_SIZE);
+        file->kind = folder_file_classify(head, head_size, entry->size);
+        folder_walk_publish(walk, folder, 0, file, cached_file ? cached->file : 0);
+      }
+    }
+    platform_wake_up();
+  }
+
+  free(head);
+  vector_free(entries);
+  vector_free(queue);
+  walk->complete = complete;
+  __atomic_store_n(&walk->done, true, __ATOMIC_RELEASE);
+  platform_wake_up();
+  return 0;
+}
+
+FolderWalk *folder_walk_start(u8 *path, void *watch) {
+  FolderWalk *walk = (FolderWalk *)malloc(sizeof(FolderWalk));
+  memset(walk, 0, sizeof(FolderWalk));
+  walk->watch = watch;
+  walk->root = folder_create(path);
+  /* NOTE: Without an index everything the walk finds is new and the index is written on destroy */
+  if(index_load(walk)) {
+    folder_walk_build_cached_table(walk);
+  } else {
+    walk->index_dirty = true;
+  }
+  walk->thread = platform_create_thread(folder_walk_thread, walk);
+  return walk;
+}
+
+void folder_walk_destroy(FolderWalk *walk) {
+  __atomic_store_n(&walk->cancel, true, __ATOMIC_RELAXED);
+  platform_wait_thread(walk->thread);
+  /* NOTE: Everything published is linked so the tree owns it */
+  walk->reported = true;
+  folder_walk_update(walk);
+  /* NOTE: A walk that did not finish did not check every file, the index is kept as it is */
+  if(walk->complete) {
+    /* NOTE: A file paged for the first time brings new page offsets */
+    bool paged = false;
+    for(u32 i = 0; i < vector_size(walk->files) && !paged; ++i) {
+      FolderFile *file = walk->files[i];
+      paged = file->file && file->file->storage == FILE_STORAGE_PAGED && !file->offsets.page_count;
+    }
+    if(walk->index_dirty || paged) {
+      index_save(walk);
+    }
+  }
+  folder_destroy(walk->root);
+  for(u32 i = 0; i < FOLDER_WALK_MAX_BLOCKS; ++i) {
+    free(walk->blocks[i]);
+  }
+  platform_unmap_file(walk->index_mapping);
+  vector_free(walk->cached);
+  free(walk->cached_table);
+  free(walk->loaded_table);
+  vector_free(walk->files);
+  free(walk);
+}
+
+static void folder_walk_report(FolderWalk *walk) {
+  /* NOTE: Read after the last entries were linked so every file is counted */
+  if(walk->reported || !folder_walk_is_done(walk) ||
+     walk->linked_count != __atomic_load_n(&walk->entry_count, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  walk->reported = true;
+  printf("Folder %s: %u text files, %u binary files skipped (%llu bytes), %u huge files mapped on open (%llu bytes), %u files unchanged since the index\n",
+         (char *)walk->root->name, walk->text_count,
+         walk->binary_count, (unsigned long long)walk->binary_bytes,
+         walk->huge_count, (unsigned long long)walk->huge_bytes, walk->indexed_count);
+}
+
+static void folder_remove_file(Folder *folder, FolderFile *file) {
+  u32 size = vector_size(folder->files);
+  for(u32 i = 0; i < size; ++i) {
+    if(folder->files[i] == file) {
+      memmove(folder->files + i, folder->files + i + 1, sizeof(FolderFile *) * (size - i - 1));
+      vector_header(folder->files)->size--;
+      return;
+    }
+  }
+}
+
+static void folder_remove_folder(Folder *parent, Folder *child) {
+  u32 size = vector_size(parent->folders);
+  for(u32 i = 0; i < size; ++i) {
+    if(parent->folders[i] == child) {
+      memmove(parent->folders + i, parent->folders + i + 1, sizeof(Folder *) * (size - i - 1));
+      vector_header(parent->folders)->size--;
+      return;
+    }
+  }
+}
+
+/* NOTE: Once the walk is done and linked, the files from the index it did not find
+   are gone from disk. Files that are loaded or being read are kept, something points
+   to them. Returns true when the tree changed */
+static bool folder_walk_prune(FolderWalk *walk) {
+  if(walk->pruned || !folder_walk_is_done(walk) ||
+     walk->linked_count != __atomic_load_n(&walk->entry_count, __ATOMIC_ACQUIRE)) {
+    return false;
+  }
+  walk->pruned = true;
+  if(!walk->complete) {
+    return false;
+  }
+
+  u32 removed_count = 0;
+  u32 *removed = (u32 *)malloc(sizeof(u32) * MAX(vector_size(walk->cached), 1));
+  /* NOTE: Children come after their parents in the index, so backwards the folders are emptied first */
+  for(u32 i = vector_size(walk->cached); i-- > 0;) {
+    FolderWalkCached *cached = &walk->cached[i];
+    if(cached->seen) {
+      walk->indexed_count += (cached->file && !cached->replaced);
+      continue;
+    }
+    if(cached->file && !cached->file->file && !cached->file->reading) {
+      folder_remove_file(cached->parent, cached->file);
+      folder_walk_count(walk, cached->file, -1);
+      removed[removed_count++] = i;
+    } else if(cached->folder && !vector_size(cached->folder->files) && !vector_size(cached->folder->folders)) {
+      folder_remove_folder(cached->parent, cached->folder);
+      removed[removed_count++] = i;
+    }
+  }
+  if(removed_count == 0) {
+    free(removed);
+    return false;
+  }
+
+  u32 kept = 0;
+  for(u32 i = 0; i < vector_size(walk->files); ++i) {
+    FolderWalkCached *cached = folder_walk_find_cached(walk, walk->files[i]->path);
+    bool gone = cached && cached->file == walk->files[i] && !cached->seen &&
+                !cached->file->file && !cached->file->reading;
+    if(!gone) {
+      walk->files[kept++] = walk->files[i];
+    }
+  }
+  walk->removed_count += vector_size(walk->files) - kept;
+  vector_header(walk->files)->size = kept;
+  /* NOTE: The paths of the cached entries are the names of what is destroyed here */
+  for(u32 i = 0; i < removed_count; ++i) {
+    FolderWalkCached *cached = &walk->cached[removed[i]];
+    if(cached->file) {
+      folder_file_destroy(cached->file);
+    } else {
+      folder_destroy(cached->folder);
+    }
+  }
+  free(removed);
+  /* NOTE: The walk is over, nothing is looked up anymore and the removed paths are gone */
+  free(walk->cached_table);
+  walk->cached_table = 0;
+  walk->index_dirty = true;
+  return true;
+}
+
+bool folder_walk_update(FolderWalk *walk) {
+  u32 entry_count = __atomic_load_n(&walk->entry_count, __ATOMIC_ACQUIRE);
+  if(walk->linked_count == entry_count) {
+    bool pruned = folder_walk_prune(walk);
+    folder_walk_report(walk);
+    return pruned;
+  }
+  for(u32 i = walk->linked_count; i < entry_count; ++i) {
+    FolderWalkEntry *entry = &walk->blocks[i / FOLDER_WALK_BLOCK_SIZE][i % FOLDER_WALK_BLOCK_SIZE];
+    if(entry->folder) {
+      folder_add_folder(entry->parent, entry->folder);
+    } else if(entry->replace) {
+      /* NOTE: The file changed on disk, it keeps its place and takes the new metadata */
+      FolderFile *file = entry->replace;
+      folder_walk_count(walk, file, -1);
+      file->size = entry->file->size;
+      file->modified_time = entry->file->modified_time;
+      file->kind = entry->file->kind;
+      memset(&file->offsets, 0, sizeof(PagerOffsets));
+      folder_walk_count(walk, file, 1);
+      folder_file_destroy(entry->file);
+    } else {
+      FolderFile *file = entry->file;
+      folder_add_file(entry->parent, file);
+      vector_push(walk->files, file);
+      folder_walk_count(walk, file, 1);
+    }
+  }
+  walk->linked_count = entry_count;
+  walk->index_dirty = true;
+  folder_walk_prune(walk);
+  folder_walk_report(walk);
+  return true;
+}
+
+bool folder_walk_is_done(FolderWalk *walk) {
+  return __atomic_load_n(&walk->done, __ATOMIC_ACQUIRE);
+}
@@ -0,0 +1,152 @@
+#ifndef _QUILL_FOLDER_H_
+#define _QUILL_FOLDER_H_
+
+#include "quill.h"
+#include "quill_pager.h"
+
+struct File;
+
+/* NOTE: The walk reads the first bytes of every file to tell text from binary.
+   Binary files are listed but never loaded, huge files are only mapped when they
+   are opened like every file over FILE_PIECE_TABLE_MIN_SIZE */
+#define FOLDER_SNIFF_SIZE (8 * 1024)
+/* NOTE: A head with one NUL or more than 1/32 control bytes is binary */
+#define FOLDER_BINARY_RATIO 32
+
+typedef enum FolderFileKind {
+  FOLDER_FILE_TEXT,
+  FOLDER_FILE_BINARY,
+  FOLDER_FILE_HUGE,
+} FolderFileKind;
+
+/* NOTE: Files found by the folder walk, only the metadata is read and the File is
+   loaded the first time it is opened */
+typedef struct FolderFile {
+  u8 *path;
+  u64 size;
+  u64 modified_time;
+  FolderFileKind kind;
+  struct File *file;
+  bool reading;
+  /* NOTE: The last open or read failed, the selector says so */
+  bool failed;
+  /* NOTE: Page offsets of the last time the file was paged, from the project index */
+  PagerOffsets offsets;
+} FolderFile;
+
+#define FOLDER_MAX_NAME_SIZE 256
+typedef struct Folder {
+  u8 name[FOLDER_MAX_NAME_SIZE];
+  FolderFile **files;
+  struct Folder **folders;
+} Folder;
+
+Folder *folder_create(u8 *name);
+void folder_destroy(Folder *folder);
+
+void folder_add_file(Folder *folder, FolderFile *file);
+void folder_add_folder(Folder *parent, Folder *child);
+
+FolderFile *folder_file_create(u8 *path, u64 size, u64 modified_time);
+void folder_file_destroy(FolderFile *file);
+FolderFileKind folder_file_classify(u8 *head, u64 head_size, u64 size);
+/* NOTE: Load the file the first time, zero when it is binary, not there anymore or unreadable */
+struct File *folder_file_open(FolderFile *file);
+/* NOTE: Read a file that is not loaded yet off the main thread, the element gets
+   MESSAGE_FILE_READ and loads it with folder_file_read_done. Returns false when
+   the file is already loaded or too big to be read whole, folder_file_open maps it */
+bool folder_file_read(FolderFile *file, void *element);
+struct File *folder_file_read_done(PlatformFileRead *read);
+
+/* NOTE: The walk lists the folders on a background thread, breadth first, and
+   publishes what it finds into fixed blocks like the pager scan. The main thread
+   links the entries into the tree with folder_walk_update */
+#define FOLDER_WALK_BLOCK_SIZE 4096
+#define FOLDER_WALK_MAX_BLOCKS 1024
+
+typedef struct FolderWalkEntry {
+  Folder *parent;
+  /* NOTE: Only one of them is set */
+  Folder *folder;
+  FolderFile *file;
+  /* NOTE: The file from the index that changed on disk, file only brings its new metadata */
+  FolderFile *replace;
+} FolderWalkEntry;
+
+/* NOTE: A folder or a file of the tree loaded from the project index, the walk looks
+   them up by path and only publishes the ones that are new or changed */
+typedef struct FolderWalkCached {
+  u8 *path;
+  Folder *parent;
+  /* NOTE: Only one of them is set */
+  Folder *folder;
+  FolderFile *file;
+  /* NOTE: Copies for the walk thread, the main thread owns the file */
+  u64 size;
+  u64 modified_time;
+  /* NOTE: Written by the walk thread and read once the walk is done */
+  bool seen;
+  bool replaced;
+} FolderWalkCached;
+
+typedef struct FolderWalk {
+  Folder *root;
+  void *thread;
+  /* NOTE: Every folder is added to the watch before it is listed, it can be zero */
+  void *watch;
+  FolderWalkEntry *blocks[FOLDER_WALK_MAX_BLOCKS];
+  /* NOTE: Written by the walk thread and read with atomics by the main thread */
+  u32 entry_count;
+  bool done;
+  bool cancel;
+  /* NOTE: The walk listed every folder, only then the files it did not find are removed */
+  bool complete;
+
+  /* NOTE: The tree from the project index is built before the walk starts, the
+     offsets of the files point into the mapping of the index */
+  MappedFile index_mapping;
+  FolderWalkCached *cached;
+  u32 *cached_table;
+  u32 cached_mask;
+  bool pruned;
+  /* NOTE: The tree is not the one in the index anymore, it is written again on destroy */
+  bool index_dirty;
+
+  /* NOTE: Every file linked so far in the order the walk found them */
+  FolderFile **files;
+  u32 linked_count;
+  /* NOTE: Files removed from files so far, the files after them moved to lower indices */
+  u32 removed_count;
+
+  /* NOTE: What the linked files are, the bytes of binary and huge files are the
+     ones that are not read when the folder is loaded */
+  u32 text_count;
+  u32 binary_count;
+  u32 huge_count;
+  u64 binary_bytes;
+  u64 huge_bytes;
+  /* NOTE: Files taken from the index that did not change on disk */
+  u32 indexed_count;
+  bool reported;
+
+  /* NOTE: The files that were loaded by path, a change on disk is looked up here.
+     Loaded files are never removed from the walk so the table only grows */
+  FolderFile **loaded_table;
+  u32 loaded_mask;
+  u32 loaded_count;
+} FolderWalk;
+
+/* NOTE: The tree is built from the project index first when there is one */
+FolderWalk *folder_walk_start(u8 *path, void *watch);
+/* NOTE: Stop the walk and destroy the whole tree */
+void folder_walk_destroy(FolderWalk *walk);
+/* NOTE: Returns true when new entries were linked, prints what was found once the walk is done */
+bool folder_walk_update(FolderWalk *walk);
+bool folder_walk_is_done(FolderWalk *walk);
+/* NOTE: Link a folder or a file loaded from the project index, before the walk starts */
+void folder_walk_add_cached(FolderWalk *walk, Folder *parent, Folder *folder, FolderFile *file);
+/* NOTE: Add a file once it is loaded, find_loaded returns zero for the files that are not */
+void folder_walk_add_loaded(FolderWalk *walk, FolderFile *file);
+FolderFile *folder_walk_find_loaded(FolderWalk *walk, u8 *path);
+
+#endif /* _QUILL_FOLDER_H_ */
@@ -0,0 +1,205 @@
+#include "quill_index.h"
+#include "quill_folder.h"
+#include "quill_file.h"
+#include "quill_data_structures.h"
+
+#define INDEX_MAX_NAME_SIZE (FOLDER_MAX_NAME_SIZE + 32)
+
+static bool index_get_name(u8 *root, u8 *name, bool folder_only) {
+  i32 size = 0;
+  if(folder_only) {
+    size = snprintf((char *)name, INDEX_MAX_NAME_SIZE, "%s/%s", (char *)root, INDEX_FOLDER_NAME);
+  } else {
+    size = snprintf((char *)name, INDEX_MAX_NAME_SIZE, "%s/%s/%s", (char *)root, INDEX_FOLDER_NAME, INDEX_FILE_NAME);
+  }
+  return size >= 0 && size < INDEX_MAX_NAME_SIZE;
+}
+
+/* NOTE: Everything is checked before the tree is built, an index that was cut or
+   written by another version is ignored and the walk starts from nothing */
+static bool index_is_valid(u8 *root, MappedFile mapping) {
+  if(mapping.size < sizeof(IndexHeader)) {
+    return false;
+  }
+  IndexHeader *header = (IndexHeader *)mapping.data;
+  u64 available = mapping.size - sizeof(IndexHeader);
+  if(header->magic != INDEX_MAGIC || header->version != INDEX_VERSION ||
+     header->entry_count > available / sizeof(IndexEntry)) {
+    return false;
+  }
+  available -= (u64)header->entry_count * sizeof(IndexEntry);
+  if(header->offset_count > available / sizeof(u64)) {
+    return false;
+  }
+  available -= header->offset_count * sizeof(u64);
+  if(header->path_bytes_size != available) {
+    return false;
+  }
+
+  IndexEntry *entries = (IndexEntry *)(header + 1);
+  u8 *paths = (u8 *)((u64 *)(entries + header->entry_count) + header->offset_count);
+  u32 root_size = strlen((char *)root);
+  if(header->root_size != root_size || root_size > header->path_bytes_size || memcmp(paths, root, root_size)) {
+    return false;
+  }
+  for(u32 i = 0; i < header->entry_count; ++i) {
+    IndexEntry *entry = &entries[i];
+    u32 max_path_size = entry->is_folder ? FOLDER_MAX_NAME_SIZE : FILE_MAX_NAME_SIZE;
+    bool parent_valid = entry->parent == INDEX_ROOT || (entry->parent < i && entries[entry->parent].is_folder);
+    if(!parent_valid || entry->is_folder > 1 || entry->kind > FOLDER_FILE_HUGE ||
+       entry->path_size == 0 || entry->path_size >= max_path_size ||
+       (u64)entry->path_offset + entry->path_size > header->path_bytes_size ||
+       entry->offsets_start > header->offset_count ||
+       entry->page_count > header->offset_count - entry->offsets_start) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool index_load(FolderWalk *walk) {
+  u8 name[INDEX_MAX_NAME_SIZE];
+  if(!index_get_name(walk->root->name, name, false)) {
+    return false;
+  }
+  MappedFile mapping;
+  PlatformFileInfo info;
+  if(!platform_try_map_file(name, &mapping, &info)) {
+    return false;
+  }
+  if(!index_is_valid(walk->root->name, mapping)) {
+    platform_unmap_file(mapping);
+    return false;
+  }
+
+  IndexHeader *header = (IndexHeader *)mapping.data;
+  IndexEntry *entries = (IndexEntry *)(header + 1);
+  u64 *offsets = (u64 *)(entries + header->entry_count);
+  u8 *paths = (u8 *)(offsets + header->offset_count);
+  /* NOTE: The folder of every entry, so the children find their parent */
+  Folder **folders = (Folder **)malloc(sizeof(Folder *) * MAX(header->entry_count, 1));
+  u8 path[FILE_MAX_NAME_SIZE];
+  for(u32 i = 0; i < header->entry_count; ++i) {
+    IndexEntry *entry = &entries[i];
+    memcpy(path, paths + entry->path_offset, entry->path_size);
+    path[entry->path_size] = 0;
+    Folder *parent = (entry->parent == INDEX_ROOT) ? walk->root : folders[entry->parent];
+    folders[i] = 0;
+    if(entry->is_folder) {
+      folders[i] = folder_create(path);
+      folder_walk_add_cached(walk, parent, folders[i], 0);
+    } else {
+      FolderFile *file = folder_file_create(path, entry->size, entry->modified_time);
+      file->kind = (FolderFileKind)entry->kind;
+      if(entry->page_count) {
+        /* NOTE: The offsets stay in the mapping, it lives as long as the walk */
+        file->offsets.offsets = offsets + entry->offsets_start;
+        file->offsets.page_count = entry->page_count;
+        file->offsets.last_page_line_count = entry->last_page_line_count;
+        file->offsets.size = entry->offsets_size;
+        file->offsets.modified_time = entry->offsets_modified_time;
+      }
+      folder_walk_add_cached(walk, parent, 0, file);
+    }
+  }
+  free(folders);
+  walk->index_mapping = mapping;
+  return true;
+}
+
+static void index_push_path(u8 **paths, u8 *path, IndexEntry *entry) {
+  entry->path_offset = vector_size(*paths);
+  entry->path_size = strlen((char *)path);
+  for(u32 i = 0; i < entry->path_size; ++i) {
+    vector_push(*paths, path[i]);
+  }
+}
+
+void index_save(FolderWalk *walk) {
+  u8 name[INDEX_MAX_NAME_SIZE];
+  if(!index_get_name(walk->root->name, name, true) || !platform_create_folder(name) ||
+     !index_get_name(walk->root->name, name, false)) {
+    return;
+  }
+
+  IndexEntry *entries = 0;
+  u64 *offsets = 0;
+  u8 *paths = 0;
+  IndexEntry root;
+  index_push_path(&paths, walk->root->name, &root);
+
+  /* NOTE: Breadth first like the walk, so the files come back in the same order */
+  Folder **queue = 0;
+  u32 *queue_entries = 0;
+  vector_push(queue, walk->root);
+  vector_push(queue_entries, INDEX_ROOT);
+  for(u32 next = 0; next < vector_size(queue); ++next) {
+    Folder *folder = queue[next];
+    u32 parent = queue_entries[next];
+    for(u32 i = 0; i < vector_size(folder->files); ++i) {
+      FolderFile *file = folder->files[i];
+      IndexEntry entry;
+      memset(&entry, 0, sizeof(IndexEntry));
+      entry.parent = parent;
+      entry.kind = (u8)file->kind;
+      entry.size = file->size;
+      entry.modified_time = file->modified_time;
+      index_push_path(&paths, file->path, &entry);
+
+      /* NOTE: A file that is paged now has the freshest offsets */
+      PagerOffsets scanned;
+      bool has_scanned = file->file && file_get_page_offsets(file->file, &scanned);
+      PagerOffsets *page_offsets = has_scanned ? &scanned : &file->offsets;
+      entry.offsets_start = vector_size(offsets);
+      entry.page_count = page_offsets->page_count;
+      entry.last_page_line_count = page_offsets->last_page_line_count;
+      entry.offsets_size = page_offsets->size;
+      entry.offsets_modified_time = page_offsets->modified_time;
+      for(u32 j = 0; j < page_offsets->page_count; ++j) {
+        vector_push(offsets, page_offsets->offsets[j]);
+      }
+      if(has_scanned) {
+        free(scanned.offsets);
+      }
+      vector_push(entries, entry);
+    }
+    for(u32 i = 0; i < vector_size(folder->folders); ++i) {
+      Folder *child = folder->folders[i];
+      IndexEntry entry;
+      memset(&entry, 0, sizeof(IndexEntry));
+      entry.parent = parent;
+      entry.is_folder = 1;
+      index_push_path(&paths, child->name, &entry);
+      vector_push(queue, child);
+      vector_push(queue_entries, vector_size(entries));
+      vector_push(entries, entry);
+    }
+  }
+
+  IndexHeader header;
+  memset(&header, 0, sizeof(IndexHeader));
+  header.magic = INDEX_MAGIC;
+  header.version = INDEX_VERSION;
+  header.entry_count = vector_size(entries);
+  header.root_size = root.path_size;
+  header.offset_count = vector_size(offsets);
+  header.path_bytes_size = vector_size(paths);
+
+  ByteArray spans[4];
+  spans[0].data = (u8 *)&header;
+  spans[0].size = sizeof(IndexHeader);
+  spans[1].data = (u8 *)entries;
+  spans[1].size = (u64)vector_size(entries) * sizeof(IndexEntry);
+  spans[2].data = (u8 *)offsets;
+  spans[2].size = (u64)vector_size(offsets) * sizeof(u64);
+  spans[3].data = paths;
+  spans[3].size = vector_size(paths);
+  PlatformFileInfo info;
+  platform_write_file_spans(name, spans, 4, &info, false);
+
+  vector_free(queue);
+  vector_free(queue_entries);
+  vector_free(entries);
+  vector_free(offsets);
+  vector_free(paths);
+}
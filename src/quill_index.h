@@ -0,0 +1,54 @@
+#ifndef _QUILL_INDEX_H_
+#define _QUILL_INDEX_H_
+
+#include "quill.h"
+
+struct FolderWalk;
+
+/* NOTE: The project index is the tree of the last folder walk written into
+   INDEX_FOLDER_NAME under the root of the walk, with the size, modified time and
+   kind of every file and the page offsets of the files that were paged. It is
+   mapped when the walk starts so the file selector is full before any folder is
+   listed, the walk then only sniffs the files that changed */
+#define INDEX_FOLDER_NAME ".quill"
+#define INDEX_FILE_NAME "index"
+#define INDEX_MAGIC 0x58444951
+#define INDEX_VERSION 1
+#define INDEX_ROOT 0xffffffff
+
+/* NOTE: The index is the header, the entries, the page offsets and the paths one
+   after the other. Paths are not zero terminated, the root path is the first one */
+typedef struct IndexHeader {
+  u32 magic;
+  u32 version;
+  u32 entry_count;
+  u32 root_size;
+  u64 offset_count;
+  u64 path_bytes_size;
+} IndexHeader;
+
+typedef struct IndexEntry {
+  /* NOTE: Index of the entry of the parent folder, parents come before their children */
+  u32 parent;
+  u32 path_offset;
+  u32 path_size;
+  u8 is_folder;
+  u8 kind;
+  u8 unused[2];
+  u64 size;
+  u64 modified_time;
+  /* NOTE: The page offsets of a paged file, page_count is zero when there are none */
+  u64 offsets_start;
+  u32 page_count;
+  u32 last_page_line_count;
+  u64 offsets_size;
+  u64 offsets_modified_time;
+} IndexEntry;
+
+/* NOTE: Build the tree of the walk from the index under its root, returns false
+   when there is no index or it does not belong to this root */
+bool index_load(struct FolderWalk *walk);
+/* NOTE: Write the tree of the walk, the files still paged give their page offsets */
+void index_save(struct FolderWalk *walk);
+
+#endif /* _QUILL_INDEX_H_ */
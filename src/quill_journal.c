@@ -0,0 +1,373 @@
+#include "quill_journal.h"
+
+static u32 journal_op_value_count[JOURNAL_OP_COUNT] = {0, 3, 2, 2, 1, 4};
+
+static inline u64 journal_hash(u64 hash, u8 *data, u64 size) {
+  /* NOTE: FNV-1a, the spans of a save are hashed one after the other */
+  for(u64 i = 0; i < size; ++i) {
+    hash = (hash ^ data[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+JournalBase journal_base_from_spans(ByteArray *spans, u32 span_count) {
+  JournalBase base;
+  base.size = 0;
+  for(u32 i = 0; i < span_count; ++i) {
+    base.size += spans[i].size;
+  }
+
+  /* NOTE: Only the first and the last bytes are hashed, big files are never read whole */
+  u64 head_end = MIN(base.size, (u64)JOURNAL_BASE_SAMPLE_SIZE);
+  u64 tail_start = MAX(head_end, base.size - MIN(base.size, (u64)JOURNAL_BASE_SAMPLE_SIZE));
+  u64 hash = 0xcbf29ce484222325ull;
+  u64 offset = 0;
+  for(u32 i = 0; i < span_count; ++i) {
+    u64 start = offset;
+    u64 end = offset + spans[i].size;
+    if(start < head_end) {
+      hash = journal_hash(hash, spans[i].data, MIN(end, head_end) - start);
+    }
+    if(end > tail_start) {
+      u64 from = MAX(start, tail_start);
+      hash = journal_hash(hash, spans[i].data + (from - start), end - from);
+    }
+    offset = end;
+  }
+  base.hash = hash;
+  return base;
+}
+
+void journal_get_names(u8 *filename, u8 *name, u8 *previous_name) {
+  /* NOTE: The journal is a hidden file in the folder of the file */
+  char *separator = strrchr((char *)filename, '/');
+  int folder_size = separator ? (int)(separator - (char *)filename) + 1 : 0;
+  char *basename = (char *)filename + folder_size;
+  snprintf((char *)name, JOURNAL_MAX_NAME_SIZE, "%.*s.%s.quill-journal", folder_size, (char *)filename, basename);
+  snprintf((char *)previous_name, JOURNAL_MAX_NAME_SIZE, "%.*s.%s.quill-journal-previous", folder_size, (char *)filename, basename);
+}
+
+/* NOTE: Every open journal is in this list, the editor pushes to the front and only
+   the flush thread unlinks them */
+static Journal *journal_list;
+static void *journal_thread;
+static u32 journal_closing_count;
+
+static void journal_write_ring(Journal *journal, u64 head) {
+  u64 tail = journal->tail;
+  while(tail < head) {
+    u64 start = tail & (JOURNAL_RING_SIZE - 1);
+    u64 size = MIN(head - tail, JOURNAL_RING_SIZE - start);
+    if(journal->file) {
+      platform_append_file(journal->file, journal->ring + start, size);
+    }
+    tail += size;
+  }
+  __atomic_store_n(&journal->tail, tail, __ATOMIC_RELEASE);
+}
+
+static void journal_close_file(Journal *journal) {
+  if(journal->file) {
+    platform_close_append_file(journal->file);
+    journal->file = 0;
+  }
+}
+
+static void journal_begin(Journal *journal, JournalBase base) {
+  u8 header[JOURNAL_HEADER_SIZE];
+  u32 magic = JOURNAL_MAGIC;
+  u32 version = JOURNAL_VERSION;
+  memcpy(header, &magic, 4);
+  memcpy(header + 4, &version, 4);
+  memcpy(header + 8, &base.size, 8);
+  memcpy(header + 16, &base.hash, 8);
+
+  journal->file = platform_open_append_file(journal->name, true);
+  if(journal->file) {
+    platform_append_file(journal->file, header, JOURNAL_HEADER_SIZE);
+  }
+}
+
+/* NOTE: Returns true when the journal was closed */
+static bool journal_run_request(Journal *journal, JournalRequest *request) {
+  journal_write_ring(journal, request->head);
+  switch(request->type) {
+  case JOURNAL_REQUEST_ROTATE: {
+    journal_close_file(journal);
+    /* NOTE: Without records the file on disk is already what is being saved */
+    if(request->empty) {
+      platform_delete_file(journal->name);
+    } else {
+      journal->has_previous = platform_rename_file(journal->name, journal->previous_name);
+    }
+    journal_begin(journal, request->base);
+  } break;
+  case JOURNAL_REQUEST_COMMIT: {
+    if(!journal->has_previous) {
+      break;
+    }
+    if(request->saved) {
+      platform_delete_file(journal->previous_name);
+    } else {
+      journal_close_file(journal);
+      journal_fold(journal->name, journal->previous_name);
+      journal->file = platform_open_append_file(journal->name, false);
+    }
+    journal->has_previous = false;
+  } break;
+  case JOURNAL_REQUEST_CLOSE: {
+    journal_close_file(journal);
+    if(request->empty && !journal->has_previous) {
+      platform_delete_file(journal->name);
+    }
+    return true;
+  } break;
+  }
+  return false;
+}
+
+/* NOTE: Returns true when the journal was closed */
+static bool journal_flush(Journal *journal) {
+  /* NOTE: head is read before the requests, a request the thread does not see yet
+     comes after every record up to head */
+  u64 head = __atomic_load_n(&journal->head, __ATOMIC_ACQUIRE);
+  u32 requested = __atomic_load_n(&journal->requested, __ATOMIC_ACQUIRE);
+  for(u32 i = journal->done; i != requested; ++i) {
+    bool closed = journal_run_request(journal, &journal->requests[i % JOURNAL_MAX_REQUESTS]);
+    __atomic_store_n(&journal->done, i + 1, __ATOMIC_RELEASE);
+    if(closed) {
+      return true;
+    }
+  }
+  if(head == journal->tail) {
+    journal->waited = 0;
+  } else {
+    journal->waited += JOURNAL_IDLE_MS;
+    /* NOTE: Flush once the editor stops adding records or the oldest one waited long enough */
+    if(head == journal->last_head || journal->waited >= JOURNAL_FLUSH_INTERVAL_MS) {
+      journal_write_ring(journal, head);
+      journal->waited = 0;
+    }
+  }
+  journal->last_head = head;
+  return false;
+}
+
+static i32 journal_flush_thread(void *data) {
+  (void)data;
+  for(;;) {
+    platform_sleep(JOURNAL_IDLE_MS);
+    Journal *previous = 0;
+    Journal *journal = __atomic_load_n(&journal_list, __ATOMIC_ACQUIRE);
+    while(journal) {
+      Journal *next = journal->next;
+      if(!journal_flush(journal)) {
+        previous = journal;
+      } else {
+        /* NOTE: The editor only changes the front of the list, an unlink there can race with a push */
+        Journal *front = journal;
+        if(previous) {
+          previous->next = next;
+        } else if(!__atomic_compare_exchange_n(&journal_list, &front, next, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+          Journal *iterator = front;
+          while(iterator->next != journal) {
+            iterator = iterator->next;
+          }
+          iterator->next = next;
+          previous = iterator;
+        }
+        free(journal->ring);
+        free(journal);
+        __atomic_sub_fetch(&journal_closing_count, 1, __ATOMIC_RELEASE);
+      }
+      journal = next;
+    }
+  }
+  return 0;
+}
+
+static void journal_request(Journal *journal, JournalRequest request) {
+  request.head = journal->head;
+  /* NOTE: The requests only pile up when the disk stalls, then the editor waits for the thread */
+  while(journal->requested - __atomic_load_n(&journal->done, __ATOMIC_ACQUIRE) == JOURNAL_MAX_REQUESTS) {
+    platform_sleep(1);
+  }
+  journal->requests[journal->requested % JOURNAL_MAX_REQUESTS] = request;
+  __atomic_store_n(&journal->requested, journal->requested + 1, __ATOMIC_RELEASE);
+}
+
+static Journal *journal_alloc(u8 *filename) {
+  Journal *journal = (Journal *)malloc(sizeof(Journal));
+  memset(journal, 0, sizeof(Journal));
+  journal_get_names(filename, journal->name, journal->previous_name);
+  journal->ring = (u8 *)malloc(JOURNAL_RING_SIZE);
+  return journal;
+}
+
+static void journal_start(Journal *journal) {
+  journal->next = __atomic_load_n(&journal_list, __ATOMIC_ACQUIRE);
+  while(!__atomic_compare_exchange_n(&journal_list, &journal->next, journal, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {}
+  /* NOTE: The thread starts with the first journal and serves every journal after it */
+  if(!journal_thread) {
+    journal_thread = platform_create_thread(journal_flush_thread, 0);
+  }
+}
+
+Journal *journal_create(u8 *filename, JournalBase base) {
+  Journal *journal = journal_alloc(filename);
+  /* NOTE: A previous journal left here did not match the file, it is stale */
+  platform_delete_file(journal->previous_name);
+  journal_begin(journal, base);
+  journal->empty = true;
+  journal_start(journal);
+  return journal;
+}
+
+Journal *journal_open(u8 *filename) {
+  Journal *journal = journal_alloc(filename);
+  journal->file = platform_open_append_file(journal->name, false);
+  journal->empty = false;
+  journal_start(journal);
+  return journal;
+}
+
+void journal_destroy(Journal *journal) {
+  JournalRequest request;
+  memset(&request, 0, sizeof(JournalRequest));
+  request.type = JOURNAL_REQUEST_CLOSE;
+  request.empty = journal->empty;
+  __atomic_add_fetch(&journal_closing_count, 1, __ATOMIC_RELEASE);
+  journal_request(journal, request);
+}
+
+void journal_wait_closed(void) {
+  while(__atomic_load_n(&journal_closing_count, __ATOMIC_ACQUIRE)) {
+    platform_sleep(1);
+  }
+}
+
+static inline u32 journal_put_varint(u8 *des, u32 value) {
+  u32 size = 0;
+  while(value >= 0x80) {
+    des[size++] = (u8)(value | 0x80);
+    value >>= 7;
+  }
+  des[size++] = (u8)value;
+  return size;
+}
+
+void journal_record(Journal *journal, JournalOp op, u32 a, u32 b, u32 c, u32 d) {
+  assert(op > JOURNAL_OP_NONE && op < JOURNAL_OP_COUNT);
+  u8 record[JOURNAL_MAX_RECORD_SIZE];
+  u32 values[4] = {a, b, c, d};
+  u32 size = 0;
+  record[size++] = (u8)op;
+  for(u32 i = 0; i < journal_op_value_count[op]; ++i) {
+    size += journal_put_varint(record + size, values[i]);
+  }
+
+  u64 head = journal->head;
+  /* NOTE: The ring only fills up when the disk stalls, then the editor waits for the flush */
+  while(head + size - __atomic_load_n(&journal->tail, __ATOMIC_ACQUIRE) > JOURNAL_RING_SIZE) {
+    platform_sleep(1);
+  }
+  for(u32 i = 0; i < size; ++i) {
+    journal->ring[(head + i) & (JOURNAL_RING_SIZE - 1)] = record[i];
+  }
+  __atomic_store_n(&journal->head, head + size, __ATOMIC_RELEASE);
+  journal->empty = false;
+}
+
+void journal_rotate(Journal *journal, JournalBase base) {
+  assert(!journal->rotated);
+  JournalRequest request;
+  memset(&request, 0, sizeof(JournalRequest));
+  request.type = JOURNAL_REQUEST_ROTATE;
+  request.base = base;
+  request.empty = journal->empty;
+  journal_request(journal, request);
+  journal->rotated = true;
+  journal->rotated_empty = journal->empty;
+  journal->empty = true;
+}
+
+void journal_commit(Journal *journal, bool saved) {
+  if(!journal->rotated) {
+    return;
+  }
+  JournalRequest request;
+  memset(&request, 0, sizeof(JournalRequest));
+  request.type = JOURNAL_REQUEST_COMMIT;
+  request.saved = saved;
+  journal_request(journal, request);
+  /* NOTE: A failed save folds the records of the old journal back in front of the new ones */
+  if(!saved && !journal->rotated_empty) {
+    journal->empty = false;
+  }
+  journal->rotated = false;
+}
+
+void journal_fold(u8 *name, u8 *previous_name) {
+  ByteArray bytes;
+  PlatformFileInfo info;
+  if(!platform_try_read_file(name, &bytes, &info)) {
+    /* NOTE: Without a new journal there is nothing to fold, the previous one takes its
+       place. One that cannot be read is left next to it, the previous one is not lost */
+    if(!platform_file_exists(name)) {
+      platform_rename_file(previous_name, name);
+    }
+    return;
+  }
+  void *file = platform_open_append_file(previous_name, false);
+  if(file) {
+    if(bytes.size > JOURNAL_HEADER_SIZE) {
+      platform_append_file(file, bytes.data + JOURNAL_HEADER_SIZE, bytes.size - JOURNAL_HEADER_SIZE);
+    }
+    platform_close_append_file(file);
+  }
+  free(bytes.data);
+  platform_rename_file(previous_name, name);
+}
+
+bool journal_read_base(ByteArray bytes, JournalBase *base) {
+  if(bytes.size < JOURNAL_HEADER_SIZE) {
+    return false;
+  }
+  u32 magic, version;
+  memcpy(&magic, bytes.data, 4);
+  memcpy(&version, bytes.data + 4, 4);
+  memcpy(&base->size, bytes.data + 8, 8);
+  memcpy(&base->hash, bytes.data + 16, 8);
+  return magic == JOURNAL_MAGIC && version == JOURNAL_VERSION;
+}
+
+bool journal_read_record(ByteArray bytes, u64 *offset, JournalRecord *record) {
+  u64 iterator = *offset;
+  if(iterator >= bytes.size) {
+    return false;
+  }
+  u8 op = bytes.data[iterator++];
+  if(op == JOURNAL_OP_NONE || op >= JOURNAL_OP_COUNT) {
+    return false;
+  }
+  record->op = (JournalOp)op;
+  memset(record->values, 0, sizeof(record->values));
+  for(u32 i = 0; i < journal_op_value_count[op]; ++i) {
+    u32 value = 0;
+    u32 shift = 0;
+    for(;;) {
+      if(iterator >= bytes.size || shift > 28) {
+        return false;
+      }
+      u8 byte = bytes.data[iterator++];
+      value |= (u32)(byte & 0x7f) << shift;
+      shift += 7;
+      if(!(byte & 0x80)) {
+        break;
+      }
+    }
+    record->values[i] = value;
+  }
+  *offset = iterator;
+  return true;
+}
@@ -0,0 +1,121 @@
+#ifndef _QUILL_JOURNAL_H_
+#define _QUILL_JOURNAL_H_
+
+#include "quill.h"
+
+/* NOTE: Every edit of a file is appended to a journal next to it, so the changes
+   that were not saved can be replayed over the file on disk after a crash. The
+   editor only copies a few bytes into a ring, one background thread writes the
+   rings of every journal to disk when the editor is idle or when the oldest byte
+   waited long enough */
+#define JOURNAL_RING_SIZE (256 * 1024)
+#define JOURNAL_IDLE_MS 50
+#define JOURNAL_FLUSH_INTERVAL_MS 500
+/* NOTE: Saves and closes are requests the flush thread runs in order with the
+   records, the editor never waits for the disk to start or end a save */
+#define JOURNAL_MAX_REQUESTS 4
+
+/* NOTE: A journal only applies to the file it was started from, the base is the
+   size and a hash of the first and last bytes of that file */
+#define JOURNAL_BASE_SAMPLE_SIZE (64 * 1024)
+#define JOURNAL_MAGIC 0x4c4e4a51
+#define JOURNAL_VERSION 1
+#define JOURNAL_HEADER_SIZE 24
+#define JOURNAL_MAX_NAME_SIZE 320
+
+typedef enum JournalOp {
+  JOURNAL_OP_NONE,
+  JOURNAL_OP_INSERT_CODEPOINT,
+  JOURNAL_OP_REMOVE_CODEPOINT,
+  JOURNAL_OP_SPLIT_LINE,
+  JOURNAL_OP_JOIN_LINES,
+  JOURNAL_OP_REMOVE_RANGE,
+  JOURNAL_OP_COUNT,
+} JournalOp;
+
+/* NOTE: Records are the op followed by its values as varints, lines and columns
+   are the same the file editing functions take */
+#define JOURNAL_MAX_RECORD_SIZE (1 + 4 * 5)
+typedef struct JournalRecord {
+  JournalOp op;
+  u32 values[4];
+} JournalRecord;
+
+typedef struct JournalBase {
+  u64 size;
+  u64 hash;
+} JournalBase;
+
+typedef enum JournalRequestType {
+  JOURNAL_REQUEST_ROTATE,
+  JOURNAL_REQUEST_COMMIT,
+  JOURNAL_REQUEST_CLOSE,
+} JournalRequestType;
+
+typedef struct JournalRequest {
+  JournalRequestType type;
+  /* NOTE: The records before head belong to the journal file before the request */
+  u64 head;
+  JournalBase base;
+  /* NOTE: The journal had no records when a rotate or a close was requested */
+  bool empty;
+  bool saved;
+} JournalRequest;
+
+typedef struct Journal {
+  u8 name[JOURNAL_MAX_NAME_SIZE];
+  /* NOTE: While a save is written the journal of the old file is kept under this
+     name, the new journal starts from the saved file */
+  u8 previous_name[JOURNAL_MAX_NAME_SIZE];
+
+  u8 *ring;
+  /* NOTE: head is only written by the editor and tail by the flush thread */
+  u64 head;
+  u64 tail;
+  /* NOTE: No record was added since the journal started from its base */
+  bool empty;
+  /* NOTE: A save is in flight, its journal had no records when it started */
+  bool rotated;
+  bool rotated_empty;
+
+  /* NOTE: requested is written by the editor and done by the flush thread */
+  JournalRequest requests[JOURNAL_MAX_REQUESTS];
+  u32 requested;
+  u32 done;
+
+  /* NOTE: Only used by the flush thread */
+  struct Journal *next;
+  void *file;
+  bool has_previous;
+  u64 last_head;
+  u32 waited;
+} Journal;
+
+JournalBase journal_base_from_spans(ByteArray *spans, u32 span_count);
+void journal_get_names(u8 *filename, u8 *name, u8 *previous_name);
+
+/* NOTE: Start a new journal over the old one or keep appending to the one on disk */
+Journal *journal_create(u8 *filename, JournalBase base);
+Journal *journal_open(u8 *filename);
+/* NOTE: The flush thread writes what is left, closes and frees the journal. A journal
+   without records is deleted */
+void journal_destroy(Journal *journal);
+/* NOTE: Wait until every destroyed journal is closed, before the editor exits */
+void journal_wait_closed(void);
+
+void journal_record(Journal *journal, JournalOp op, u32 a, u32 b, u32 c, u32 d);
+
+/* NOTE: Called when a save starts and when it ends, a failed save folds the new
+   journal back into the previous one so the records apply to the file on disk */
+void journal_rotate(Journal *journal, JournalBase base);
+void journal_commit(Journal *journal, bool saved);
+
+/* NOTE: Replay helpers, the records are read until the end or a torn record */
+bool journal_read_base(ByteArray bytes, JournalBase *base);
+bool journal_read_record(ByteArray bytes, u64 *offset, JournalRecord *record);
+/* NOTE: Append the records of the journal at name to the one at previous_name and
+   move it back to name. A journal at name that exists but cannot be read is left
+   as it is, next to the previous one */
+void journal_fold(u8 *name, u8 *previous_name);
+
+#endif /* _QUILL_JOURNAL_H_ */
@@ -1,8 +1,228 @@
 #include "quill_line.h"
 #include "quill_data_structures.h"
+#include "quill_scan.h"
+#include "quill_utf8.h"
 
 extern Platform platform;
 
+#define LINE_ALLOCATOR_ALIGN(size) (((size) + 7) & ~7)
+
+static inline u32 line_allocator_size_class(u32 capacity) {
+  u32 size_class = 0;
+  while((u32)(LINE_ALLOCATOR_MIN_CAPACITY << size_class) < capacity) {
+    ++size_class;
+  }
+  return size_class;
+}
+
+static void *line_allocator_push(LineAllocator *allocator, u32 size) {
+  size = LINE_ALLOCATOR_ALIGN(size);
+  u32 block_header_size = LINE_ALLOCATOR_ALIGN(sizeof(LineAllocatorBlock));
+  assert(block_header_size + size <= LINE_ALLOCATOR_BLOCK_SIZE);
+  if(!allocator->block || allocator->block->used + size > LINE_ALLOCATOR_BLOCK_SIZE) {
+    LineAllocatorBlock *block = (LineAllocatorBlock *)malloc(LINE_ALLOCATOR_BLOCK_SIZE);
+    block->next = allocator->block;
+    block->used = block_header_size;
+    allocator->block = block;
+  }
+  void *result = (u8 *)allocator->block + allocator->block->used;
+  allocator->block->used += size;
+  return result;
+}
+
+static inline bool line_is_inline(Line *line) {
+  return line->buffer == (u8 *)line->storage.inline_memory + sizeof(GapBufferHeader);
+}
+
+static inline u8 *line_mapped(Line *line) {
+  return line_is_inline(line) ? 0 : line->storage.external.mapped;
+}
+
+static inline u32 *line_checkpoints(Line *line) {
+  return line_is_inline(line) ? 0 : line->storage.external.checkpoints;
+}
+
+/* NOTE: Give back the gap buffer of the line, leaving the inline buffer clears
+   the memory it shares with the external fields */
+static void line_release_buffer(Line *line) {
+  if(line_is_inline(line)) {
+    memset(&line->storage, 0, sizeof(line->storage));
+  } else if(line->buffer) {
+    line_allocator_free_buffer(line->allocator, line->buffer);
+  }
+  line->buffer = 0;
+}
+
+static void line_free_checkpoints(Line *line) {
+  u32 *checkpoints = line_checkpoints(line);
+  if(checkpoints) {
+    line_allocator_free_buffer(line->allocator, (u8 *)checkpoints);
+    line->storage.external.checkpoints = 0;
+  }
+}
+
+LineAllocator *line_allocator_create(void) {
+  LineAllocator *allocator = (LineAllocator *)malloc(sizeof(LineAllocator));
+  memset(allocator, 0, sizeof(LineAllocator));
+  dll_init(&allocator->large);
+  return allocator;
+}
+
+void line_allocator_destroy(LineAllocator *allocator) {
+  /* NOTE: Bulk release, the lines are never visited one by one */
+  LineAllocatorBlock *block = allocator->block;
+  while(block) {
+    LineAllocatorBlock *to_free = block;
+    block = block->next;
+    free(to_free);
+  }
+  LineAllocatorLarge *large = allocator->large.next;
+  while(large != &allocator->large) {
+    LineAllocatorLarge *to_free = large;
+    large = large->next;
+    free(to_free);
+  }
+  free(allocator);
+}
+
+Line *line_allocator_alloc_line(LineAllocator *allocator) {
+  Line *line = allocator->first_free_line;
+  if(line) {
+    allocator->first_free_line = line->next;
+    allocator->free_bytes -= LINE_ALLOCATOR_ALIGN(sizeof(Line));
+  } else {
+    line = (Line *)line_allocator_push(allocator, sizeof(Line));
+  }
+  memset(line, 0, sizeof(Line));
+  line->allocator = allocator;
+  return line;
+}
+
+void line_allocator_free_line(LineAllocator *allocator, Line *line) {
+  assert(line->allocator == allocator);
+  line_free_checkpoints(line);
+  line_release_buffer(line);
+  line->next = allocator->first_free_line;
+  allocator->first_free_line = line;
+  allocator->free_bytes += LINE_ALLOCATOR_ALIGN(sizeof(Line));
+}
+
+u8 *line_allocator_alloc_buffer(LineAllocator *allocator, u32 capacity) {
+  if(!allocator) {
+    return gapbuffer_init(malloc(sizeof(GapBufferHeader) + capacity), capacity);
+  }
+
+  u32 size_class = line_allocator_size_class(capacity);
+  if(size_class < LINE_ALLOCATOR_SIZE_CLASS_COUNT) {
+    capacity = LINE_ALLOCATOR_MIN_CAPACITY << size_class;
+    void *memory = allocator->first_free_buffer[size_class];
+    if(memory) {
+      allocator->first_free_buffer[size_class] = *(void **)memory;
+      allocator->free_bytes -= LINE_ALLOCATOR_ALIGN(sizeof(GapBufferHeader) + capacity);
+    } else {
+      memory = line_allocator_push(allocator, sizeof(GapBufferHeader) + capacity);
+    }
+    return gapbuffer_init(memory, capacity);
+  }
+
+  LineAllocatorLarge *large = (LineAllocatorLarge *)malloc(sizeof(LineAllocatorLarge) + sizeof(GapBufferHeader) + capacity);
+  dll_insert_front(large, &allocator->large);
+  return gapbuffer_init(large + 1, capacity);
+}
+
+void line_allocator_free_buffer(LineAllocator *allocator, u8 *buffer) {
+  GapBufferHeader *header = gapbuffer_header(buffer);
+  if(!allocator) {
+    free(header);
+    return;
+  }
+
+  u32 size_class = line_allocator_size_class(header->capacity);
+  if(size_class < LINE_ALLOCATOR_SIZE_CLASS_COUNT) {
+    void *memory = (void *)header;
+    *(void **)memory = allocator->first_free_buffer[size_class];
+    allocator->first_free_buffer[size_class] = memory;
+    allocator->free_bytes += LINE_ALLOCATOR_ALIGN(sizeof(GapBufferHeader) + header->capacity);
+  } else {
+    LineAllocatorLarge *large = (LineAllocatorLarge *)header - 1;
+    large->prev->next = large->next;
+    large->next->prev = large->prev;
+    free(large);
+  }
+}
+
+/* NOTE: Make room for count more bytes, line buffers never grow with realloc
+   because they can live inside of the allocator blocks */
+static void line_reserve(Line *line, u32 count) {
+  u32 capacity = gapbuffer_capacity(line->buffer);
+  u32 size = gapbuffer_size(line->buffer);
+  if(capacity - size > count) {
+    return;
+  }
+  if(!line->buffer && count < LINE_INLINE_CAPACITY) {
+    /* NOTE: Short lines start with the inline buffer and allocate nothing */
+    assert(!line_mapped(line));
+    line_free_checkpoints(line);
+    line->buffer = gapbuffer_init(line->storage.inline_memory, LINE_INLINE_CAPACITY);
+    return;
+  }
+  u32 new_capacity = capacity ? capacity : GAPBUFFER_DEFAULT_CAPACITY;
+  while(new_capacity - size <= count) {
+    new_capacity *= 2;
+  }
+  u8 *buffer = line_allocator_alloc_buffer(line->allocator, new_capacity);
+  if(line->buffer) {
+    gapbuffer_copy(buffer, line->buffer, sizeof(*line->buffer));
+    line_release_buffer(line);
+  }
+  line->buffer = buffer;
+}
+
+static inline u32 line_checkpoint_capacity(Line *line) {
+  u32 *checkpoints = line_checkpoints(line);
+  return checkpoints ? gapbuffer_capacity((u8 *)checkpoints) / sizeof(u32) : 0;
+}
+
+static inline u32 line_checkpoint_count(Line *line) {
+  return (line->codepoint_count > 0) ? (line->codepoint_count - 1) / LINE_CHECKPOINT_STRIDE : 0;
+}
+
+/* NOTE: The checkpoints live in a buffer of the line allocator, so they are
+   released together with the rest of the lines of the file */
+static void line_reserve_checkpoints(Line *line, u32 count) {
+  if(line_checkpoint_capacity(line) < count) {
+    assert(!line_is_inline(line));
+    line_free_checkpoints(line);
+    line->storage.external.checkpoints = (u32 *)line_allocator_alloc_buffer(line->allocator, count * sizeof(u32));
+  }
+}
+
+/* NOTE: Same policy as gapbuffer_shrink, but the line moves to a smaller buffer
+   of its allocator or back to the inline buffer, empty lines give their buffer back */
+static void line_shrink(Line *line) {
+  u32 capacity = gapbuffer_capacity(line->buffer);
+  u32 size = gapbuffer_size(line->buffer);
+  if(capacity == 0 || line_is_inline(line)) {
+    return;
+  }
+  if(size == 0) {
+    line_release_buffer(line);
+    return;
+  }
+  u32 new_capacity = gapbuffer_shrink_capacity(capacity, size, LINE_ALLOCATOR_MIN_CAPACITY);
+  if(new_capacity != capacity) {
+    u8 *old_buffer = line->buffer;
+    if(new_capacity <= LINE_INLINE_CAPACITY) {
+      line_free_checkpoints(line);
+      line->buffer = gapbuffer_init(line->storage.inline_memory, LINE_INLINE_CAPACITY);
+    } else {
+      line->buffer = line_allocator_alloc_buffer(line->allocator, new_capacity);
+    }
+    gapbuffer_copy(line->buffer, old_buffer, sizeof(*line->buffer));
+    line_allocator_free_buffer(line->allocator, old_buffer);
+  }
+}
+
 Line *line_create(void) {
   Line *line = (Line *)malloc(sizeof(Line));
   memset(line, 0, sizeof(Line));
@@ -11,11 +231,288 @@ Line *line_create(void) {
 }
 
 void line_destroy(Line *line) {
-  gapbuffer_free(line->buffer);
+  if(line->allocator) {
+    line_allocator_free_line(line->allocator, line);
+    return;
+  }
+  line_free_checkpoints(line);
+  line_release_buffer(line);
   free(line);
 }
 
+Line *line_repack(LineAllocator *allocator, Line *line) {
+  /* NOTE: Copy the line into allocator with its buffer at the exact size, the
+     source line is not modified so its allocator can be released in bulk later */
+  Line *result = line_allocator_alloc_line(allocator);
+  result->codepoint_count = line->codepoint_count;
+  result->multibyte = line->multibyte;
+  /* NOTE: The checkpoints are not copied, multibyte lines rebuild them when needed */
+  result->dirty = line->dirty || line->multibyte;
+  if(!line_is_inline(line)) {
+    result->storage.external.mapped = line->storage.external.mapped;
+    result->storage.external.mapped_size = line->storage.external.mapped_size;
+    result->storage.external.shares = line->storage.external.shares;
+  }
+  u32 size = gapbuffer_size(line->buffer);
+  if(size > 0) {
+    if(size < LINE_INLINE_CAPACITY) {
+      result->buffer = gapbuffer_init(result->storage.inline_memory, LINE_INLINE_CAPACITY);
+    } else {
+      result->buffer = line_allocator_alloc_buffer(allocator, size + 1);
+    }
+    gapbuffer_copy(result->buffer, line->buffer, sizeof(*line->buffer));
+  }
+  return result;
+}
+
+void line_share(Line *line) {
+  assert(!line_is_inline(line) && gapbuffer_size(line->buffer) == 0);
+  ++line->storage.external.shares;
+}
+
+bool line_is_shared(Line *line) {
+  return !line_is_inline(line) && line->storage.external.shares > 0;
+}
+
+void line_drop_share(Line *line) {
+  assert(line_is_shared(line));
+  --line->storage.external.shares;
+}
+
+Line *line_unshare(Line *line) {
+  /* NOTE: Shared lines are never modified, so the copy is only a new header
+     that references the same bytes */
+  line_drop_share(line);
+  Line *result = line_repack(line->allocator, line);
+  result->storage.external.shares = 0;
+  return result;
+}
+
+u32 line_byte_size(Line *line) {
+  if(line_mapped(line)) {
+    return line->storage.external.mapped_size;
+  }
+  return gapbuffer_size(line->buffer);
+}
+
+void line_get_segments(Line *line, ByteArray *first, ByteArray *second) {
+  u8 *mapped = line_mapped(line);
+  if(mapped) {
+    first->data = mapped;
+    first->size = line->storage.external.mapped_size;
+    second->data = 0;
+    second->size = 0;
+    return;
+  }
+  first->data = line->buffer;
+  first->size = 0;
+  second->data = 0;
+  second->size = 0;
+  if(line->buffer) {
+    GapBufferHeader *header = gapbuffer_header(line->buffer);
+    first->size = header->f_index;
+    second->data = line->buffer + header->s_index;
+    second->size = header->capacity - header->s_index;
+  }
+}
+
+static inline u8 line_byte_at(Line *line, u32 index) {
+  u8 *mapped = line_mapped(line);
+  if(mapped) {
+    return mapped[index];
+  }
+  /* TODO: Make this iterator a macro to use in all gap buffers */
+  if(index < gapbuffer_f_index(line->buffer)) {
+    return line->buffer[index];
+  } else {
+    u32 offset = index - gapbuffer_f_index(line->buffer);
+    return line->buffer[gapbuffer_s_index(line->buffer) + offset];
+  }
+}
+
+/* NOTE: Return the size in bytes of the codepoint that starts at index */
+static u32 line_decode_at(Line *line, u32 index, u32 *codepoint) {
+  u8 bytes[UTF8_MAX_SIZE];
+  bytes[0] = line_byte_at(line, index);
+  u32 size = MIN(utf8_sequence_size(bytes[0]), line_byte_size(line) - index);
+  for(u32 i = 1; i < size; ++i) {
+    bytes[i] = line_byte_at(line, index + i);
+  }
+  return utf8_decode(bytes, size, codepoint);
+}
+
+static bool line_is_ascii(Line *line) {
+  u8 *mapped = line_mapped(line);
+  if(mapped) {
+    return scan_is_ascii(mapped, line->storage.external.mapped_size);
+  }
+  if(!line->buffer) {
+    return true;
+  }
+  u32 f_index = gapbuffer_f_index(line->buffer);
+  u32 s_index = gapbuffer_s_index(line->buffer);
+  return scan_is_ascii(line->buffer, f_index) &&
+    scan_is_ascii(line->buffer + s_index, gapbuffer_capacity(line->buffer) - s_index);
+}
+
+static void line_update_index(Line *line) {
+  if(!line->dirty) {
+    return;
+  }
+  line->dirty = false;
+  line->last_col = 0;
+  line->last_byte = 0;
+
+  u32 byte_size = line_byte_size(line);
+  line->multibyte = !line_is_ascii(line);
+  if(!line->multibyte) {
+    line->codepoint_count = byte_size;
+    return;
+  }
+
+  /* NOTE: A line never has more codepoints than bytes, so this is enough room */
+  line_reserve_checkpoints(line, byte_size / LINE_CHECKPOINT_STRIDE);
+  u32 count = 0;
+  u32 index = 0;
+  while(index < byte_size) {
+    if(count > 0 && (count % LINE_CHECKPOINT_STRIDE) == 0) {
+      line->storage.external.checkpoints[count / LINE_CHECKPOINT_STRIDE - 1] = index;
+    }
+    u32 codepoint;
+    index += line_decode_at(line, index, &codepoint);
+    ++count;
+  }
+  line->codepoint_count = count;
+}
+
+/* NOTE: Ascii bytes added to an ascii line keep the fast path, anything else
+   makes the line rebuild its index the next time a column is needed */
+static inline void line_bytes_added(Line *line, u32 count, bool ascii) {
+  if(!line->dirty && !line->multibyte && ascii) {
+    line->codepoint_count += count;
+  } else {
+    line->dirty = true;
+  }
+}
+
+static inline void line_bytes_removed(Line *line, u32 count) {
+  if(!line->dirty && !line->multibyte) {
+    line->codepoint_count -= count;
+  } else {
+    line->dirty = true;
+  }
+}
+
+u32 line_col_to_byte(Line *line, u32 col) {
+  line_update_index(line);
+  assert(col <= line->codepoint_count);
+  if(!line->multibyte) {
+    return col;
+  }
+
+  /* NOTE: The end of a line with a multiple of the stride columns has no checkpoint */
+  u32 checkpoint = MIN(col / LINE_CHECKPOINT_STRIDE, line_checkpoint_count(line));
+  u32 current_col = checkpoint * LINE_CHECKPOINT_STRIDE;
+  u32 byte = (checkpoint > 0) ? line->storage.external.checkpoints[checkpoint - 1] : 0;
+  /* NOTE: Sequential access continues from the last column instead of the checkpoint */
+  if(line->last_col <= col && line->last_col >= current_col) {
+    current_col = line->last_col;
+    byte = line->last_byte;
+  }
+  while(current_col < col) {
+    u32 codepoint;
+    byte += line_decode_at(line, byte, &codepoint);
+    ++current_col;
+  }
+  line->last_col = col;
+  line->last_byte = byte;
+  return byte;
+}
+
+u32 line_byte_to_col(Line *line, u32 byte) {
+  line_update_index(line);
+  assert(byte <= line_byte_size(line));
+  if(!line->multibyte) {
+    return byte;
+  }
+
+  /* NOTE: Find the last checkpoint at or before the byte */
+  u32 low = 0;
+  u32 high = line_checkpoint_count(line);
+  while(low < high) {
+    u32 middle = low + (high - low + 1) / 2;
+    if(line->storage.external.checkpoints[middle - 1] <= byte) {
+      low = middle;
+    } else {
+      high = middle - 1;
+    }
+  }
+  u32 col = low * LINE_CHECKPOINT_STRIDE;
+  u32 current_byte = (low > 0) ? line->storage.external.checkpoints[low - 1] : 0;
+  u32 byte_size = line_byte_size(line);
+  while(current_byte < byte) {
+    u32 codepoint;
+    u32 size = line_decode_at(line, current_byte, &codepoint);
+    if(current_byte + size > byte) {
+      break;
+    }
+    current_byte += size;
+    ++col;
+  }
+  assert(current_byte <= byte_size);
+  return col;
+}
+
+static void line_materialize(Line *line) {
+  u8 *data = line_mapped(line);
+  if(data) {
+    u32 size = line->storage.external.mapped_size;
+    line->storage.external.mapped = 0;
+    line->storage.external.mapped_size = 0;
+    /* NOTE: Short lines are copied inline, the others get one allocation at the
+       exact size of the line, both with one memcpy */
+    if(gapbuffer_capacity(line->buffer) <= size) {
+      line_release_buffer(line);
+      if(size < LINE_INLINE_CAPACITY) {
+        line_free_checkpoints(line);
+        line->buffer = gapbuffer_init(line->storage.inline_memory, LINE_INLINE_CAPACITY);
+      } else {
+        line->buffer = line_allocator_alloc_buffer(line->allocator, size + 1);
+      }
+    }
+    memcpy(line->buffer, data, size);
+    gapbuffer_header(line->buffer)->f_index = size;
+    gapbuffer_header(line->buffer)->s_index = gapbuffer_header(line->buffer)->capacity;
+  }
+}
+
+void line_set_mapped(Line *line, u8 *data, u32 size) {
+  assert(gapbuffer_size(line->buffer) == 0);
+  if(line_is_inline(line)) {
+    line_release_buffer(line);
+  }
+  size = (data != 0) ? size : 0;
+  line->storage.external.mapped = (size > 0) ? data : 0;
+  line->storage.external.mapped_size = size;
+  /* NOTE: Ascii lines get their column count here, the others are counted the
+     first time they are used */
+  line->multibyte = !scan_is_ascii(data, size);
+  line->dirty = line->multibyte;
+  line->codepoint_count = line->multibyte ? 0 : size;
+}
+
+bool line_is_mapped(Line *line) {
+  return line_mapped(line) != 0;
+}
+
 void line_reset(Line *line) {
+  if(!line_is_inline(line)) {
+    line->storage.external.mapped = 0;
+    line->storage.external.mapped_size = 0;
+  }
+  line->codepoint_count = 0;
+  line->multibyte = false;
+  line->dirty = false;
   if(gapbuffer_capacity(line->buffer) > 0) {
     GapBufferHeader *header = gapbuffer_header(line->buffer);
     header->f_index = 0;
@@ -23,71 +520,163 @@ void line_reset(Line *line) {
   }
 }
 
-void line_insert(Line *line, u8 codepoint) {
+void line_insert_bytes(Line *line, u32 index, u8 *bytes, u32 count) {
+  assert(line);
+  if(count > 0) {
+    line_materialize(line);
+    gapbuffer_move_to(line->buffer, index);
+    line_reserve(line, count);
+    gapbuffer_insert_span(line->buffer, bytes, count);
+    line_bytes_added(line, count, scan_is_ascii(bytes, count));
+  }
+}
+
+static void line_remove_bytes(Line *line, u32 start, u32 end) {
+  assert(start <= end && end <= line_byte_size(line));
+  if(end == start) {
+    return;
+  }
+  line_bytes_removed(line, end - start);
+  if(line_mapped(line)) {
+    /* NOTE: Cutting the front or the back of a mapped line only shrinks the view */
+    LineExternal *external = &line->storage.external;
+    if(start == 0 || end == external->mapped_size) {
+      external->mapped += (start == 0) ? end : 0;
+      external->mapped_size -= end - start;
+      if(external->mapped_size == 0) {
+        external->mapped = 0;
+      }
+      return;
+    }
+    line_materialize(line);
+  }
+  gapbuffer_move_to(line->buffer, end);
+  gapbuffer_remove_span(line->buffer, end - start);
+  line_shrink(line);
+}
+
+static void line_copy_bytes(Line *des, u32 des_index, Line *src, u32 src_index, u32 count) {
+  assert(des && src && des != src);
+  assert(src_index + count <= line_byte_size(src));
+  if(count == 0) {
+    return;
+  }
+
+  line_materialize(des);
+  gapbuffer_move_to(des->buffer, des_index);
+  line_reserve(des, count);
+  line_update_index(src);
+  line_bytes_added(des, count, !src->multibyte);
+
+  u8 *src_mapped = line_mapped(src);
+  if(src_mapped) {
+    gapbuffer_insert_span(des->buffer, src_mapped + src_index, count);
+    return;
+  }
+
+  /* NOTE: The source span is at most two contiguous segments, one on each side of the gap */
+  u32 src_f_index = gapbuffer_f_index(src->buffer);
+  if(src_index < src_f_index) {
+    u32 first_count = MIN(count, src_f_index - src_index);
+    gapbuffer_insert_span(des->buffer, src->buffer + src_index, first_count);
+    src_index += first_count;
+    count -= first_count;
+  }
+  if(count > 0) {
+    u32 offset = gapbuffer_s_index(src->buffer) + (src_index - src_f_index);
+    gapbuffer_insert_span(des->buffer, src->buffer + offset, count);
+  }
+}
+
+void line_insert(Line *line, u32 codepoint) {
   assert(line);
-  gapbuffer_insert(line->buffer, codepoint);
+  line_materialize(line);
+  u8 bytes[UTF8_MAX_SIZE];
+  u32 size = utf8_encode(codepoint, bytes);
+  line_insert_bytes(line, gapbuffer_f_index(line->buffer), bytes, size);
 }
 
-void line_insert_at_index(Line *line, u32 index, u8 codepoint) {
+void line_insert_at_index(Line *line, u32 index, u32 codepoint) {
   assert(line);
-  gapbuffer_move_to(line->buffer, index);
-  gapbuffer_insert(line->buffer, codepoint);
+  u8 bytes[UTF8_MAX_SIZE];
+  u32 size = utf8_encode(codepoint, bytes);
+  line_insert_bytes(line, line_col_to_byte(line, index), bytes, size);
 }
 
 void line_remove(Line *line) {
   assert(line);
-  gapbuffer_remove(line->buffer);
+  line_materialize(line);
+  u32 col = line_byte_to_col(line, gapbuffer_f_index(line->buffer));
+  assert(col > 0);
+  line_remove_range(line, col - 1, col);
 }
 
 void line_remove_at_index(Line *line, u32 index) {
   assert(line);
-  gapbuffer_move_to(line->buffer, index);
-  gapbuffer_remove(line->buffer);
+  assert(index > 0);
+  line_remove_range(line, index - 1, index);
 }
 
 void line_remove_from_front_up_to(Line *line, u32 index) {
-  assert(index <= gapbuffer_size(line->buffer));
-  if(line->buffer) {
-    gapbuffer_move_to(line->buffer, index);
-    gapbuffer_header(line->buffer)->f_index = 0;
-  }
+  assert(index <= line_size(line));
+  line_remove_range(line, 0, index);
 }
 
 void line_copy(Line *des, Line *src, u32 count) {
   assert(count <= line_size(src));
-  for(u32 i = 0; i < count; ++i) {
-    u8 codepoint = line_get_codepoint_at(src, i);
-    line_insert(des, codepoint);
-  }
+  line_materialize(des);
+  line_copy_bytes(des, gapbuffer_f_index(des->buffer), src, 0, line_col_to_byte(src, count));
 }
 
 void line_copy_at(Line *des, Line *src, u32 count, u32 index) {
   assert(des);
   if(src) {
-    gapbuffer_move_to(des->buffer, index);
-    line_copy(des, src, count);
+    line_copy_span(des, index, src, 0, count);
   }
 }
 
-u8 line_get_codepoint_at(Line *line, u32 index) {
-  /* TODO: Make this iterator a macro to use in all gap buffers */
-  assert(index < gapbuffer_size(line->buffer));
-  if(index < gapbuffer_f_index(line->buffer)) {
-    return line->buffer[index];
-  } else {
-    u32 offset = index - gapbuffer_f_index(line->buffer);
-    return line->buffer[gapbuffer_s_index(line->buffer) + offset];
+void line_remove_range(Line *line, u32 start, u32 end) {
+  assert(line);
+  assert(start <= end && end <= line_size(line));
+  if(end > start) {
+    u32 start_byte = line_col_to_byte(line, start);
+    u32 end_byte = line_col_to_byte(line, end);
+    line_remove_bytes(line, start_byte, end_byte);
   }
 }
 
+void line_copy_span(Line *des, u32 des_index, Line *src, u32 src_index, u32 count) {
+  assert(des && src && des != src);
+  assert(src_index + count <= line_size(src));
+  if(count == 0) {
+    return;
+  }
+  u32 src_byte = line_col_to_byte(src, src_index);
+  u32 src_byte_count = line_col_to_byte(src, src_index + count) - src_byte;
+  line_copy_bytes(des, line_col_to_byte(des, des_index), src, src_byte, src_byte_count);
+}
+
+u32 line_get_codepoint_at(Line *line, u32 index) {
+  line_update_index(line);
+  assert(index < line->codepoint_count);
+  if(!line->multibyte) {
+    return line_byte_at(line, index);
+  }
+  u32 codepoint;
+  line_decode_at(line, line_col_to_byte(line, index), &codepoint);
+  return codepoint;
+}
+
 u32 line_size(Line *line) {
-  return gapbuffer_size(line->buffer);
+  line_update_index(line);
+  return line->codepoint_count;
 }
 
 void line_print(Line *line) {
   for(u32 i = 0; i < line_size(line); ++i) {
-     u8 codepoint = line_get_codepoint_at(line, i);
-     printf("%c", codepoint);
+    u8 bytes[UTF8_MAX_SIZE];
+    u32 size = utf8_encode(line_get_codepoint_at(line, i), bytes);
+    printf("%.*s", (i32)size, (char *)bytes);
   }
   printf("\n");
 }
@@ -3,25 +3,119 @@
 
 #include "quill.h"
 #include "quill_element.h"
+#include "quill_data_structures.h"
 
-/* TODO: Handle unicode characters */
+#define LINE_CHECKPOINT_STRIDE 64
+
+typedef struct LineExternal {
+  /* NOTE: Untouched lines reference the bytes of the mapped file, the line is
+     copied into its own gap buffer the first time it is modified */
+  u8 *mapped;
+  /* NOTE: checkpoints[i] is the byte offset of the codepoint (i + 1) * LINE_CHECKPOINT_STRIDE */
+  u32 *checkpoints;
+  u32 mapped_size;
+  /* NOTE: Interned lines are referenced by (shares + 1) slots of their file */
+  u32 shares;
+} LineExternal;
+
+/* NOTE: Lines with less bytes than this keep their gap buffer inside of the Line.
+   The buffer takes the memory of LineExternal and no more, so the mapped lines
+   that are most of a big file do not pay for it. It has to be smaller than
+   LINE_CHECKPOINT_STRIDE so inline lines never need checkpoints */
+#define LINE_INLINE_MEMORY_SIZE sizeof(LineExternal)
+#define LINE_INLINE_CAPACITY (u32)(LINE_INLINE_MEMORY_SIZE - sizeof(GapBufferHeader))
+
+/* NOTE: Lines store utf8 and their columns are codepoints. Ascii lines map a
+   column to its byte directly, the other lines keep the byte offset of every
+   LINE_CHECKPOINT_STRIDE codepoints and rebuild it lazily after an edit */
 typedef struct Line {
+  /* NOTE: Points into storage.inline_memory for short lines, the line_* functions
+     hide which one is used */
   u8 *buffer;
   struct Line *next;
+  /* NOTE: Lines without allocator use the heap */
+  struct LineAllocator *allocator;
+
+  u32 codepoint_count;
+  /* NOTE: Last column translated to bytes, walking a line does not go back to the checkpoint */
+  u32 last_col;
+  u32 last_byte;
+  bool multibyte;
+  bool dirty;
+
+  /* NOTE: Inline lines are never mapped and never have checkpoints, so they share the memory */
+  union {
+    LineExternal external;
+    u32 inline_memory[LINE_INLINE_MEMORY_SIZE / sizeof(u32)];
+  } storage;
 } Line;
 
+/* NOTE: Line headers and small line buffers are packed into big blocks, small
+   buffers are recycled with one free list per size class and bigger buffers
+   are kept in a list so the whole allocator can be released at once */
+#define LINE_ALLOCATOR_BLOCK_SIZE (64 * 1024)
+#define LINE_ALLOCATOR_MIN_CAPACITY 8
+#define LINE_ALLOCATOR_SIZE_CLASS_COUNT 6
+
+typedef struct LineAllocatorBlock {
+  struct LineAllocatorBlock *next;
+  u32 used;
+} LineAllocatorBlock;
+
+typedef struct LineAllocatorLarge {
+  struct LineAllocatorLarge *next;
+  struct LineAllocatorLarge *prev;
+} LineAllocatorLarge;
+
+typedef struct LineAllocator {
+  LineAllocatorBlock *block;
+  LineAllocatorLarge large;
+  Line *first_free_line;
+  void *first_free_buffer[LINE_ALLOCATOR_SIZE_CLASS_COUNT];
+  /* NOTE: Bytes sitting in the free lists, the blocks only go back to the system
+     when the allocator is destroyed, so a file repacks its lines when this grows */
+  u64 free_bytes;
+} LineAllocator;
+
+LineAllocator *line_allocator_create(void);
+void line_allocator_destroy(LineAllocator *allocator);
+Line *line_allocator_alloc_line(LineAllocator *allocator);
+void line_allocator_free_line(LineAllocator *allocator, Line *line);
+u8 *line_allocator_alloc_buffer(LineAllocator *allocator, u32 capacity);
+void line_allocator_free_buffer(LineAllocator *allocator, u8 *buffer);
+Line *line_repack(LineAllocator *allocator, Line *line);
+
+/* NOTE: Identical untouched lines can be shared by many slots of a file, a shared
+   line is read only and the file writes to a private copy from line_unshare */
+void line_share(Line *line);
+bool line_is_shared(Line *line);
+void line_drop_share(Line *line);
+Line *line_unshare(Line *line);
+
 Line *line_create(void);
 void line_destroy(Line *line);
 void line_reset(Line *line);
-void line_insert(Line *line, u8 codepoint);
-void line_insert_at_index(Line *line, u32 index, u8 codepoint);
+void line_set_mapped(Line *line, u8 *data, u32 size);
+bool line_is_mapped(Line *line);
+void line_insert(Line *line, u32 codepoint);
+void line_insert_at_index(Line *line, u32 index, u32 codepoint);
 void line_remove(Line *line);
 void line_remove_at_index(Line *line, u32 index);
 void line_remove_from_front_up_to(Line *line, u32 index);
 void line_copy(Line *des, Line *src, u32 count);
 void line_copy_at(Line *des, Line *src, u32 count, u32 index);
-u8 line_get_codepoint_at(Line *line, u32 index);
+/* NOTE: Index is a byte offset and it has to be at a codepoint boundary */
+void line_insert_bytes(Line *line, u32 index, u8 *bytes, u32 count);
+void line_remove_range(Line *line, u32 start, u32 end);
+void line_copy_span(Line *des, u32 des_index, Line *src, u32 src_index, u32 count);
+u32 line_get_codepoint_at(Line *line, u32 index);
 u32 line_size(Line *line);
+u32 line_byte_size(Line *line);
+u32 line_col_to_byte(Line *line, u32 col);
+u32 line_byte_to_col(Line *line, u32 byte);
+/* NOTE: The bytes of the line are first followed by second, they point straight
+   into the mapping or the gap buffer and are only valid until the line changes */
+void line_get_segments(Line *line, ByteArray *first, ByteArray *second);
 
 void line_print(Line *line);
 
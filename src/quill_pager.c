@@ -0,0 +1,545 @@
+#include "quill_pager.h"
+#include "quill_line.h"
+#include "quill_data_structures.h"
+#include "quill_scan.h"
+
+/* NOTE: Return the start of the page that follows the one at iterator, last is set
+   when the page ends at the end of the file */
+static u8 *pager_scan_page(u8 *iterator, u8 *end, u32 *line_count, bool *last) {
+  u32 count = 0;
+  for(;;) {
+    u8 *line_end = scan_find_byte(iterator, end, '\n');
+    ++count;
+    if(line_end == end) {
+      *line_count = count;
+      *last = true;
+      return end;
+    }
+    iterator = line_end + 1;
+    if(count == PAGER_PAGE_LINE_COUNT) {
+      *line_count = count;
+      *last = false;
+      return iterator;
+    }
+  }
+}
+
+static void pager_scan_publish(PagerScan *scan, u64 offset) {
+  u32 page_count = scan->page_count;
+  u32 block = page_count / PAGER_INDEX_BLOCK_SIZE;
+  if(!scan->blocks[block]) {
+    scan->blocks[block] = (u64 *)malloc(sizeof(u64) * PAGER_INDEX_BLOCK_SIZE);
+  }
+  scan->blocks[block][page_count % PAGER_INDEX_BLOCK_SIZE] = offset;
+  __atomic_store_n(&scan->page_count, page_count + 1, __ATOMIC_RELEASE);
+}
+
+static inline u64 pager_scan_offset(PagerScan *scan, u32 page_index) {
+  return scan->blocks[page_index / PAGER_INDEX_BLOCK_SIZE][page_index % PAGER_INDEX_BLOCK_SIZE];
+}
+
+typedef struct PagerScanChunk {
+  PagerScan *scan;
+  u8 *start;
+  u8 *end;
+  /* NOTE: Newlines of the chunk, and of the scanned bytes before it */
+  u64 newline_count;
+  u64 newlines_before;
+  u32 max_page_count;
+} PagerScanChunk;
+
+/* NOTE: Counted in steps so a cancel does not wait for a whole chunk */
+#define PAGER_SCAN_STEP_SIZE (16 * 1024 * 1024)
+
+static i32 pager_scan_count_chunk(void *data) {
+  PagerScanChunk *chunk = (PagerScanChunk *)data;
+  chunk->newline_count = 0;
+  for(u8 *iterator = chunk->start; iterator < chunk->end; iterator += PAGER_SCAN_STEP_SIZE) {
+    if(__atomic_load_n(&chunk->scan->cancel, __ATOMIC_RELAXED)) {
+      break;
+    }
+    u64 size = MIN((u64)(chunk->end - iterator), (u64)PAGER_SCAN_STEP_SIZE);
+    chunk->newline_count += scan_count_byte(iterator, size, '\n');
+  }
+  return 0;
+}
+
+/* NOTE: Pages start after every PAGER_PAGE_LINE_COUNT newlines from the start of
+   the scan, the chunk writes the offsets of the pages that start inside it */
+static i32 pager_scan_find_pages(void *data) {
+  PagerScanChunk *chunk = (PagerScanChunk *)data;
+  PagerScan *scan = chunk->scan;
+  u8 *mapping_start = scan->mapping.data;
+  u64 newline = chunk->newlines_before;
+  u8 *iterator = chunk->start;
+  for(;;) {
+    u64 skip = PAGER_PAGE_LINE_COUNT - (newline % PAGER_PAGE_LINE_COUNT);
+    u64 page_index = (newline + skip) / PAGER_PAGE_LINE_COUNT + 1;
+    if(newline + skip > chunk->newlines_before + chunk->newline_count || page_index >= chunk->max_page_count ||
+       __atomic_load_n(&scan->cancel, __ATOMIC_RELAXED)) {
+      break;
+    }
+    for(u64 i = 0; i < skip; ++i) {
+      iterator = scan_find_byte(iterator, chunk->end, '\n') + 1;
+    }
+    newline += skip;
+    scan->blocks[page_index / PAGER_INDEX_BLOCK_SIZE][page_index % PAGER_INDEX_BLOCK_SIZE] = (u64)(iterator - mapping_start);
+  }
+  return 0;
+}
+
+static void pager_scan_run(PagerScanChunk *chunks, u32 chunk_count, PlatformThreadProc *proc) {
+  void *threads[PAGER_SCAN_MAX_THREADS];
+  for(u32 i = 1; i < chunk_count; ++i) {
+    threads[i] = platform_create_thread(proc, &chunks[i]);
+  }
+  proc(&chunks[0]);
+  for(u32 i = 1; i < chunk_count; ++i) {
+    platform_wait_thread(threads[i]);
+  }
+}
+
+/* NOTE: One page after the other, every page is published as soon as it is scanned */
+static void pager_scan_sequential(PagerScan *scan) {
+  u8 *start = scan->mapping.data;
+  u8 *end = start + scan->mapping.size;
+  u8 *iterator = start + pager_scan_offset(scan, scan->page_count - 1);
+  u32 max_page_count = PAGER_INDEX_MAX_BLOCKS * PAGER_INDEX_BLOCK_SIZE;
+  u32 line_count = 0;
+  bool last = false;
+  for(;;) {
+    iterator = pager_scan_page(iterator, end, &line_count, &last);
+    if(last || scan->page_count == max_page_count || __atomic_load_n(&scan->cancel, __ATOMIC_RELAXED)) {
+      break;
+    }
+    pager_scan_publish(scan, (u64)(iterator - start));
+  }
+  scan->last_page_line_count = line_count;
+}
+
+/* NOTE: The first two pages were published by pager_create, the scan starts at the
+   second one */
+static i32 pager_scan_thread(void *data) {
+  PagerScan *scan = (PagerScan *)data;
+  u8 *start = scan->mapping.data + pager_scan_offset(scan, 1);
+  u8 *end = scan->mapping.data + scan->mapping.size;
+  u32 max_page_count = PAGER_INDEX_MAX_BLOCKS * PAGER_INDEX_BLOCK_SIZE;
+  u64 size = (u64)(end - start);
+
+  PagerScanChunk chunks[PAGER_SCAN_MAX_THREADS];
+  u32 chunk_count = MIN((u32)MIN(size / PAGER_SCAN_CHUNK_MIN_SIZE, (u64)PAGER_SCAN_MAX_THREADS),
+                        platform_get_processor_count());
+  if(chunk_count < 2) {
+    pager_scan_sequential(scan);
+    __atomic_store_n(&scan->done, true, __ATOMIC_RELEASE);
+    /* NOTE: A reload of the file waits for the scan to be done */
+    platform_wake_up();
+    return 0;
+  }
+  for(u32 i = 0; i < chunk_count; ++i) {
+    chunks[i].scan = scan;
+    chunks[i].start = start + size / chunk_count * i;
+    chunks[i].end = (i + 1 == chunk_count) ? end : start + size / chunk_count * (i + 1);
+    chunks[i].max_page_count = max_page_count;
+  }
+  pager_scan_run(chunks, chunk_count, pager_scan_count_chunk);
+
+  /* NOTE: The blocks are allocated before the chunks write into them */
+  u64 newline_count = 0;
+  for(u32 i = 0; i < chunk_count; ++i) {
+    chunks[i].newlines_before = newline_count;
+    newline_count += chunks[i].newline_count;
+  }
+  u64 page_count = MIN(newline_count / PAGER_PAGE_LINE_COUNT + 2, (u64)max_page_count);
+  for(u32 i = 0; i < (page_count + PAGER_INDEX_BLOCK_SIZE - 1) / PAGER_INDEX_BLOCK_SIZE; ++i) {
+    if(!scan->blocks[i]) {
+      scan->blocks[i] = (u64 *)malloc(sizeof(u64) * PAGER_INDEX_BLOCK_SIZE);
+    }
+  }
+
+  /* NOTE: The page starts of a chunk are published once it and the chunks before it are done */
+  void *threads[PAGER_SCAN_MAX_THREADS];
+  for(u32 i = 1; i < chunk_count; ++i) {
+    threads[i] = platform_create_thread(pager_scan_find_pages, &chunks[i]);
+  }
+  for(u32 i = 0; i < chunk_count; ++i) {
+    if(i == 0) {
+      pager_scan_find_pages(&chunks[0]);
+    } else {
+      platform_wait_thread(threads[i]);
+    }
+    u64 newlines = chunks[i].newlines_before + chunks[i].newline_count;
+    u32 published = (u32)MIN(newlines / PAGER_PAGE_LINE_COUNT + 2, (u64)max_page_count);
+    /* NOTE: A canceled chunk stopped before its last page, nothing after it is published */
+    if(__atomic_load_n(&scan->cancel, __ATOMIC_RELAXED)) {
+      continue;
+    }
+    if(i + 1 < chunk_count && published > scan->page_count) {
+      __atomic_store_n(&scan->page_count, published, __ATOMIC_RELEASE);
+    }
+  }
+
+  if(__atomic_load_n(&scan->cancel, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&scan->done, true, __ATOMIC_RELEASE);
+    platform_wake_up();
+    return 0;
+  }
+  /* NOTE: The scan stops at the last page that fits the index, like a full index */
+  if(newline_count / PAGER_PAGE_LINE_COUNT + 2 > max_page_count) {
+    scan->last_page_line_count = PAGER_PAGE_LINE_COUNT;
+  } else {
+    scan->last_page_line_count = (u32)(newline_count % PAGER_PAGE_LINE_COUNT) + 1;
+  }
+  __atomic_store_n(&scan->page_count, (u32)page_count, __ATOMIC_RELEASE);
+  __atomic_store_n(&scan->done, true, __ATOMIC_RELEASE);
+  /* NOTE: A reload of the file waits for the scan to be done */
+  platform_wake_up();
+  return 0;
+}
+
+static bool pager_offsets_fit(PagerOffsets *offsets, MappedFile mapping) {
+  u32 max_page_count = PAGER_INDEX_MAX_BLOCKS * PAGER_INDEX_BLOCK_SIZE;
+  if(offsets->page_count == 0 || offsets->page_count > max_page_count || offsets->offsets[0] != 0 ||
+     offsets->last_page_line_count == 0 || offsets->last_page_line_count > PAGER_PAGE_LINE_COUNT) {
+    return false;
+  }
+  /* NOTE: Every page starts after a newline, only that is checked, the lines are not counted again */
+  for(u32 i = 1; i < offsets->page_count; ++i) {
+    u64 offset = offsets->offsets[i];
+    if(offset <= offsets->offsets[i - 1] || offset > mapping.size || mapping.data[offset - 1] != '\n') {
+      return false;
+    }
+  }
+  return true;
+}
+
+Pager *pager_create(MappedFile mapping, LineAllocator *allocator, PagerOffsets *offsets) {
+  Pager *pager = (Pager *)malloc(sizeof(Pager));
+  memset(pager, 0, sizeof(Pager));
+  pager->mapping = mapping;
+  pager->line_allocator = allocator;
+  pager->resident_budget = PAGER_DEFAULT_RESIDENT_BUDGET;
+
+  u8 *start = mapping.data;
+  u8 *end = mapping.data + mapping.size;
+  u8 *first_line_end = scan_find_byte(start, end, '\n');
+  pager->crlf = (first_line_end != end && first_line_end > start && first_line_end[-1] == '\r');
+
+  PagerScan *scan = (PagerScan *)malloc(sizeof(PagerScan));
+  memset(scan, 0, sizeof(PagerScan));
+  scan->mapping = mapping;
+  pager->scan = scan;
+
+  if(offsets && pager_offsets_fit(offsets, mapping)) {
+    for(u32 i = 0; i < offsets->page_count; ++i) {
+      pager_scan_publish(scan, offsets->offsets[i]);
+    }
+    scan->last_page_line_count = offsets->last_page_line_count;
+    scan->done = true;
+    pager_update(pager);
+    return pager;
+  }
+
+  /* NOTE: The first page is scanned here so the editor has lines to show right away */
+  u32 line_count = 0;
+  bool last = false;
+  pager_scan_publish(scan, 0);
+  u8 *next = pager_scan_page(start, end, &line_count, &last);
+  if(last) {
+    scan->last_page_line_count = line_count;
+    scan->done = true;
+  } else {
+    pager_scan_publish(scan, (u64)(next - start));
+    pager->scan_thread = platform_create_thread(pager_scan_thread, scan);
+  }
+  pager_update(pager);
+  return pager;
+}
+
+void pager_destroy(Pager *pager) {
+  __atomic_store_n(&pager->scan->cancel, true, __ATOMIC_RELAXED);
+  if(pager->scan_thread) {
+    platform_wait_thread(pager->scan_thread);
+  }
+  for(u32 i = 0; i < PAGER_INDEX_MAX_BLOCKS; ++i) {
+    free(pager->scan->blocks[i]);
+  }
+  free(pager->scan);
+
+  /* NOTE: The lines belong to the line allocator of the file, only the vectors are released */
+  for(u32 i = 0; i < vector_size(pager->pages); ++i) {
+    vector_free(pager->pages[i].lines);
+  }
+  vector_free(pager->pages);
+  vector_free(pager->resident_pages);
+  free(pager->line_index);
+  free(pager);
+}
+
+void pager_update(Pager *pager) {
+  PagerScan *scan = pager->scan;
+  /* NOTE: done is read first, once it is set the page count is final */
+  bool done = __atomic_load_n(&scan->done, __ATOMIC_ACQUIRE);
+  u32 published = __atomic_load_n(&scan->page_count, __ATOMIC_ACQUIRE);
+  /* NOTE: A page is complete when the next one is published or the scan is over */
+  u32 available = done ? published : published - 1;
+  u32 first = vector_size(pager->pages);
+  if(available <= first) {
+    return;
+  }
+
+  for(u32 i = first; i < available; ++i) {
+    Page page;
+    memset(&page, 0, sizeof(Page));
+    page.offset = pager_scan_offset(scan, i);
+    page.line_count = (done && i + 1 == published) ? scan->last_page_line_count : PAGER_PAGE_LINE_COUNT;
+    vector_push(pager->pages, page);
+  }
+
+  u32 capacity = pager->line_index_capacity;
+  if(available > capacity) {
+    while(capacity < available) {
+      capacity = capacity ? capacity * 2 : 16;
+    }
+    pager->line_index = (u64 *)realloc(pager->line_index, sizeof(u64) * (capacity + 1));
+    pager->line_index_capacity = capacity;
+    memset(pager->line_index, 0, sizeof(u64) * (capacity + 1));
+    for(u32 i = 0; i < available; ++i) {
+      pager->line_index[i + 1] = pager->pages[i].line_count;
+    }
+    fenwick_build(pager->line_index, capacity);
+  } else {
+    for(u32 i = first; i < available; ++i) {
+      fenwick_add(pager->line_index, capacity, i, pager->pages[i].line_count);
+    }
+  }
+}
+
+bool pager_is_scanning(Pager *pager) {
+  return !__atomic_load_n(&pager->scan->done, __ATOMIC_ACQUIRE);
+}
+
+void pager_wait_scan(Pager *pager) {
+  if(pager->scan_thread) {
+    platform_wait_thread(pager->scan_thread);
+    pager->scan_thread = 0;
+  }
+  pager_update(pager);
+}
+
+bool pager_get_offsets(Pager *pager, PagerOffsets *offsets) {
+  if(pager_is_scanning(pager)) {
+    return false;
+  }
+  PagerScan *scan = pager->scan;
+  offsets->page_count = scan->page_count;
+  offsets->last_page_line_count = scan->last_page_line_count;
+  offsets->offsets = (u64 *)malloc(sizeof(u64) * scan->page_count);
+  for(u32 i = 0; i < scan->page_count; ++i) {
+    offsets->offsets[i] = pager_scan_offset(scan, i);
+  }
+  return true;
+}
+
+u64 pager_page_byte_size(Pager *pager, u32 page_index) {
+  u32 published = __atomic_load_n(&pager->scan->page_count, __ATOMIC_ACQUIRE);
+  u64 end = (page_index + 1 < published) ? pager_scan_offset(pager->scan, page_index + 1) : pager->mapping.size;
+  return end - pager->pages[page_index].offset;
+}
+
+static void pager_evict(Pager *pager, u32 keep) {
+  while(vector_size(pager->resident_pages) > pager->resident_budget) {
+    u32 victim = 0;
+    bool found = false;
+    for(u32 i = 0; i < vector_size(pager->resident_pages); ++i) {
+      Page *page = &pager->pages[pager->resident_pages[i]];
+      if(!page->dirty && pager->resident_pages[i] != keep &&
+         (!found || page->last_used < pager->pages[pager->resident_pages[victim]].last_used)) {
+        victim = i;
+        found = true;
+      }
+    }
+    if(!found) {
+      return;
+    }
+
+    u32 page_index = pager->resident_pages[victim];
+    Page *page = &pager->pages[page_index];
+    for(u32 i = 0; i < vector_size(page->lines); ++i) {
+      line_allocator_free_line(pager->line_allocator, page->lines[i]);
+    }
+    vector_free(page->lines);
+    page->lines = 0;
+    /* NOTE: The bytes of a clean page are only in the page cache, give them back too */
+    platform_release_mapped_range(pager->mapping, page->offset, pager_page_byte_size(pager, page_index));
+
+    u32 resident_count = vector_size(pager->resident_pages);
+    pager->resident_pages[victim] = pager->resident_pages[resident_count - 1];
+    vector_header(pager->resident_pages)->size--;
+  }
+}
+
+static Page *pager_load_page(Pager *pager, u32 page_index) {
+  Page *page = &pager->pages[page_index];
+  page->last_used = ++pager->clock;
+  if(page->lines) {
+    return page;
+  }
+
+  /* NOTE: Same as the lines loader, the lines only reference the mapped bytes */
+  u8 *iterator = pager->mapping.data + page->offset;
+  u8 *end = pager->mapping.data + pager->mapping.size;
+  for(u32 i = 0; i < page->line_count; ++i) {
+    u8 *line_end = scan_find_byte(iterator, end, '\n');
+    u8 *content_end = line_end;
+    if(line_end != end && content_end > iterator && content_end[-1] == '\r') {
+      --content_end;
+    }
+    Line *line = line_allocator_alloc_line(pager->line_allocator);
+    line_set_mapped(line, iterator, (u32)(content_end - iterator));
+    vector_push(page->lines, line);
+    iterator = line_end + 1;
+  }
+  /* NOTE: A page whose lines were all removed still needs a vector to be resident */
+  vector_fit(page->lines);
+
+  vector_push(pager->resident_pages, page_index);
+  pager_evict(pager, page_index);
+  return page;
+}
+
+static Page *pager_find_line(Pager *pager, u32 index, u32 *page_line) {
+  pager_update(pager);
+  u64 remainder = 0;
+  u32 page_index = fenwick_find(pager->line_index, pager->line_index_capacity, index, &remainder);
+  assert(page_index < vector_size(pager->pages));
+  *page_line = (u32)remainder;
+  return pager_load_page(pager, page_index);
+}
+
+u32 pager_line_count(Pager *pager) {
+  pager_update(pager);
+  return (u32)fenwick_prefix(pager->line_index, pager->line_index_capacity);
+}
+
+Line *pager_get_line(Pager *pager, u32 index) {
+  assert(index < pager_line_count(pager));
+  u32 page_line;
+  Page *page = pager_find_line(pager, index, &page_line);
+  return page->lines[page_line];
+}
+
+Line *pager_get_line_for_write(Pager *pager, u32 index) {
+  assert(index < pager_line_count(pager));
+  u32 page_line;
+  Page *page = pager_find_line(pager, index, &page_line);
+  page->dirty = true;
+  return page->lines[page_line];
+}
+
+void pager_insert_line(Pager *pager, u32 index, Line *line) {
+  u32 line_count = pager_line_count(pager);
+  assert(index <= line_count);
+  u32 page_index;
+  u32 page_line;
+  if(index == line_count) {
+    /* NOTE: Append to the last page, the pages the scan adds later go after it */
+    page_index = vector_size(pager->pages) - 1;
+    page_line = pager->pages[page_index].line_count;
+  } else {
+    u64 remainder = 0;
+    page_index = fenwick_find(pager->line_index, pager->line_index_capacity, index, &remainder);
+    page_line = (u32)remainder;
+  }
+
+  Page *page = pager_load_page(pager, page_index);
+  vector_push(page->lines, line);
+  u32 count = vector_size(page->lines);
+  memmove(page->lines + page_line + 1, page->lines + page_line, sizeof(*page->lines) * (count - 1 - page_line));
+  page->lines[page_line] = line;
+  page->line_count++;
+  page->dirty = true;
+  fenwick_add(pager->line_index, pager->line_index_capacity, page_index, 1);
+}
+
+Line *pager_remove_line(Pager *pager, u32 index) {
+  assert(index < pager_line_count(pager));
+  u64 remainder = 0;
+  u32 page_index = fenwick_find(pager->line_index, pager->line_index_capacity, index, &remainder);
+  u32 page_line = (u32)remainder;
+
+  Page *page = pager_load_page(pager, page_index);
+  Line *line = page->lines[page_line];
+  u32 count = vector_size(page->lines);
+  memmove(page->lines + page_line, page->lines + page_line + 1, sizeof(*page->lines) * (count - 1 - page_line));
+  vector_header(page->lines)->size--;
+  page->line_count--;
+  page->dirty = true;
+  fenwick_add(pager->line_index, pager->line_index_capacity, page_index, -1);
+  return line;
+}
+
+void pager_prefetch(Pager *pager, u32 line, i32 direction) {
+  u32 line_count = pager_line_count(pager);
+  if(line_count == 0) {
+    return;
+  }
+  u32 page_line;
+  Page *page = pager_find_line(pager, MIN(line, line_count - 1), &page_line);
+  u32 page_index = (u32)(page - pager->pages);
+
+  /* NOTE: The page after it is only read ahead, its lines are materialized when they are reached */
+  i64 next_index = (i64)page_index + ((direction > 0) ? 1 : -1);
+  if(next_index >= 0 && next_index < (i64)vector_size(pager->pages)) {
+    Page *next = &pager->pages[next_index];
+    platform_prefetch_mapped_range(pager->mapping, next->offset, pager_page_byte_size(pager, (u32)next_index));
+  }
+}
+
+static inline u64 pager_line_physical_size(Pager *pager, Line *line) {
+  return line_byte_size(line) + (pager->crlf ? 2 : 1);
+}
+
+u64 pager_line_offset(Pager *pager, u32 index) {
+  assert(index < pager_line_count(pager));
+  u32 page_line;
+  Page *page = pager_find_line(pager, index, &page_line);
+  u64 offset = page->offset;
+  for(u32 i = 0; i < page_line; ++i) {
+    offset += pager_line_physical_size(pager, page->lines[i]);
+  }
+  return offset;
+}
+
+u32 pager_offset_to_line(Pager *pager, u64 offset, u64 *byte) {
+  pager_update(pager);
+  u32 page_count = vector_size(pager->pages);
+  assert(page_count > 0);
+
+  /* NOTE: Last page that starts at or before the offset, modified pages keep the
+     offset they had on disk so the pages are always sorted */
+  u32 low = 0;
+  u32 high = page_count - 1;
+  while(low < high) {
+    u32 middle = low + (high - low + 1) / 2;
+    if(pager->pages[middle].offset <= offset) {
+      low = middle;
+    } else {
+      high = middle - 1;
+    }
+  }
+
+  u32 line = (u32)fenwick_prefix(pager->line_index, low);
+  Page *page = pager_load_page(pager, low);
+  u64 remainder = offset - MIN(offset, page->offset);
+  for(u32 i = 0; i < page->line_count; ++i) {
+    u64 size = pager_line_physical_size(pager, page->lines[i]);
+    if(remainder < size || i + 1 == page->line_count) {
+      *byte = remainder;
+      return line + i;
+    }
+    remainder -= size;
+  }
+  *byte = 0;
+  return line;
+}
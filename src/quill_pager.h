@@ -0,0 +1,96 @@
+#ifndef _QUILL_PAGER_H_
+#define _QUILL_PAGER_H_
+
+#include "quill.h"
+
+/* NOTE: The pager shows files too big to be resident. A background thread scans the
+   mapping and publishes the offset of every PAGER_PAGE_LINE_COUNT lines, the lines
+   of a page are only materialized while the page is resident and clean pages are
+   evicted, least recently used first, when there are more than the budget */
+#define PAGER_PAGE_LINE_COUNT 4096
+#define PAGER_DEFAULT_RESIDENT_BUDGET 64
+
+/* NOTE: The scan publishes into fixed blocks so the offsets never move while the
+   main thread reads them, the blocks cover as many lines as a u32 line index */
+#define PAGER_INDEX_BLOCK_SIZE 4096
+#define PAGER_INDEX_MAX_BLOCKS 255
+
+/* NOTE: The scan splits the file in chunks, counts their newlines on several threads
+   and then finds the page starts of every chunk on several threads too, the pages
+   are published one chunk after the other */
+#define PAGER_SCAN_CHUNK_MIN_SIZE (64 * 1024 * 1024)
+#define PAGER_SCAN_MAX_THREADS 16
+
+typedef struct PagerScan {
+  MappedFile mapping;
+  u64 *blocks[PAGER_INDEX_MAX_BLOCKS];
+  /* NOTE: Written by the scan thread and read with atomics by the main thread */
+  u32 page_count;
+  u32 last_page_line_count;
+  bool done;
+  bool cancel;
+} PagerScan;
+
+/* NOTE: The offsets of a finished scan, the project index keeps them so a file that
+   did not change is not scanned again. size and modified_time are the file they
+   were scanned from, the pager does not read them */
+typedef struct PagerOffsets {
+  u64 *offsets;
+  u32 page_count;
+  u32 last_page_line_count;
+  u64 size;
+  u64 modified_time;
+} PagerOffsets;
+
+typedef struct Page {
+  /* NOTE: Offset of the first line of the page in the file on disk */
+  u64 offset;
+  u32 line_count;
+  u32 last_used;
+  /* NOTE: Vector with the lines of the page, zero when the page is not resident */
+  struct Line **lines;
+  /* NOTE: Modified pages are never evicted */
+  bool dirty;
+} Page;
+
+typedef struct Pager {
+  MappedFile mapping;
+  PagerScan *scan;
+  void *scan_thread;
+  bool crlf;
+
+  /* NOTE: Pages taken from the scan, line_index is a fenwick tree over their line count */
+  Page *pages;
+  u64 *line_index;
+  u32 line_index_capacity;
+
+  struct LineAllocator *line_allocator;
+  u32 *resident_pages;
+  u32 resident_budget;
+  u32 clock;
+} Pager;
+
+/* NOTE: offsets can be zero, offsets that do not fit the mapping are ignored and the file is scanned */
+Pager *pager_create(MappedFile mapping, struct LineAllocator *allocator, PagerOffsets *offsets);
+void pager_destroy(Pager *pager);
+void pager_update(Pager *pager);
+bool pager_is_scanning(Pager *pager);
+void pager_wait_scan(Pager *pager);
+/* NOTE: Copy the offsets of the scan into a heap buffer, false while the scan is running */
+bool pager_get_offsets(Pager *pager, PagerOffsets *offsets);
+
+u32 pager_line_count(Pager *pager);
+struct Line *pager_get_line(Pager *pager, u32 index);
+/* NOTE: Same as pager_get_line, but the page of the line is marked as modified */
+struct Line *pager_get_line_for_write(Pager *pager, u32 index);
+void pager_insert_line(Pager *pager, u32 index, struct Line *line);
+struct Line *pager_remove_line(Pager *pager, u32 index);
+/* NOTE: Materialize the page after line in the scroll direction and read its bytes ahead */
+void pager_prefetch(Pager *pager, u32 line, i32 direction);
+
+/* NOTE: Size of the page in the file on disk, clean pages still have exactly these bytes */
+u64 pager_page_byte_size(Pager *pager, u32 page_index);
+u64 pager_line_offset(Pager *pager, u32 index);
+u32 pager_offset_to_line(Pager *pager, u64 offset, u64 *byte);
+
+#endif /* _QUILL_PAGER_H_ */
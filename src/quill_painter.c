@@ -1,6 +1,7 @@
 #include "quill_painter.h"
 #include "quill_line.h"
 #include "quill_tokenizer.h"
+#include "quill_utf8.h"
 
 extern Platform platform;
 
@@ -87,13 +88,13 @@ void painter_draw_text(Painter *painter, u8 *text, u32 size, i32 x, i32 y, u32 c
   assert(painter->font);
   i32 pen_y = y; //(y + painter->font->line_gap);
   i32 pen_x = x;
-  for(u32 i = 0; i < size; ++i) {
-    u16 codepoint = (u16)text[i];
+  u32 i = 0;
+  while(i < size) {
+    u32 codepoint;
+    i += utf8_decode(text + i, size - i, &codepoint);
 
-    if((codepoint < ' ') || (codepoint > '~')) codepoint = '?';
-
-    Glyph *glyph = &painter->font->glyph_table[codepoint];
-    if(codepoint != (u16)' ') {
+    Glyph *glyph = font_get_glyph(painter->font, codepoint);
+    if(codepoint != (u32)' ') {
       painter_draw_glyph(painter, glyph, pen_x, pen_y, color);
     }
     pen_x += painter->font->advance;
@@ -113,10 +114,8 @@ void painter_draw_token(Painter *painter, Token *token, i32 x, i32 y, u32 color)
   }
 
   for(u32 i = token->start; i < token->end; ++i) {
-    u8 codepoint = line_get_codepoint_at(token->line, i);
-    if((codepoint < ' ') || (codepoint > '~')) codepoint = '?';
-
-    Glyph *glyph = &painter->font->glyph_table[codepoint];
+    u32 codepoint = line_get_codepoint_at(token->line, i);
+    Glyph *glyph = font_get_glyph(painter->font, codepoint);
     painter_draw_glyph(painter, glyph, x, y, color);
     x += platform.font->advance;
   }
@@ -135,8 +134,8 @@ void painter_draw_line(Painter *painter, struct Line *line, i32 x, i32 y, u32 co
 #elif
 void painter_draw_line(Painter *painter, struct Line *line, i32 x, i32 y, u32 color) {
   for(u32 i = 0; i < line_size(line); ++i) {
-    u8 codepoint = line_get_codepoint_at(line, i);
-    Glyph *glyph = &painter->font->glyph_table[codepoint];
+    u32 codepoint = line_get_codepoint_at(line, i);
+    Glyph *glyph = font_get_glyph(painter->font, codepoint);
     painter_draw_glyph(painter, glyph, x, y, color);
     x += platform.font->advance;
   }
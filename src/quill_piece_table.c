@@ -0,0 +1,380 @@
+#include "quill_piece_table.h"
+#include "quill_data_structures.h"
+#include "quill_scan.h"
+
+static inline u64 piece_subtree_size(Piece *piece) {
+  return piece ? piece->subtree_size : 0;
+}
+
+static inline u64 piece_subtree_newline_count(Piece *piece) {
+  return piece ? piece->subtree_newline_count : 0;
+}
+
+static inline void piece_update(Piece *piece) {
+  piece->subtree_size = piece_subtree_size(piece->left) + piece->size + piece_subtree_size(piece->right);
+  piece->subtree_newline_count = piece_subtree_newline_count(piece->left) + piece->newline_count +
+    piece_subtree_newline_count(piece->right);
+}
+
+static inline u8 *piece_table_piece_data(PieceTable *table, Piece *piece) {
+  u8 *buffer = (piece->source == PIECE_SOURCE_ORIGINAL) ? table->original : table->add;
+  return buffer + piece->start;
+}
+
+static inline u32 piece_table_random(PieceTable *table) {
+  /* NOTE: xorshift32, the treap only needs the priorities to be well distributed */
+  u32 x = table->seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  table->seed = x;
+  return x;
+}
+
+static inline u64 piece_count_newlines(u8 *data, u64 size) {
+  return scan_count_byte(data, size, '\n');
+}
+
+static Piece *piece_create(PieceTable *table, PieceSource source, u64 start, u64 size) {
+  Piece *piece = (Piece *)malloc(sizeof(Piece));
+  memset(piece, 0, sizeof(Piece));
+  piece->priority = piece_table_random(table);
+  piece->source = source;
+  piece->start = start;
+  piece->size = size;
+  piece->newline_count = piece_count_newlines(piece_table_piece_data(table, piece), size);
+  piece_update(piece);
+  return piece;
+}
+
+static void piece_destroy_tree(Piece *piece) {
+  if(piece) {
+    piece_destroy_tree(piece->left);
+    piece_destroy_tree(piece->right);
+    free(piece);
+  }
+}
+
+static void piece_visit_tree(PieceTable *table, Piece *piece, PieceTableVisitProc *proc, void *data) {
+  if(piece) {
+    piece_visit_tree(table, piece->left, proc, data);
+    proc(data, piece_table_piece_data(table, piece), piece->size);
+    piece_visit_tree(table, piece->right, proc, data);
+  }
+}
+
+static Piece *piece_merge(Piece *a, Piece *b) {
+  if(!a) {
+    return b;
+  }
+  if(!b) {
+    return a;
+  }
+  if(a->priority > b->priority) {
+    a->right = piece_merge(a->right, b);
+    piece_update(a);
+    return a;
+  } else {
+    b->left = piece_merge(a, b->left);
+    piece_update(b);
+    return b;
+  }
+}
+
+/* NOTE: After the split the left tree contains exactly offset bytes, a piece
+   that straddles the offset is cut in two */
+static void piece_split(PieceTable *table, Piece *piece, u64 offset, Piece **left, Piece **right) {
+  if(!piece) {
+    *left = 0;
+    *right = 0;
+    return;
+  }
+
+  u64 left_size = piece_subtree_size(piece->left);
+  if(offset <= left_size) {
+    piece_split(table, piece->left, offset, left, &piece->left);
+    piece_update(piece);
+    *right = piece;
+  } else if(offset >= left_size + piece->size) {
+    piece_split(table, piece->right, offset - left_size - piece->size, &piece->right, right);
+    piece_update(piece);
+    *left = piece;
+  } else {
+    u64 local_offset = offset - left_size;
+    Piece *tail = piece_create(table, piece->source, piece->start + local_offset, piece->size - local_offset);
+    piece->size = local_offset;
+    piece->newline_count -= tail->newline_count;
+    *right = piece_merge(tail, piece->right);
+    piece->right = 0;
+    piece_update(piece);
+    *left = piece;
+  }
+}
+
+static Piece *piece_table_create_pieces(PieceTable *table, PieceSource source, u64 start, u64 size) {
+  Piece *result = 0;
+  while(size > 0) {
+    u64 piece_size = MIN(size, (u64)PIECE_MAX_SIZE);
+    result = piece_merge(result, piece_create(table, source, start, piece_size));
+    start += piece_size;
+    size -= piece_size;
+  }
+  return result;
+}
+
+/* NOTE: When the user types, every new codepoint lands right after the last
+   piece that was added, so that piece is extended instead of creating a new one */
+static bool piece_try_extend(Piece *piece, u64 offset, u64 add_size, u64 size, u64 newline_count) {
+  if(!piece) {
+    return false;
+  }
+  bool extended = false;
+  u64 left_size = piece_subtree_size(piece->left);
+  if(offset <= left_size) {
+    extended = piece_try_extend(piece->left, offset, add_size, size, newline_count);
+  } else if(offset == left_size + piece->size) {
+    if((piece->source == PIECE_SOURCE_ADD) &&
+       (piece->start + piece->size == add_size) &&
+       (piece->size + size <= PIECE_MAX_SIZE)) {
+      piece->size += size;
+      piece->newline_count += newline_count;
+      extended = true;
+    }
+  } else if(offset > left_size + piece->size) {
+    extended = piece_try_extend(piece->right, offset - left_size - piece->size, add_size, size, newline_count);
+  }
+  if(extended) {
+    piece_update(piece);
+  }
+  return extended;
+}
+
+static void piece_table_append_add(PieceTable *table, u8 *data, u64 size) {
+  assert((u64)vector_size(table->add) + size <= 0xffffffff);
+  while(vector_capacity(table->add) < vector_size(table->add) + size) {
+    table->add = vector_grow(table->add, sizeof(*table->add));
+  }
+  memcpy(table->add + vector_size(table->add), data, size);
+  vector_header(table->add)->size += (u32)size;
+}
+
+typedef struct PieceTableChunk {
+  /* NOTE: A copy of the table with its own seed, the threads never share the random state */
+  PieceTable table;
+  u64 start;
+  u64 size;
+  Piece *root;
+} PieceTableChunk;
+
+static i32 piece_table_create_chunk(void *data) {
+  PieceTableChunk *chunk = (PieceTableChunk *)data;
+  chunk->root = piece_table_create_pieces(&chunk->table, PIECE_SOURCE_ORIGINAL, chunk->start, chunk->size);
+  return 0;
+}
+
+/* NOTE: The chunks are whole pieces so the pieces are the same ones a single thread
+   creates, the treaps of the chunks are merged in document order */
+static Piece *piece_table_create_pieces_parallel(PieceTable *table, u32 thread_count) {
+  PieceTableChunk chunks[PIECE_TABLE_MAX_THREADS];
+  void *threads[PIECE_TABLE_MAX_THREADS];
+  u64 piece_count = (table->original_size + PIECE_MAX_SIZE - 1) / PIECE_MAX_SIZE;
+  u64 start = 0;
+  for(u32 i = 0; i < thread_count; ++i) {
+    PieceTableChunk *chunk = &chunks[i];
+    u64 end = (i + 1 == thread_count) ? table->original_size :
+              MIN(piece_count * (i + 1) / thread_count * PIECE_MAX_SIZE, table->original_size);
+    chunk->table = *table;
+    chunk->table.seed = table->seed ^ (0x85ebca6bu * (i + 1));
+    chunk->start = start;
+    chunk->size = end - start;
+    chunk->root = 0;
+    start = end;
+  }
+  for(u32 i = 1; i < thread_count; ++i) {
+    threads[i] = platform_create_thread(piece_table_create_chunk, &chunks[i]);
+  }
+  piece_table_create_chunk(&chunks[0]);
+  Piece *root = chunks[0].root;
+  for(u32 i = 1; i < thread_count; ++i) {
+    platform_wait_thread(threads[i]);
+    root = piece_merge(root, chunks[i].root);
+  }
+  return root;
+}
+
+PieceTable *piece_table_create(u8 *data, u64 size) {
+  PieceTable *table = (PieceTable *)malloc(sizeof(PieceTable));
+  memset(table, 0, sizeof(PieceTable));
+  table->seed = 0x9e3779b9;
+  table->original = data;
+  table->original_size = size;
+  u32 thread_count = MIN((u32)MIN(size / PIECE_TABLE_CHUNK_MIN_SIZE, (u64)PIECE_TABLE_MAX_THREADS),
+                         platform_get_processor_count());
+  if(thread_count > 1) {
+    table->root = piece_table_create_pieces_parallel(table, thread_count);
+  } else {
+    table->root = piece_table_create_pieces(table, PIECE_SOURCE_ORIGINAL, 0, size);
+  }
+  return table;
+}
+
+void piece_table_destroy(PieceTable *table) {
+  piece_destroy_tree(table->root);
+  vector_free(table->add);
+  free(table);
+}
+
+void piece_table_insert(PieceTable *table, u64 offset, u8 *data, u64 size) {
+  assert(offset <= piece_table_size(table));
+  if(size == 0) {
+    return;
+  }
+
+  u64 add_size = vector_size(table->add);
+  u64 newline_count = piece_count_newlines(data, size);
+  if(piece_try_extend(table->root, offset, add_size, size, newline_count)) {
+    piece_table_append_add(table, data, size);
+    return;
+  }
+
+  piece_table_append_add(table, data, size);
+  Piece *pieces = piece_table_create_pieces(table, PIECE_SOURCE_ADD, add_size, size);
+
+  Piece *left, *right;
+  piece_split(table, table->root, offset, &left, &right);
+  table->root = piece_merge(piece_merge(left, pieces), right);
+}
+
+void piece_table_remove(PieceTable *table, u64 offset, u64 size) {
+  assert(offset + size <= piece_table_size(table));
+  if(size == 0) {
+    return;
+  }
+
+  Piece *left, *middle, *right;
+  piece_split(table, table->root, offset, &left, &right);
+  piece_split(table, right, size, &middle, &right);
+  piece_destroy_tree(middle);
+  table->root = piece_merge(left, right);
+}
+
+static void piece_copy(PieceTable *table, Piece *piece, u64 offset, u64 size, u8 *des) {
+  if(!piece || size == 0) {
+    return;
+  }
+
+  u64 left_size = piece_subtree_size(piece->left);
+  if(offset < left_size) {
+    u64 count = MIN(size, left_size - offset);
+    piece_copy(table, piece->left, offset, count, des);
+    des += count;
+    offset += count;
+    size -= count;
+  }
+  if(size == 0) {
+    return;
+  }
+  offset -= left_size;
+
+  if(offset < piece->size) {
+    u64 count = MIN(size, piece->size - offset);
+    memcpy(des, piece_table_piece_data(table, piece) + offset, count);
+    des += count;
+    offset += count;
+    size -= count;
+  }
+  if(size == 0) {
+    return;
+  }
+  offset -= piece->size;
+
+  piece_copy(table, piece->right, offset, size, des);
+}
+
+void piece_table_copy(PieceTable *table, u64 offset, u64 size, u8 *des) {
+  assert(offset + size <= piece_table_size(table));
+  piece_copy(table, table->root, offset, size, des);
+}
+
+u64 piece_table_size(PieceTable *table) {
+  return piece_subtree_size(table->root);
+}
+
+u64 piece_table_line_count(PieceTable *table) {
+  return piece_subtree_newline_count(table->root) + 1;
+}
+
+/* NOTE: Return the document offset of the newline with index newline_index */
+static u64 piece_table_newline_offset(PieceTable *table, u64 newline_index) {
+  assert(newline_index < piece_subtree_newline_count(table->root));
+  u64 base = 0;
+  Piece *piece = table->root;
+  while(piece) {
+    u64 left_newline_count = piece_subtree_newline_count(piece->left);
+    if(newline_index < left_newline_count) {
+      piece = piece->left;
+    } else if(newline_index < left_newline_count + piece->newline_count) {
+      base += piece_subtree_size(piece->left);
+      newline_index -= left_newline_count;
+      u8 *data = piece_table_piece_data(table, piece);
+      u8 *iterator = data;
+      for(;;) {
+        iterator = (u8 *)memchr(iterator, '\n', piece->size - (iterator - data));
+        assert(iterator);
+        if(newline_index == 0) {
+          return base + (iterator - data);
+        }
+        --newline_index;
+        ++iterator;
+      }
+    } else {
+      newline_index -= left_newline_count + piece->newline_count;
+      base += piece_subtree_size(piece->left) + piece->size;
+      piece = piece->right;
+    }
+  }
+  assert(!"invalid newline index");
+  return 0;
+}
+
+u64 piece_table_line_start(PieceTable *table, u64 line) {
+  assert(line < piece_table_line_count(table));
+  if(line == 0) {
+    return 0;
+  }
+  return piece_table_newline_offset(table, line - 1) + 1;
+}
+
+u64 piece_table_line_size(PieceTable *table, u64 line) {
+  u64 start = piece_table_line_start(table, line);
+  u64 end = piece_table_size(table);
+  if(line + 1 < piece_table_line_count(table)) {
+    end = piece_table_newline_offset(table, line);
+  }
+  return end - start;
+}
+
+u64 piece_table_offset_to_line(PieceTable *table, u64 offset) {
+  assert(offset <= piece_table_size(table));
+  u64 line = 0;
+  Piece *piece = table->root;
+  while(piece) {
+    u64 left_size = piece_subtree_size(piece->left);
+    if(offset < left_size) {
+      piece = piece->left;
+    } else if(offset < left_size + piece->size) {
+      line += piece_subtree_newline_count(piece->left);
+      line += piece_count_newlines(piece_table_piece_data(table, piece), offset - left_size);
+      return line;
+    } else {
+      line += piece_subtree_newline_count(piece->left) + piece->newline_count;
+      offset -= left_size + piece->size;
+      piece = piece->right;
+    }
+  }
+  return line;
+}
+
+void piece_table_visit(PieceTable *table, PieceTableVisitProc *proc, void *data) {
+  piece_visit_tree(table, table->root, proc, data);
+}
@@ -0,0 +1,62 @@
+#ifndef _QUILL_PIECE_TABLE_H_
+#define _QUILL_PIECE_TABLE_H_
+
+#include "quill.h"
+
+/* NOTE: Pieces are never bigger than this, so splitting a piece or looking for a
+   newline inside of it only ever scans a bounded amount of bytes */
+#define PIECE_MAX_SIZE (64 * 1024)
+/* NOTE: The pieces of an original buffer bigger than this are created and their
+   newlines counted on several threads, each one builds the treap of its chunk */
+#define PIECE_TABLE_CHUNK_MIN_SIZE (4 * 1024 * 1024)
+#define PIECE_TABLE_MAX_THREADS 16
+
+typedef enum PieceSource {
+  PIECE_SOURCE_ORIGINAL,
+  PIECE_SOURCE_ADD,
+} PieceSource;
+
+/* NOTE: Pieces are nodes of a treap ordered by document position, each node
+   caches the size and newline count of its whole subtree */
+typedef struct Piece {
+  struct Piece *left;
+  struct Piece *right;
+  u32 priority;
+
+  PieceSource source;
+  u64 start;
+  u64 size;
+  u64 newline_count;
+
+  u64 subtree_size;
+  u64 subtree_newline_count;
+} Piece;
+
+typedef struct PieceTable {
+  /* NOTE: The original buffer is owned by the caller and is never copied or modified */
+  u8 *original;
+  u64 original_size;
+  /* NOTE: Append only buffer, pieces reference it by offset so it can be reallocated */
+  u8 *add;
+
+  Piece *root;
+  u32 seed;
+} PieceTable;
+
+/* NOTE: Called with the bytes of every piece in document order, the bytes of the
+   add buffer are only valid until the next insert */
+typedef void PieceTableVisitProc(void *data, u8 *bytes, u64 size);
+
+PieceTable *piece_table_create(u8 *data, u64 size);
+void piece_table_destroy(PieceTable *table);
+void piece_table_insert(PieceTable *table, u64 offset, u8 *data, u64 size);
+void piece_table_remove(PieceTable *table, u64 offset, u64 size);
+void piece_table_copy(PieceTable *table, u64 offset, u64 size, u8 *des);
+u64 piece_table_size(PieceTable *table);
+u64 piece_table_line_count(PieceTable *table);
+u64 piece_table_line_start(PieceTable *table, u64 line);
+u64 piece_table_line_size(PieceTable *table, u64 line);
+u64 piece_table_offset_to_line(PieceTable *table, u64 offset);
+void piece_table_visit(PieceTable *table, PieceTableVisitProc *proc, void *data);
+
+#endif /* _QUILL_PIECE_TABLE_H_ */
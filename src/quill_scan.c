@@ -0,0 +1,216 @@
+#include "quill_scan.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SCAN_WIDTH 32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SCAN_WIDTH 16
+#else
+#define SCAN_WIDTH 0
+#endif
+
+#if SCAN_WIDTH > 0
+/* NOTE: Return a bit mask with the bytes of the block that are equal to value */
+static inline u32 scan_block_mask(u8 *data, u8 value) {
+#if defined(__AVX2__)
+  __m256i block = _mm256_loadu_si256((__m256i *)data);
+  __m256i equals = _mm256_cmpeq_epi8(block, _mm256_set1_epi8((char)value));
+  return (u32)_mm256_movemask_epi8(equals);
+#else
+  __m128i block = _mm_loadu_si128((__m128i *)data);
+  __m128i equals = _mm_cmpeq_epi8(block, _mm_set1_epi8((char)value));
+  return (u32)_mm_movemask_epi8(equals);
+#endif
+}
+
+/* NOTE: Return a bit mask with the bytes of the block that have the high bit set */
+static inline u32 scan_block_high_mask(u8 *data) {
+#if defined(__AVX2__)
+  return (u32)_mm256_movemask_epi8(_mm256_loadu_si256((__m256i *)data));
+#else
+  return (u32)_mm_movemask_epi8(_mm_loadu_si128((__m128i *)data));
+#endif
+}
+
+/* NOTE: Return a bit mask with the bytes of the block that are below 0x20 */
+static inline u32 scan_block_control_mask(u8 *data) {
+#if defined(__AVX2__)
+  __m256i block = _mm256_loadu_si256((__m256i *)data);
+  __m256i below = _mm256_cmpeq_epi8(_mm256_min_epu8(block, _mm256_set1_epi8(0x1f)), block);
+  return (u32)_mm256_movemask_epi8(below);
+#else
+  __m128i block = _mm_loadu_si128((__m128i *)data);
+  __m128i below = _mm_cmpeq_epi8(_mm_min_epu8(block, _mm_set1_epi8(0x1f)), block);
+  return (u32)_mm_movemask_epi8(below);
+#endif
+}
+#endif
+
+u8 *scan_find_byte(u8 *data, u8 *end, u8 value) {
+#if SCAN_WIDTH > 0
+  while(end - data >= SCAN_WIDTH) {
+    u32 mask = scan_block_mask(data, value);
+    if(mask) {
+      return data + __builtin_ctz(mask);
+    }
+    data += SCAN_WIDTH;
+  }
+#endif
+  while(data < end) {
+    if(*data == value) {
+      return data;
+    }
+    ++data;
+  }
+  return end;
+}
+
+u8 *scan_find_either_byte(u8 *data, u8 *end, u8 a, u8 b) {
+#if SCAN_WIDTH > 0
+  while(end - data >= SCAN_WIDTH) {
+    u32 mask = scan_block_mask(data, a) | scan_block_mask(data, b);
+    if(mask) {
+      return data + __builtin_ctz(mask);
+    }
+    data += SCAN_WIDTH;
+  }
+#endif
+  while(data < end) {
+    if(*data == a || *data == b) {
+      return data;
+    }
+    ++data;
+  }
+  return end;
+}
+
+u64 scan_count_byte(u8 *data, u64 size, u8 value) {
+  u64 count = 0;
+  u8 *end = data + size;
+#if SCAN_WIDTH > 0
+  while(end - data >= SCAN_WIDTH) {
+    count += (u64)__builtin_popcount(scan_block_mask(data, value));
+    data += SCAN_WIDTH;
+  }
+#endif
+  while(data < end) {
+    count += (*data++ == value);
+  }
+  return count;
+}
+
+bool scan_is_ascii(u8 *data, u64 size) {
+  u8 *end = data + size;
+#if SCAN_WIDTH > 0
+  while(end - data >= SCAN_WIDTH) {
+    if(scan_block_high_mask(data)) {
+      return false;
+    }
+    data += SCAN_WIDTH;
+  }
+#endif
+  while(data < end) {
+    if(*data++ & 0x80) {
+      return false;
+    }
+  }
+  return true;
+}
+
+u64 scan_ascii_size(u8 *data, u64 size) {
+  u8 *start = data;
+  u8 *end = data + size;
+#if SCAN_WIDTH > 0
+  while(end - data >= SCAN_WIDTH) {
+    u32 mask = scan_block_high_mask(data);
+    if(mask) {
+      return (u64)(data - start) + __builtin_ctz(mask);
+    }
+    data += SCAN_WIDTH;
+  }
+#endif
+  while(data < end && !(*data & 0x80)) {
+    ++data;
+  }
+  return (u64)(data - start);
+}
+
+/* NOTE: The utf16 helpers work on 16 code units at a time with SSE2 even when AVX2
+   is there, the AVX2 pack and unpack work inside of each 128 bit lane */
+u64 scan_narrow_utf16_ascii(u8 *des, u8 *data, u64 unit_count, bool big_endian) {
+  u64 count = 0;
+#if SCAN_WIDTH > 0
+  __m128i high_bits = _mm_set1_epi16((short)0xff80);
+  __m128i zero = _mm_setzero_si128();
+  while(unit_count - count >= 16) {
+    __m128i a = _mm_loadu_si128((__m128i *)(data + count * 2));
+    __m128i b = _mm_loadu_si128((__m128i *)(data + count * 2 + 16));
+    if(big_endian) {
+      a = _mm_or_si128(_mm_slli_epi16(a, 8), _mm_srli_epi16(a, 8));
+      b = _mm_or_si128(_mm_slli_epi16(b, 8), _mm_srli_epi16(b, 8));
+    }
+    __m128i high = _mm_and_si128(_mm_or_si128(a, b), high_bits);
+    if(_mm_movemask_epi8(_mm_cmpeq_epi8(high, zero)) != 0xffff) {
+      break;
+    }
+    _mm_storeu_si128((__m128i *)(des + count), _mm_packus_epi16(a, b));
+    count += 16;
+  }
+#endif
+  while(count < unit_count) {
+    u8 *unit = data + count * 2;
+    u32 value = big_endian ? ((u32)unit[0] << 8 | unit[1]) : ((u32)unit[1] << 8 | unit[0]);
+    if(value >= 0x80) {
+      break;
+    }
+    des[count++] = (u8)value;
+  }
+  return count;
+}
+
+void scan_widen_ascii_utf16(u8 *des, u8 *data, u64 size, bool big_endian) {
+  u64 i = 0;
+#if SCAN_WIDTH > 0
+  __m128i zero = _mm_setzero_si128();
+  while(size - i >= 16) {
+    __m128i block = _mm_loadu_si128((__m128i *)(data + i));
+    __m128i low = big_endian ? _mm_unpacklo_epi8(zero, block) : _mm_unpacklo_epi8(block, zero);
+    __m128i high = big_endian ? _mm_unpackhi_epi8(zero, block) : _mm_unpackhi_epi8(block, zero);
+    _mm_storeu_si128((__m128i *)(des + i * 2), low);
+    _mm_storeu_si128((__m128i *)(des + i * 2 + 16), high);
+    i += 16;
+  }
+#endif
+  for(; i < size; ++i) {
+    des[i * 2 + (big_endian ? 0 : 1)] = 0;
+    des[i * 2 + (big_endian ? 1 : 0)] = data[i];
+  }
+}
+
+static inline bool scan_is_binary_byte(u8 byte) {
+  /* NOTE: One bit for every control byte that text files use */
+  u32 text_controls = (1u << '\t') | (1u << '\n') | (1u << '\v') | (1u << '\f') |
+                      (1u << '\r') | (1u << '\b') | (1u << 0x1b);
+  return byte < 0x20 && !(text_controls & (1u << byte));
+}
+
+u64 scan_count_binary_bytes(u8 *data, u64 size) {
+  u64 count = 0;
+  u8 *end = data + size;
+#if SCAN_WIDTH > 0
+  while(end - data >= SCAN_WIDTH) {
+    /* NOTE: Text is mostly above 0x20, only the new lines and tabs are checked one by one */
+    u32 mask = scan_block_control_mask(data);
+    while(mask) {
+      count += scan_is_binary_byte(data[__builtin_ctz(mask)]);
+      mask &= mask - 1;
+    }
+    data += SCAN_WIDTH;
+  }
+#endif
+  while(data < end) {
+    count += scan_is_binary_byte(*data++);
+  }
+  return count;
+}
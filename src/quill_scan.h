@@ -0,0 +1,25 @@
+#ifndef _QUILL_SCAN_H_
+#define _QUILL_SCAN_H_
+
+#include "quill.h"
+
+/* NOTE: Byte scanning helpers used by the loaders, they use AVX2 or SSE2 when
+   the compiler targets them and fall back to scalar code otherwise */
+
+u8 *scan_find_byte(u8 *data, u8 *end, u8 value);
+/* NOTE: First byte equal to a or b, the finder uses it for both cases of a letter */
+u8 *scan_find_either_byte(u8 *data, u8 *end, u8 a, u8 b);
+u64 scan_count_byte(u8 *data, u64 size, u8 value);
+bool scan_is_ascii(u8 *data, u64 size);
+/* NOTE: Size of the run of ascii bytes at the start of data */
+u64 scan_ascii_size(u8 *data, u64 size);
+/* NOTE: Copy the ascii code units at the start of the utf16 data into des, one byte
+   each, and return how many were copied */
+u64 scan_narrow_utf16_ascii(u8 *des, u8 *data, u64 unit_count, bool big_endian);
+/* NOTE: Write every ascii byte of data into des as a utf16 code unit */
+void scan_widen_ascii_utf16(u8 *des, u8 *data, u64 size, bool big_endian);
+/* NOTE: Count the control bytes that do not show up in text files, everything
+   below 0x20 except tab, new lines, form feed, backspace and escape */
+u64 scan_count_binary_bytes(u8 *data, u64 size);
+
+#endif /* _QUILL_SCAN_H_ */
@@ -1,5 +1,6 @@
 #include "quill_tokenizer.h"
 #include "quill_line.h"
+#include "quill_utf8.h"
 
 char *keyword_list[] = {
   "u8",
@@ -94,8 +95,9 @@ void token_print(Token token) {
   printf("Token Type: %s\n", token_type_to_string[token.type]);
   printf("Token Content: ");
   for(u32 i = token.start; i < token.end; ++i) {
-    u8 codepoint = line_get_codepoint_at(token.line, i);
-    printf("%c", codepoint);
+    u8 bytes[UTF8_MAX_SIZE];
+    u32 size = utf8_encode(line_get_codepoint_at(token.line, i), bytes);
+    printf("%.*s", (i32)size, (char *)bytes);
   }
   printf("\n");
 }
@@ -115,14 +117,15 @@ void tokenier_set_line(Tokenizer *tokenizer, Line *line) {
   tokenizer->size = line_size(line);
 }
 
-static inline bool is_digit(u8 codepoint) {
+static inline bool is_digit(u32 codepoint) {
   return (codepoint >= '0') && (codepoint <= '9');
 }
 
-static inline bool is_alpha(u8 codepoint) {
-/* TODO: Need to take in consideration UTF8 codepoints */
+static inline bool is_alpha(u32 codepoint) {
+  /* NOTE: Every codepoint outside of ascii is treated as part of a word */
   return ((codepoint >= 'A') && (codepoint <= 'Z')) ||
-      ((codepoint >= 'a') && (codepoint <= 'z'));
+      ((codepoint >= 'a') && (codepoint <= 'z')) ||
+      (codepoint >= 0x80);
 }
 
 static void tokenizer_skip_white_space(Tokenizer *tokenizer) {
@@ -143,7 +146,10 @@ bool tokenizer_next_token(Tokenizer *tokenizer, Token *token) {
       return tokenizer_parse_multiline_comment(tokenizer, token);
     }
 
-    u8 codepoit = line_get_codepoint_at(tokenizer->line, tokenizer->current);
+    u32 codepoit = line_get_codepoint_at(tokenizer->line, tokenizer->current);
+    if(codepoit >= 0x80) {
+      return tokenizer_parse_word(tokenizer, token);
+    }
 
     switch(codepoit) {
 
@@ -154,7 +160,7 @@ bool tokenizer_next_token(Tokenizer *tokenizer, Token *token) {
 #if 0
     case '.': {
       assert((tokenizer->current + 1) < tokenizer->size);
-      u8 next_codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current + 1);
+      u32 next_codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current + 1);
       if(is_digit(next_codepoint)) {
         tokenizer_parse_number(tokenizer, token);
       }
@@ -177,7 +183,7 @@ bool tokenizer_next_token(Tokenizer *tokenizer, Token *token) {
 
     case '/': {
       if((tokenizer->current + 1) < tokenizer->size) {
-        u8 next_codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current + 1);
+        u32 next_codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current + 1);
         if(next_codepoint == '/') {
           return tokenizer_parse_comment(tokenizer, token);
         } else if (next_codepoint == '*') {
@@ -201,7 +207,7 @@ bool tokenizer_next_token(Tokenizer *tokenizer, Token *token) {
 
 bool tokenizer_parse_number(Tokenizer *tokenizer, Token *token) {
   u32 start = tokenizer->current;
-  u8 codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current);
+  u32 codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current);
 
   while((is_digit(codepoint)) || (codepoint == '.') ||
         (codepoint == 'x') || (codepoint == 'b') ||
@@ -239,7 +245,7 @@ bool tokenizer_parse_word(Tokenizer *tokenizer, Token *token) {
 
   assert(tokenizer->current < line_size(tokenizer->line));
 
-  u8 codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current);
+  u32 codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current);
   while(is_alpha(codepoint) || (codepoint == '_') || is_digit(codepoint)) {
 
     ++tokenizer->current;
@@ -269,7 +275,7 @@ bool tokenizer_parse_string(Tokenizer *tokenizer, Token *token) {
 
   assert(tokenizer->current < line_size(tokenizer->line));
 
-  u8 codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current);
+  u32 codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current);
   assert(codepoint == '"');
   ++tokenizer->current;
 
@@ -298,8 +304,8 @@ bool tokenizer_parse_string(Tokenizer *tokenizer, Token *token) {
 bool tokenizer_parse_multiline_comment(Tokenizer *tokenizer, Token *token) {
   u32 start = tokenizer->current;
 
-  u8 codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current++);
-  u8 next_codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current);
+  u32 codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current++);
+  u32 next_codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current);
 
   if(!tokenizer->on_comment) {
     assert((codepoint == '/') && (next_codepoint == '*'));
@@ -332,8 +338,8 @@ bool tokenizer_parse_multiline_comment(Tokenizer *tokenizer, Token *token) {
 
 bool tokenizer_parse_comment(Tokenizer *tokenizer, Token *token) {
   u32 start = tokenizer->current;
-  u8 codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current++);
-  u8 next_codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current);
+  u32 codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current++);
+  u32 next_codepoint = line_get_codepoint_at(tokenizer->line, tokenizer->current);
   assert((codepoint == '/') && (next_codepoint == '/'));
 
   tokenizer->current = tokenizer->size;
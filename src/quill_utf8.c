@@ -0,0 +1,69 @@
+#include "quill_utf8.h"
+
+static inline bool utf8_is_continuation(u8 byte) {
+  return (byte & 0xc0) == 0x80;
+}
+
+u32 utf8_sequence_size(u8 lead) {
+  if(lead < 0x80) {
+    return 1;
+  } else if(lead >= 0xc2 && lead <= 0xdf) {
+    return 2;
+  } else if(lead >= 0xe0 && lead <= 0xef) {
+    return 3;
+  } else if(lead >= 0xf0 && lead <= 0xf4) {
+    return 4;
+  }
+  /* NOTE: Continuation bytes, overlong leads and leads past U+10FFFF */
+  return 1;
+}
+
+u32 utf8_decode(u8 *data, u32 size, u32 *codepoint) {
+  assert(size > 0);
+  u8 lead = data[0];
+  u32 sequence_size = utf8_sequence_size(lead);
+  if(sequence_size == 1) {
+    *codepoint = (lead < 0x80) ? lead : UTF8_REPLACEMENT_CODEPOINT;
+    return 1;
+  }
+  if(sequence_size > size) {
+    *codepoint = UTF8_REPLACEMENT_CODEPOINT;
+    return 1;
+  }
+  u32 result = lead & (0x7f >> sequence_size);
+  for(u32 i = 1; i < sequence_size; ++i) {
+    if(!utf8_is_continuation(data[i])) {
+      *codepoint = UTF8_REPLACEMENT_CODEPOINT;
+      return 1;
+    }
+    result = (result << 6) | (data[i] & 0x3f);
+  }
+  *codepoint = result;
+  return sequence_size;
+}
+
+u32 utf8_encode(u32 codepoint, u8 *des) {
+  if(codepoint < 0x80) {
+    des[0] = (u8)codepoint;
+    return 1;
+  } else if(codepoint < 0x800) {
+    des[0] = (u8)(0xc0 | (codepoint >> 6));
+    des[1] = (u8)(0x80 | (codepoint & 0x3f));
+    return 2;
+  } else if(codepoint < 0x10000) {
+    if(codepoint >= 0xd800 && codepoint <= 0xdfff) {
+      codepoint = UTF8_REPLACEMENT_CODEPOINT;
+    }
+    des[0] = (u8)(0xe0 | (codepoint >> 12));
+    des[1] = (u8)(0x80 | ((codepoint >> 6) & 0x3f));
+    des[2] = (u8)(0x80 | (codepoint & 0x3f));
+    return 3;
+  } else if(codepoint <= 0x10ffff) {
+    des[0] = (u8)(0xf0 | (codepoint >> 18));
+    des[1] = (u8)(0x80 | ((codepoint >> 12) & 0x3f));
+    des[2] = (u8)(0x80 | ((codepoint >> 6) & 0x3f));
+    des[3] = (u8)(0x80 | (codepoint & 0x3f));
+    return 4;
+  }
+  return utf8_encode(UTF8_REPLACEMENT_CODEPOINT, des);
+}
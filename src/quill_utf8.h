@@ -0,0 +1,15 @@
+#ifndef _QUILL_UTF8_H_
+#define _QUILL_UTF8_H_
+
+#include "quill.h"
+
+#define UTF8_MAX_SIZE 4
+#define UTF8_REPLACEMENT_CODEPOINT 0xfffd
+
+/* NOTE: Malformed sequences are decoded one byte at a time as the replacement
+   codepoint, so every byte of a line belongs to exactly one column */
+u32 utf8_sequence_size(u8 lead);
+u32 utf8_decode(u8 *data, u32 size, u32 *codepoint);
+u32 utf8_encode(u32 codepoint, u8 *des);
+
+#endif /* _QUILL_UTF8_H_ */
@@ -1,3 +1,6 @@
+/* NOTE: madvise is not part of c99, the linux specific includes below need it */
+#define _DEFAULT_SOURCE
+
 #include <SDL2/SDL.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -8,13 +11,26 @@
 
 /* TODO: This is linux specific, Remove it from sdl_quill.c */
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
 #include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <signal.h>
+#include <stdint.h>
 /* -------------------------------------------------------- */
 
 #include "quill_data_structures.h"
 #include "quill_file.h"
+#include "quill_folder.h"
 #include "quill_editor.h"
 #include "quill_application.h"
+#include "quill_utf8.h"
 
 #define QUILL_PLATFORM
 
@@ -57,39 +73,42 @@ QUILL_PLATFORM_API void platform_set_clipboard(u8 *buffer) {
   }
 }
 
-QUILL_PLATFORM_API Folder *platform_load_folder(u8 *foldername) {
-  Folder *folder = folder_create(foldername);
-
+QUILL_PLATFORM_API bool platform_list_folder(u8 *foldername, PlatformFolderEntry **entries) {
   DIR *directory = opendir((char *)foldername);
   if(!directory) {
-    printf("Cannot load folder: %s\n", foldername);
-    exit(-1);
+    return false;
   }
 
-  static u8 current_dir[256];
-  u32 current_dir_size = strlen((char *)foldername);
-  SDL_memcpy(current_dir, foldername, current_dir_size);
-  current_dir[current_dir_size++] = '/';
-
-  struct dirent *node = readdir(directory);
-  while(node) {
-    /* TODO: If the node is a directory this function have to recursively call itself */
-    if( !strcmp(node->d_name, ".") || !strcmp(node->d_name, "..")) {
-      node = readdir(directory);
+  struct dirent *node;
+  while((node = readdir(directory)) != 0) {
+    if(!strcmp(node->d_name, ".") || !strcmp(node->d_name, "..")) {
+      continue;
+    }
+    u32 name_size = strlen(node->d_name);
+    struct stat node_stat;
+    if(name_size >= sizeof((*entries)->name) ||
+       fstatat(dirfd(directory), node->d_name, &node_stat, AT_SYMLINK_NOFOLLOW) != 0) {
+      continue;
+    }
+    /* NOTE: Links to files are listed with the file they point to */
+    if(S_ISLNK(node_stat.st_mode)) {
+      if(fstatat(dirfd(directory), node->d_name, &node_stat, 0) != 0 || S_ISDIR(node_stat.st_mode)) {
+        continue;
+      }
+    }
+    if(!S_ISDIR(node_stat.st_mode) && !S_ISREG(node_stat.st_mode)) {
       continue;
     }
 
-    u32 file_name_size = strlen(node->d_name);
-    memcpy(current_dir + current_dir_size, node->d_name, file_name_size);
-    u8 *filepath = current_dir;
-    filepath[current_dir_size + file_name_size] = 0;
-
-    File *file = file_load_from_existing_file(filepath);
-    vector_push(folder->files, file);
-    node = readdir(directory);
+    PlatformFolderEntry entry;
+    memcpy(entry.name, node->d_name, name_size + 1);
+    entry.is_folder = S_ISDIR(node_stat.st_mode);
+    entry.size = (u64)node_stat.st_size;
+    entry.modified_time = (u64)node_stat.st_mtim.tv_sec * 1000000000ull + (u64)node_stat.st_mtim.tv_nsec;
+    vector_push(*entries, entry);
   }
-
-  return folder;
+  closedir(directory);
+  return true;
 }
 
 QUILL_PLATFORM_API ByteArray load_entire_file(u8 *filename) {
@@ -109,6 +128,855 @@ QUILL_PLATFORM_API ByteArray load_entire_file(u8 *filename) {
   return result;
 }
 
+static void platform_file_info_from_stat(struct stat *file_stat, PlatformFileInfo *info) {
+  info->size = (u64)file_stat->st_size;
+  info->modified_time = (u64)file_stat->st_mtim.tv_sec * 1000000000ull + (u64)file_stat->st_mtim.tv_nsec;
+  info->device = (u64)file_stat->st_dev;
+  info->inode = (u64)file_stat->st_ino;
+}
+
+QUILL_PLATFORM_API bool platform_get_file_info(u8 *filename, PlatformFileInfo *info) {
+  struct stat file_stat;
+  if(stat((char *)filename, &file_stat) != 0) {
+    return false;
+  }
+  platform_file_info_from_stat(&file_stat, info);
+  return true;
+}
+
+QUILL_PLATFORM_API u64 platform_read_file_head(u8 *filename, u8 *buffer, u64 size) {
+  int fd = open((char *)filename, O_RDONLY);
+  if(fd < 0) {
+    return 0;
+  }
+  u64 total = 0;
+  while(total < size) {
+    ssize_t result = read(fd, buffer + total, (size_t)(size - total));
+    if(result < 0 && errno == EINTR) {
+      continue;
+    }
+    if(result <= 0) {
+      break;
+    }
+    total += (u64)result;
+  }
+  close(fd);
+  return total;
+}
+
+QUILL_PLATFORM_API bool platform_try_read_file(u8 *filename, ByteArray *bytes, PlatformFileInfo *info) {
+  bytes->data = 0;
+  bytes->size = 0;
+
+  int fd = open((char *)filename, O_RDONLY);
+  if(fd < 0) {
+    return false;
+  }
+  struct stat file_stat;
+  if(fstat(fd, &file_stat) != 0) {
+    close(fd);
+    return false;
+  }
+  platform_file_info_from_stat(&file_stat, info);
+  u64 size = (u64)file_stat.st_size;
+  u8 *buffer = (u8 *)malloc(size ? size : 1);
+  u64 total = 0;
+  while(total < size) {
+    ssize_t result = read(fd, buffer + total, (size_t)(size - total));
+    if(result < 0 && errno == EINTR) {
+      continue;
+    }
+    if(result < 0) {
+      free(buffer);
+      close(fd);
+      return false;
+    }
+    if(result == 0) {
+      break;
+    }
+    total += (u64)result;
+  }
+  close(fd);
+  /* NOTE: A file truncated while it was read is kept at the bytes that were there */
+  info->size = total;
+  bytes->data = buffer;
+  bytes->size = total;
+  return true;
+}
+
+/* NOTE: The pages of a mapped file that is truncated on disk raise SIGBUS when they
+   are touched. The guard puts zero pages in their place so the editor keeps running,
+   the file finds out about the truncation when it is reloaded. The handler only
+   reads the table, guarding and unguarding take the lock. A full table is copied
+   into one twice its size, the old one is never freed because the handler may
+   still be reading it */
+#define PLATFORM_GUARD_TABLE_MIN_CAPACITY 256
+
+typedef struct PlatformGuardTable {
+  u32 capacity;
+  MappedFile mappings[];
+} PlatformGuardTable;
+
+static PlatformGuardTable *platform_guard_table;
+static SDL_mutex *platform_guard_mutex;
+static u64 platform_guard_page_size;
+
+static void platform_mapping_guard(int signal_number, siginfo_t *signal_info, void *context) {
+  (void)signal_number;
+  (void)context;
+  u8 *address = (u8 *)signal_info->si_addr;
+  PlatformGuardTable *table = __atomic_load_n(&platform_guard_table, __ATOMIC_ACQUIRE);
+  for(u32 i = 0; table && i < table->capacity; ++i) {
+    u8 *data = __atomic_load_n(&table->mappings[i].data, __ATOMIC_ACQUIRE);
+    u64 size = __atomic_load_n(&table->mappings[i].size, __ATOMIC_ACQUIRE);
+    if(data && address >= data && address < data + size) {
+      u8 *page = (u8 *)((uintptr_t)address & ~(uintptr_t)(platform_guard_page_size - 1));
+      void *zero = mmap(page, (size_t)platform_guard_page_size, PROT_READ,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+      if(zero != MAP_FAILED) {
+        return;
+      }
+    }
+  }
+  /* NOTE: Not a page of a mapped file, the editor ends the way it would without the guard */
+  signal(SIGBUS, SIG_DFL);
+  raise(SIGBUS);
+}
+
+static PlatformGuardTable *platform_guard_table_create(u32 capacity) {
+  u64 size = sizeof(PlatformGuardTable) + sizeof(MappedFile) * capacity;
+  PlatformGuardTable *table = (PlatformGuardTable *)malloc(size);
+  memset(table, 0, size);
+  table->capacity = capacity;
+  return table;
+}
+
+static void platform_guard_mappings(void) {
+  platform_guard_page_size = (u64)sysconf(_SC_PAGESIZE);
+  platform_guard_mutex = SDL_CreateMutex();
+  __atomic_store_n(&platform_guard_table, platform_guard_table_create(PLATFORM_GUARD_TABLE_MIN_CAPACITY), __ATOMIC_RELEASE);
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = platform_mapping_guard;
+  action.sa_flags = SA_SIGINFO;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGBUS, &action, 0);
+}
+
+static void platform_guard_mapping(MappedFile mapping) {
+  SDL_LockMutex(platform_guard_mutex);
+  PlatformGuardTable *table = platform_guard_table;
+  u32 index = 0;
+  while(index < table->capacity && table->mappings[index].data) {
+    ++index;
+  }
+  if(index == table->capacity) {
+    /* NOTE: The new table is filled before the handler can see it */
+    PlatformGuardTable *grown = platform_guard_table_create(table->capacity * 2);
+    memcpy(grown->mappings, table->mappings, sizeof(MappedFile) * table->capacity);
+    __atomic_store_n(&platform_guard_table, grown, __ATOMIC_RELEASE);
+    table = grown;
+  }
+  __atomic_store_n(&table->mappings[index].size, mapping.size, __ATOMIC_RELEASE);
+  __atomic_store_n(&table->mappings[index].data, mapping.data, __ATOMIC_RELEASE);
+  SDL_UnlockMutex(platform_guard_mutex);
+}
+
+static void platform_unguard_mapping(MappedFile mapping) {
+  SDL_LockMutex(platform_guard_mutex);
+  PlatformGuardTable *table = platform_guard_table;
+  for(u32 i = 0; i < table->capacity; ++i) {
+    if(table->mappings[i].data == mapping.data) {
+      __atomic_store_n(&table->mappings[i].data, (u8 *)0, __ATOMIC_RELEASE);
+      __atomic_store_n(&table->mappings[i].size, 0, __ATOMIC_RELEASE);
+      break;
+    }
+  }
+  SDL_UnlockMutex(platform_guard_mutex);
+}
+
+QUILL_PLATFORM_API bool platform_try_map_file(u8 *filename, MappedFile *mapping, PlatformFileInfo *info) {
+  mapping->data = 0;
+  mapping->size = 0;
+
+  int fd = open((char *)filename, O_RDONLY);
+  if(fd < 0) {
+    return false;
+  }
+  struct stat file_stat;
+  if(fstat(fd, &file_stat) != 0) {
+    close(fd);
+    return false;
+  }
+  platform_file_info_from_stat(&file_stat, info);
+  if(file_stat.st_size > 0) {
+    /* NOTE: MAP_PRIVATE so the pages are copy on write and the file on disk is never touched */
+    void *data = mmap(0, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data == MAP_FAILED) {
+      close(fd);
+      return false;
+    }
+    mapping->data = (u8 *)data;
+    mapping->size = (u64)file_stat.st_size;
+    platform_guard_mapping(*mapping);
+  }
+  close(fd);
+  return true;
+}
+
+QUILL_PLATFORM_API MappedFile platform_map_file(u8 *filename) {
+  MappedFile mapping;
+  PlatformFileInfo info;
+  if(!platform_try_map_file(filename, &mapping, &info)) {
+    printf("Cannot load file: %s\n", filename);
+    exit(-1);
+  }
+  return mapping;
+}
+
+QUILL_PLATFORM_API void platform_unmap_file(MappedFile mapping) {
+  if(mapping.data) {
+    platform_unguard_mapping(mapping);
+    munmap(mapping.data, (size_t)mapping.size);
+  }
+}
+
+static void platform_mapped_range_advise(MappedFile mapping, u64 offset, u64 size, int advice) {
+  if(!mapping.data || offset >= mapping.size) {
+    return;
+  }
+  /* NOTE: madvise wants a page aligned address */
+  u64 page_size = (u64)sysconf(_SC_PAGESIZE);
+  u64 start = offset & ~(page_size - 1);
+  u64 end = MIN(offset + size, mapping.size);
+  madvise(mapping.data + start, (size_t)(end - start), advice);
+}
+
+QUILL_PLATFORM_API void platform_release_mapped_range(MappedFile mapping, u64 offset, u64 size) {
+  platform_mapped_range_advise(mapping, offset, size, MADV_DONTNEED);
+}
+
+QUILL_PLATFORM_API void platform_prefetch_mapped_range(MappedFile mapping, u64 offset, u64 size) {
+  platform_mapped_range_advise(mapping, offset, size, MADV_WILLNEED);
+}
+
+/* NOTE: Linux does not take more iovecs than this in one writev */
+#define PLATFORM_WRITE_BATCH_SIZE 1024
+
+static bool platform_write_spans(int fd, ByteArray *spans, u32 span_count) {
+  struct iovec iovecs[PLATFORM_WRITE_BATCH_SIZE];
+  u32 span_index = 0;
+  u64 span_offset = 0;
+  while(span_index < span_count) {
+    int iovec_count = 0;
+    for(u32 i = span_index; i < span_count && iovec_count < PLATFORM_WRITE_BATCH_SIZE; ++i) {
+      u64 offset = (i == span_index) ? span_offset : 0;
+      iovecs[iovec_count].iov_base = spans[i].data + offset;
+      iovecs[iovec_count].iov_len = (size_t)(spans[i].size - offset);
+      ++iovec_count;
+    }
+    ssize_t written = writev(fd, iovecs, iovec_count);
+    if(written < 0 && errno == EINTR) {
+      continue;
+    }
+    if(written <= 0) {
+      return false;
+    }
+    /* NOTE: Writes can be short, the next batch starts at the first byte not written */
+    u64 remainder = (u64)written;
+    while(span_index < span_count && remainder >= spans[span_index].size - span_offset) {
+      remainder -= spans[span_index].size - span_offset;
+      span_offset = 0;
+      ++span_index;
+    }
+    span_offset += remainder;
+  }
+  return true;
+}
+
+static void platform_sync_parent_folder(char *filename) {
+  char foldername[PATH_MAX];
+  char *separator = strrchr(filename, '/');
+  if(!separator) {
+    strcpy(foldername, ".");
+  } else if(separator == filename) {
+    strcpy(foldername, "/");
+  } else {
+    u32 size = MIN((u32)(separator - filename), (u32)sizeof(foldername) - 1);
+    memcpy(foldername, filename, size);
+    foldername[size] = 0;
+  }
+  int fd = open(foldername, O_RDONLY);
+  if(fd >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+}
+
+/* NOTE: Writes over the file itself, not atomic, a failed write leaves part of the file */
+static bool platform_write_file_spans_in_place(char *filename, ByteArray *spans, u32 span_count, PlatformFileInfo *info) {
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0) {
+    return false;
+  }
+  bool result = platform_write_spans(fd, spans, span_count) && fsync(fd) == 0;
+  struct stat written_stat;
+  result = result && fstat(fd, &written_stat) == 0;
+  if(result) {
+    platform_file_info_from_stat(&written_stat, info);
+  }
+  return (close(fd) == 0) && result;
+}
+
+QUILL_PLATFORM_API bool platform_write_file_spans(u8 *filename, ByteArray *spans, u32 span_count, PlatformFileInfo *info, bool allow_in_place) {
+  /* NOTE: A symlink is followed, the file it points to is the one replaced */
+  char target[PATH_MAX];
+  if(!realpath((char *)filename, target)) {
+    if(strlen((char *)filename) >= sizeof(target)) {
+      printf("Cannot save file: %s\n", filename);
+      return false;
+    }
+    strcpy(target, (char *)filename);
+  }
+  struct stat file_stat;
+  bool exists = (stat(target, &file_stat) == 0);
+  /* NOTE: A rename would leave the other hard links with the old file */
+  bool in_place = allow_in_place && exists && file_stat.st_nlink > 1;
+
+  char temp_name[PATH_MAX];
+  int fd = -1;
+  if(!in_place && snprintf(temp_name, sizeof(temp_name), "%s.XXXXXX", target) < (int)sizeof(temp_name)) {
+    fd = mkstemp(temp_name);
+  }
+  if(fd >= 0 && exists) {
+    /* NOTE: The temporary file is created private by the user saving, it takes the
+       mode, the owner and the group of the file it replaces */
+    fchmod(fd, file_stat.st_mode & 07777);
+    bool owned = (file_stat.st_uid == geteuid() && file_stat.st_gid == getegid()) ||
+                 fchown(fd, file_stat.st_uid, file_stat.st_gid) == 0;
+    if(!owned && allow_in_place) {
+      close(fd);
+      unlink(temp_name);
+      fd = -1;
+    }
+  }
+  if(fd < 0) {
+    /* NOTE: A writable file in a folder that is not, or one that cannot keep its owner
+       or links through a rename, is written in place when the spans allow it */
+    if(allow_in_place && platform_write_file_spans_in_place(target, spans, span_count, info)) {
+      return true;
+    }
+    printf("Cannot save file: %s\n", filename);
+    return false;
+  }
+
+  bool result = platform_write_spans(fd, spans, span_count) && fsync(fd) == 0;
+  /* NOTE: The rename keeps the inode, so this is the file that ends up at filename */
+  struct stat written_stat;
+  result = result && fstat(fd, &written_stat) == 0;
+  if(result) {
+    platform_file_info_from_stat(&written_stat, info);
+  }
+  result = (close(fd) == 0) && result;
+  if(result && rename(temp_name, target) == 0) {
+    /* NOTE: The rename is only durable once the folder is on disk too */
+    platform_sync_parent_folder(target);
+    return true;
+  }
+  unlink(temp_name);
+  printf("Cannot save file: %s\n", filename);
+  return false;
+}
+
+QUILL_PLATFORM_API void *platform_open_append_file(u8 *filename, bool truncate) {
+  int fd = open((char *)filename, O_WRONLY | O_CREAT | O_APPEND | (truncate ? O_TRUNC : 0), 0644);
+  if(fd < 0) {
+    printf("Cannot open file: %s\n", filename);
+    return 0;
+  }
+  /* NOTE: The descriptor is stored in the handle plus one so zero stays the error */
+  return (void *)(intptr_t)(fd + 1);
+}
+
+QUILL_PLATFORM_API bool platform_append_file(void *file, u8 *data, u64 size) {
+  int fd = (int)(intptr_t)file - 1;
+  while(size > 0) {
+    ssize_t written = write(fd, data, (size_t)size);
+    if(written < 0 && errno == EINTR) {
+      continue;
+    }
+    if(written <= 0) {
+      return false;
+    }
+    data += written;
+    size -= (u64)written;
+  }
+  return true;
+}
+
+QUILL_PLATFORM_API void platform_close_append_file(void *file) {
+  close((int)(intptr_t)file - 1);
+}
+
+QUILL_PLATFORM_API void *platform_open_temp_file(void) {
+  char name[] = "/tmp/quill-XXXXXX";
+  int fd = mkstemp(name);
+  if(fd < 0) {
+    printf("Cannot create temp file\n");
+    return 0;
+  }
+  unlink(name);
+  return (void *)(intptr_t)(fd + 1);
+}
+
+QUILL_PLATFORM_API bool platform_read_file_at(void *file, u64 offset, u8 *buffer, u64 size) {
+  int fd = (int)(intptr_t)file - 1;
+  while(size > 0) {
+    ssize_t result = pread(fd, buffer, (size_t)size, (off_t)offset);
+    if(result < 0 && errno == EINTR) {
+      continue;
+    }
+    if(result <= 0) {
+      return false;
+    }
+    buffer += result;
+    offset += (u64)result;
+    size -= (u64)result;
+  }
+  return true;
+}
+
+QUILL_PLATFORM_API bool platform_file_exists(u8 *filename) {
+  struct stat file_stat;
+  return stat((char *)filename, &file_stat) == 0;
+}
+
+QUILL_PLATFORM_API bool platform_rename_file(u8 *filename, u8 *new_filename) {
+  return rename((char *)filename, (char *)new_filename) == 0;
+}
+
+QUILL_PLATFORM_API void platform_delete_file(u8 *filename) {
+  unlink((char *)filename);
+}
+
+QUILL_PLATFORM_API bool platform_create_folder(u8 *foldername) {
+  return mkdir((char *)foldername, 0755) == 0 || errno == EEXIST;
+}
+
+QUILL_PLATFORM_API void *platform_create_thread(PlatformThreadProc *proc, void *data) {
+  SDL_Thread *thread = SDL_CreateThread(proc, "quill", data);
+  if(!thread) {
+    printf("Cannot create thread: %s\n", SDL_GetError());
+    exit(-1);
+  }
+  return thread;
+}
+
+QUILL_PLATFORM_API i32 platform_wait_thread(void *thread) {
+  int result = 0;
+  SDL_WaitThread((SDL_Thread *)thread, &result);
+  return result;
+}
+
+QUILL_PLATFORM_API u32 platform_get_processor_count(void) {
+  return (u32)MAX(SDL_GetCPUCount(), 1);
+}
+
+QUILL_PLATFORM_API void platform_sleep(u32 milliseconds) {
+  SDL_Delay(milliseconds);
+}
+
+/* NOTE: Only one wake up event is queued at a time, the main loop clears this when it handles it */
+static bool platform_wake_up_pending;
+
+QUILL_PLATFORM_API void platform_wake_up(void) {
+  if(__atomic_exchange_n(&platform_wake_up_pending, true, __ATOMIC_ACQ_REL)) {
+    return;
+  }
+  SDL_Event event;
+  memset(&event, 0, sizeof(event));
+  event.type = SDL_USEREVENT;
+  SDL_PushEvent(&event);
+}
+
+/* NOTE: The pool starts with the first read, requests and completions are vectors
+   behind one mutex and the semaphore counts the requests waiting */
+typedef struct PlatformReadPool {
+  SDL_Thread *threads[PLATFORM_READ_THREAD_COUNT];
+  SDL_mutex *mutex;
+  SDL_sem *pending;
+  PlatformFileRead **requests;
+  u32 next_request;
+  PlatformFileRead **completed;
+  bool stop;
+} PlatformReadPool;
+
+static PlatformReadPool platform_read_pool;
+
+static bool platform_read_file(u8 *filename, ByteArray *bytes, PlatformFileInfo *info) {
+  int fd = open((char *)filename, O_RDONLY);
+  if(fd < 0) {
+    return false;
+  }
+  struct stat file_stat;
+  if(fstat(fd, &file_stat) != 0) {
+    close(fd);
+    return false;
+  }
+  platform_file_info_from_stat(&file_stat, info);
+  u64 size = (u64)file_stat.st_size;
+  u8 *data = (u8 *)malloc(MAX(size, 1));
+  u64 offset = 0;
+  while(offset < size) {
+    ssize_t result = read(fd, data + offset, (size_t)(size - offset));
+    if(result < 0 && errno == EINTR) {
+      continue;
+    }
+    if(result <= 0) {
+      break;
+    }
+    offset += (u64)result;
+  }
+  close(fd);
+  /* NOTE: A file that shrank while it was read keeps what was there */
+  bytes->data = data;
+  bytes->size = offset;
+  return offset == size;
+}
+
+static int platform_read_thread(void *data) {
+  PlatformReadPool *pool = (PlatformReadPool *)data;
+  for(;;) {
+    SDL_SemWait(pool->pending);
+    SDL_LockMutex(pool->mutex);
+    if(pool->stop) {
+      SDL_UnlockMutex(pool->mutex);
+      break;
+    }
+    PlatformFileRead *read = pool->requests[pool->next_request++];
+    if(pool->next_request == vector_size(pool->requests)) {
+      vector_clear(pool->requests);
+      pool->next_request = 0;
+    }
+    SDL_UnlockMutex(pool->mutex);
+
+    read->success = platform_read_file(read->filename, &read->bytes, &read->info);
+
+    SDL_LockMutex(pool->mutex);
+    vector_push(pool->completed, read);
+    SDL_UnlockMutex(pool->mutex);
+    platform_wake_up();
+  }
+  return 0;
+}
+
+static void platform_free_file_read(PlatformFileRead *read) {
+  free(read->bytes.data);
+  free(read->filename);
+  free(read);
+}
+
+QUILL_PLATFORM_API void platform_read_file_async(u8 *filename, void *element, void *data) {
+  PlatformReadPool *pool = &platform_read_pool;
+  if(!pool->mutex) {
+    pool->mutex = SDL_CreateMutex();
+    pool->pending = SDL_CreateSemaphore(0);
+    if(!pool->mutex || !pool->pending) {
+      printf("Cannot create read pool: %s\n", SDL_GetError());
+      exit(-1);
+    }
+    for(u32 i = 0; i < PLATFORM_READ_THREAD_COUNT; ++i) {
+      pool->threads[i] = (SDL_Thread *)platform_create_thread(platform_read_thread, pool);
+    }
+  }
+
+  PlatformFileRead *read = (PlatformFileRead *)malloc(sizeof(PlatformFileRead));
+  memset(read, 0, sizeof(PlatformFileRead));
+  u32 filename_size = strlen((char *)filename);
+  read->filename = (u8 *)malloc(filename_size + 1);
+  memcpy(read->filename, filename, filename_size + 1);
+  read->element = element;
+  read->data = data;
+
+  SDL_LockMutex(pool->mutex);
+  vector_push(pool->requests, read);
+  SDL_UnlockMutex(pool->mutex);
+  SDL_SemPost(pool->pending);
+}
+
+static void platform_dispatch_file_reads(void) {
+  PlatformReadPool *pool = &platform_read_pool;
+  if(!pool->mutex) {
+    return;
+  }
+  /* NOTE: The completions are taken out first, a handler may start new reads */
+  SDL_LockMutex(pool->mutex);
+  PlatformFileRead **completed = pool->completed;
+  pool->completed = 0;
+  SDL_UnlockMutex(pool->mutex);
+
+  for(u32 i = 0; i < vector_size(completed); ++i) {
+    PlatformFileRead *read = completed[i];
+    _element_message((Element *)read->element, MESSAGE_FILE_READ, read);
+    platform_free_file_read(read);
+  }
+  vector_free(completed);
+}
+
+QUILL_PLATFORM_API void platform_stop_file_reads(void) {
+  PlatformReadPool *pool = &platform_read_pool;
+  if(!pool->mutex) {
+    return;
+  }
+  SDL_LockMutex(pool->mutex);
+  pool->stop = true;
+  SDL_UnlockMutex(pool->mutex);
+  for(u32 i = 0; i < PLATFORM_READ_THREAD_COUNT; ++i) {
+    SDL_SemPost(pool->pending);
+  }
+  for(u32 i = 0; i < PLATFORM_READ_THREAD_COUNT; ++i) {
+    platform_wait_thread(pool->threads[i]);
+  }
+  for(u32 i = pool->next_request; i < vector_size(pool->requests); ++i) {
+    platform_free_file_read(pool->requests[i]);
+  }
+  for(u32 i = 0; i < vector_size(pool->completed); ++i) {
+    platform_free_file_read(pool->completed[i]);
+  }
+  vector_free(pool->requests);
+  vector_free(pool->completed);
+  SDL_DestroySemaphore(pool->pending);
+  SDL_DestroyMutex(pool->mutex);
+  memset(pool, 0, sizeof(PlatformReadPool));
+}
+
+/* NOTE: A thread waits on inotify and queues the paths that changed, the main thread
+   sends them to the element. The pipe wakes the thread up when the watch is destroyed */
+typedef struct PlatformWatchFolder {
+  int descriptor;
+  u8 *name;
+} PlatformWatchFolder;
+
+typedef struct PlatformWatch {
+  void *element;
+  int fd;
+  int wake_fds[2];
+  SDL_Thread *thread;
+  SDL_mutex *mutex;
+  PlatformWatchFolder *folders;
+  u8 **changed;
+} PlatformWatch;
+
+static PlatformWatch **platform_watches;
+
+static void platform_watch_push_change(PlatformWatch *watch, int descriptor, char *name) {
+  u8 *foldername = 0;
+  for(u32 i = 0; i < vector_size(watch->folders); ++i) {
+    if(watch->folders[i].descriptor == descriptor) {
+      foldername = watch->folders[i].name;
+      break;
+    }
+  }
+  if(!foldername) {
+    return;
+  }
+  char path[PATH_MAX];
+  if(snprintf(path, sizeof(path), "%s/%s", (char *)foldername, name) >= (int)sizeof(path)) {
+    return;
+  }
+  /* NOTE: A file that is written many times before the main thread gets to it is sent once */
+  for(u32 i = 0; i < vector_size(watch->changed); ++i) {
+    if(!strcmp((char *)watch->changed[i], path)) {
+      return;
+    }
+  }
+  u32 path_size = strlen(path);
+  u8 *change = (u8 *)malloc(path_size + 1);
+  memcpy(change, path, path_size + 1);
+  vector_push(watch->changed, change);
+}
+
+static void platform_watch_remove_folder(PlatformWatch *watch, int descriptor) {
+  for(u32 i = 0; i < vector_size(watch->folders); ++i) {
+    if(watch->folders[i].descriptor == descriptor) {
+      free(watch->folders[i].name);
+      watch->folders[i] = watch->folders[vector_size(watch->folders) - 1];
+      vector_header(watch->folders)->size--;
+      return;
+    }
+  }
+}
+
+static int platform_watch_thread(void *data) {
+  PlatformWatch *watch = (PlatformWatch *)data;
+  union {
+    struct inotify_event event;
+    u8 bytes[64 * 1024];
+  } buffer;
+  struct pollfd fds[2];
+  fds[0].fd = watch->fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = watch->wake_fds[0];
+  fds[1].events = POLLIN;
+  for(;;) {
+    if(poll(fds, 2, -1) < 0) {
+      if(errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if(fds[1].revents) {
+      break;
+    }
+    ssize_t size = read(watch->fd, buffer.bytes, sizeof(buffer.bytes));
+    if(size <= 0) {
+      if(size < 0 && (errno == EINTR || errno == EAGAIN)) {
+        continue;
+      }
+      break;
+    }
+
+    SDL_LockMutex(watch->mutex);
+    u32 change_count = vector_size(watch->changed);
+    for(ssize_t offset = 0; offset < size;) {
+      struct inotify_event *event = (struct inotify_event *)(buffer.bytes + offset);
+      offset += sizeof(struct inotify_event) + event->len;
+      if(event->mask & IN_IGNORED) {
+        platform_watch_remove_folder(watch, event->wd);
+      } else if(event->len && event->name[0] != '.' && !(event->mask & IN_ISDIR)) {
+        platform_watch_push_change(watch, event->wd, event->name);
+      }
+    }
+    bool changed = vector_size(watch->changed) > change_count;
+    SDL_UnlockMutex(watch->mutex);
+    if(changed) {
+      platform_wake_up();
+    }
+  }
+  return 0;
+}
+
+QUILL_PLATFORM_API void *platform_watch_create(void *element) {
+  PlatformWatch *watch = (PlatformWatch *)malloc(sizeof(PlatformWatch));
+  memset(watch, 0, sizeof(PlatformWatch));
+  watch->element = element;
+  watch->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if(watch->fd < 0 || pipe(watch->wake_fds) != 0) {
+    printf("Cannot watch files, changes on disk are not reloaded\n");
+    if(watch->fd >= 0) {
+      close(watch->fd);
+    }
+    free(watch);
+    return 0;
+  }
+  watch->mutex = SDL_CreateMutex();
+  if(!watch->mutex) {
+    printf("Cannot create watch: %s\n", SDL_GetError());
+    exit(-1);
+  }
+  watch->thread = (SDL_Thread *)platform_create_thread(platform_watch_thread, watch);
+  vector_push(platform_watches, watch);
+  return watch;
+}
+
+QUILL_PLATFORM_API void platform_watch_folder(void *data, u8 *foldername) {
+  PlatformWatch *watch = (PlatformWatch *)data;
+  if(!watch) {
+    return;
+  }
+  /* NOTE: The lock is taken first so the thread knows the folder before its first event */
+  SDL_LockMutex(watch->mutex);
+  int descriptor = inotify_add_watch(watch->fd, (char *)foldername, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_ONLYDIR);
+  if(descriptor >= 0) {
+    PlatformWatchFolder folder;
+    u32 name_size = strlen((char *)foldername);
+    folder.descriptor = descriptor;
+    folder.name = (u8 *)malloc(name_size + 1);
+    memcpy(folder.name, foldername, name_size + 1);
+    vector_push(watch->folders, folder);
+  }
+  SDL_UnlockMutex(watch->mutex);
+}
+
+static void platform_dispatch_file_changes(void) {
+  for(u32 i = 0; i < vector_size(platform_watches); ++i) {
+    PlatformWatch *watch = platform_watches[i];
+    SDL_LockMutex(watch->mutex);
+    u8 **changed = watch->changed;
+    watch->changed = 0;
+    SDL_UnlockMutex(watch->mutex);
+
+    for(u32 j = 0; j < vector_size(changed); ++j) {
+      _element_message((Element *)watch->element, MESSAGE_FILE_CHANGED, changed[j]);
+      free(changed[j]);
+    }
+    vector_free(changed);
+  }
+}
+
+QUILL_PLATFORM_API void platform_watch_destroy(void *data) {
+  PlatformWatch *watch = (PlatformWatch *)data;
+  if(!watch) {
+    return;
+  }
+  u8 wake = 0;
+  while(write(watch->wake_fds[1], &wake, 1) < 0 && errno == EINTR) {}
+  platform_wait_thread(watch->thread);
+  close(watch->wake_fds[0]);
+  close(watch->wake_fds[1]);
+  close(watch->fd);
+
+  for(u32 i = 0; i < vector_size(platform_watches); ++i) {
+    if(platform_watches[i] == watch) {
+      platform_watches[i] = platform_watches[vector_size(platform_watches) - 1];
+      vector_header(platform_watches)->size--;
+      break;
+    }
+  }
+  for(u32 i = 0; i < vector_size(watch->folders); ++i) {
+    free(watch->folders[i].name);
+  }
+  vector_free(watch->folders);
+  for(u32 i = 0; i < vector_size(watch->changed); ++i) {
+    free(watch->changed[i]);
+  }
+  vector_free(watch->changed);
+  SDL_DestroyMutex(watch->mutex);
+  free(watch);
+}
+
+static bool font_render_glyph(FT_Face face, u32 codepoint, Glyph *glyph) {
+  FT_UInt glyph_index = FT_Get_Char_Index(face, (FT_ULong)codepoint);
+  if(glyph_index == 0) {
+    return false;
+  }
+  /* NOTE: This runs while drawing, a glyph that fails is drawn as unknown without a word */
+  FT_Error freetype_error = FT_Load_Glyph(face, glyph_index, 0);
+  if(freetype_error) {
+    return false;
+  }
+  /* NOTE: Render glyph to bitmap */
+  freetype_error = FT_Render_Glyph(face->glyph, 0);
+  if(freetype_error) {
+    return false;
+  }
+  assert(face->glyph->format == FT_GLYPH_FORMAT_BITMAP);
+
+  FT_Bitmap *bitmap = &face->glyph->bitmap;
+  glyph->w = bitmap->width;
+  glyph->h = bitmap->rows;
+  glyph->pixels = (u8 *)malloc(glyph->w * glyph->h);
+  for(u32 row = 0; row < glyph->h; ++row) {
+    memcpy(glyph->pixels + row * glyph->w, bitmap->buffer + row * bitmap->pitch, glyph->w);
+  }
+
+  glyph->bearing_x = face->glyph->bitmap_left;
+  glyph->bearing_y = face->glyph->bitmap_top;
+  glyph->advance = (u32)(face->glyph->advance.x >> 6);
+  glyph->codepoint = codepoint;
+  return true;
+}
+
 QUILL_PLATFORM_API Font *font_load_from_file(u8 *filename, u32 font_size) {
   if(!freetype_is_initialize) {
     freetype_initialize();
@@ -134,50 +1002,74 @@ QUILL_PLATFORM_API Font *font_load_from_file(u8 *filename, u32 font_size) {
   }
 
   Font *font = (Font *)malloc(sizeof(Font));
+  memset(font, 0, sizeof(Font));
+  font->face = face;
   font->line_gap = face->size->metrics.height >> 6;
   font->advance = face->size->metrics.max_advance >> 6;
   font->ascender = face->size->metrics.ascender >> 6;
   font->descender = face->size->metrics.descender >> 6;
-  for(u16 codepoint = (u16)' '; codepoint <= (u16)'~'; ++codepoint)
+  for(u32 codepoint = (u32)' '; codepoint <= (u32)'~'; ++codepoint)
   {
     Glyph *glyph = &font->glyph_table[codepoint];
-
-    FT_UInt glyph_index = FT_Get_Char_Index(face, (FT_ULong)codepoint);
-    FT_Error freetype_error = FT_Load_Glyph(face, glyph_index, 0);
-    if(freetype_error) {
-      printf("Cannot load glyph: [%d]\n", glyph_index);
-      exit(-1);
-    }
-    /* NOTE: Render glyph to bitmap */
-    freetype_error = FT_Render_Glyph(face->glyph, 0);
-    if(freetype_error) {
-      printf("Cannot render glyph: [%d]\n", glyph_index);
+    if(!font_render_glyph(face, codepoint, glyph)) {
+      printf("Cannot load glyph for codepoint: [%d]\n", codepoint);
       exit(-1);
-
     }
-    assert(face->glyph->format == FT_GLYPH_FORMAT_BITMAP);
+    assert((u32)glyph->advance == font->advance);
+  }
 
-    assert((i32)face->glyph->bitmap.width == face->glyph->bitmap.pitch);
-    u32 glyph_bitmap_size = face->glyph->bitmap.rows*face->glyph->bitmap.pitch;
-    glyph->pixels = (u8 *)malloc(glyph_bitmap_size);
-    memcpy(glyph->pixels, face->glyph->bitmap.buffer, glyph_bitmap_size);
-    glyph->w = face->glyph->bitmap.width;
-    glyph->h = face->glyph->bitmap.rows;
+  /* NOTE: The face is kept alive to rasterize the glyphs outside of ascii */
+  return font;
+}
 
-    glyph->bearing_x = face->glyph->bitmap_left;
-    glyph->bearing_y = face->glyph->bitmap_top;
-    glyph->advance = (u32)(face->glyph->advance.x >> 6);
-    assert((u32)glyph->advance == font->advance);
-    glyph->codepoint = codepoint;
+QUILL_PLATFORM_API Glyph *font_get_glyph(Font *font, u32 codepoint) {
+  Glyph *unknown_glyph = &font->glyph_table[(u32)'?'];
+  if(codepoint < 0x80) {
+    return ((codepoint < ' ') || (codepoint > '~')) ? unknown_glyph : &font->glyph_table[codepoint];
   }
 
-  FT_Done_Face(face);
+  u32 set_count = FONT_GLYPH_CACHE_SIZE / FONT_GLYPH_CACHE_WAYS;
+  u32 first = ((codepoint * 2654435761u) >> 16) % set_count * FONT_GLYPH_CACHE_WAYS;
+  u32 oldest = first;
+  u32 oldest_age = 0;
+  ++font->glyph_cache_clock;
+  for(u32 slot = first; slot < first + FONT_GLYPH_CACHE_WAYS; ++slot) {
+    if(font->glyph_cache[slot].codepoint == codepoint) {
+      font->glyph_cache_used[slot] = font->glyph_cache_clock;
+      return &font->glyph_cache[slot];
+    }
+    /* NOTE: A free slot is older than any glyph, the clock wraps so ages are differences */
+    u32 age = font->glyph_cache[slot].codepoint ? font->glyph_cache_clock - font->glyph_cache_used[slot] : 0xffffffff;
+    if(age > oldest_age) {
+      oldest = slot;
+      oldest_age = age;
+    }
+  }
 
-  return font;
+  Glyph *glyph = &font->glyph_cache[oldest];
+  /* NOTE: Codepoints the face does not have share the pixels of the unknown glyph */
+  if(glyph->codepoint && glyph->pixels != unknown_glyph->pixels) {
+    free(glyph->pixels);
+  }
+  if(!font_render_glyph((FT_Face)font->face, codepoint, glyph)) {
+    *glyph = *unknown_glyph;
+  }
+  glyph->codepoint = codepoint;
+  font->glyph_cache_used[oldest] = font->glyph_cache_clock;
+  return glyph;
 }
 
 QUILL_PLATFORM_API void font_destroy(Font *font) {
-  /* TODO: Free all bitmap of each used glyph */
+  for(u32 i = 0; i < FONT_GLYPH_CACHE_SIZE; ++i) {
+    Glyph *glyph = &font->glyph_cache[i];
+    if(glyph->codepoint && glyph->pixels != font->glyph_table[(u32)'?'].pixels) {
+      free(glyph->pixels);
+    }
+  }
+  for(u32 codepoint = (u32)' '; codepoint <= (u32)'~'; ++codepoint) {
+    free(font->glyph_table[codepoint].pixels);
+  }
+  FT_Done_Face((FT_Face)font->face);
   free(font);
 }
 
@@ -220,6 +1112,7 @@ int main(void) {
 
   platform.temp_clipboard = 0;
   platform.data = (void *)window;
+  platform_guard_mappings();
   platform.backbuffer = backbuffer_create(window_surface->w, window_surface->h, window_surface->format->BytesPerPixel);
   platform.font = font_load_from_file((u8 *)"/usr/share/fonts/truetype/liberation/LiberationMono-Regular.ttf", 14);
   //platform.font = font_load_from_file((u8 *)"/usr/share/fonts/truetype/ubuntu/UbuntuMono-R.ttf", 14);
@@ -228,7 +1121,8 @@ int main(void) {
   Editor *editor0 = editor_create(&application->element);
   Editor *editor1 = editor_create(&application->element); (void)editor1;
   application_set_current_editor(application, editor0);
-  application->folder = platform_load_folder((u8 *)"./src");
+  application->watch = platform_watch_create(&application->element);
+  application->folder_walk = folder_walk_start((u8 *)"./src", application->watch);
 
   /* NOTE: Platform events */
   SDL_Event e;
@@ -250,8 +1144,15 @@ int main(void) {
         platform_end_draw(platform.backbuffer);
       }
     } else if(e.type == SDL_TEXTINPUT) {
-      u8 codepoint = (u8)e.text.text[0];
-      element_message(application, MESSAGE_TEXTINPUT, codepoint);
+      /* NOTE: One message for each codepoint of the utf8 text */
+      u8 *text = (u8 *)e.text.text;
+      u32 text_size = strlen(e.text.text);
+      u32 index = 0;
+      while(index < text_size) {
+        u32 codepoint;
+        index += utf8_decode(text + index, text_size - index, &codepoint);
+        element_message(application, MESSAGE_TEXTINPUT, codepoint);
+      }
 
     } else if(e.type == SDL_KEYDOWN) {
 
@@ -306,6 +1207,12 @@ int main(void) {
                         (shift ? EDITOR_MOD_SHIFT : 0));
       }
 
+      else if(e.key.keysym.scancode == SDL_SCANCODE_Y) {
+        element_message(application, MESSAGE_KEYDOWN, EDITOR_KEY_Y|
+                        (ctrl ? EDITOR_MOD_CRTL : 0)|
+                        (shift ? EDITOR_MOD_SHIFT : 0));
+      }
+
       else if(e.key.keysym.scancode == SDL_SCANCODE_P) {
         u32 keycode = EDITOR_KEY_P;
         if(e.key.keysym.mod & KMOD_CTRL) {
@@ -314,6 +1221,18 @@ int main(void) {
         element_message(application, MESSAGE_KEYDOWN, keycode);
       }
 
+      else if(e.key.keysym.scancode == SDL_SCANCODE_G) {
+        element_message(application, MESSAGE_KEYDOWN, EDITOR_KEY_G|(ctrl ? EDITOR_MOD_CRTL : 0));
+      }
+
+      else if(e.key.keysym.scancode == SDL_SCANCODE_S) {
+        element_message(application, MESSAGE_KEYDOWN, EDITOR_KEY_S|(ctrl ? EDITOR_MOD_CRTL : 0));
+      }
+
+      else if(e.key.keysym.scancode == SDL_SCANCODE_T) {
+        element_message(application, MESSAGE_KEYDOWN, EDITOR_KEY_T|(ctrl ? EDITOR_MOD_CRTL : 0));
+      }
+
     } else if(e.type == SDL_MOUSEBUTTONDOWN) {
       if(e.button.button == SDL_BUTTON_LEFT) {
         EditorMessage message;
@@ -322,12 +1241,18 @@ int main(void) {
         message.button.y = e.button.y;
         element_message(application, MESSAGE_BUTTONDOWN, &message);
       }
+    } else if(e.type == SDL_USEREVENT) {
+      __atomic_store_n(&platform_wake_up_pending, false, __ATOMIC_RELEASE);
+      platform_dispatch_file_reads();
+      platform_dispatch_file_changes();
+      element_message(application, MESSAGE_BACKGROUND_UPDATE, 0);
     } else if(e.type == SDL_QUIT) {
       printf("Quitting application\n");
       break;
     }
   }
 
+  platform_stop_file_reads();
   element_destroy(application);
   backbuffer_destroy(platform.backbuffer);
   font_destroy(platform.font);